@@ -23,6 +23,7 @@
 #include "common.h"
 #include "minizip/unzip.h"
 #include <stdio.h>
+#include <limits.h>
 #include <ApplicationServices/ApplicationServices.h>
 #include <QuickLook/QuickLook.h>
 #include <CoreServices/CoreServices.h>
@@ -34,8 +35,6 @@
  */
 #define kAppleTextQLGeneratorPath	"/System/Library/QuickLook/Text.qlgenerator"
 
-#define UNZIP_BUFFER_SIZE 4096
-
 /**
  * Path to the thumnail preview in OpenDocument formatted files
  */
@@ -49,7 +48,9 @@
 ///// prototypes /////
 
 static OSErr ExtractZipArchiveContent(CFStringRef pathToArchive, const char *fileToExtract, CFMutableDataRef fileContents);
+static OSErr ExtractZipArchiveContents(CFStringRef pathToArchive, const char * const *filesToExtract, CFMutableDataRef *fileContents, OSErr *fileErrors, int numFiles);
 static bool ExtractZipArchiveHasFile(CFStringRef pathToArchive, const char *fileToExtract);
+static unzFile OpenZipArchive(const char *filePath);
 
 ///// functions /////
 
@@ -275,6 +276,27 @@ extern "C" bool DrawThumbnailPDFPageOneForOD(CFURLRef docURL, QLThumbnailRequest
 	return(toReturn);
 }
 
+/**
+ * Open a zip archive for reading.  The archive is mapped in memory so
+ * that reading its directory and entries does not cost a system call
+ * for each buffer refill.  If the archive cannot be mapped, it is opened
+ * with the default stdio based functions.
+ *
+ * @param filePath		UTF-8 path to the zip archive on disk
+ * @return handle to the opened archive, or NULL on failure
+ */
+static unzFile OpenZipArchive(const char *filePath)
+{
+	zlib_filefunc_def fileFuncs;
+	fill_mmap_filefunc(&fileFuncs);
+
+	unzFile f = unzOpen2(filePath, &fileFuncs);
+	if (!f)
+		f = unzOpen(filePath);
+
+	return(f);
+}
+
 /**
  * Extract the listing of the contents of a zip archive.  Listing is in the format of unzip -l
  *
@@ -301,7 +323,7 @@ static bool ExtractZipArchiveHasFile(CFStringRef pathToArchive, const char *file
 	// open the "content.xml" file living within the sxw and read it into
 	// a CFData structure for use with other CoreFoundation elements.
 	
-	unzFile f = unzOpen((const char *)filePath);
+	unzFile f = OpenZipArchive((const char *)filePath);
 	if (f)
 	{
 		if (unzLocateFile(f, fileToExtract, 0) == UNZ_OK)
@@ -336,9 +358,106 @@ static bool ExtractZipArchiveHasFile(CFStringRef pathToArchive, const char *file
  * @return noErr on success, else OS error code
  */
 static OSErr ExtractZipArchiveContent(CFStringRef pathToArchive, const char *fileToExtract, CFMutableDataRef fileContents)
+{
+	OSErr ret = ExtractZipArchiveContents(pathToArchive, &fileToExtract, &fileContents, NULL, 1);
+	
+	if (ret == noErr && CFDataGetLength(fileContents) < 28)
+		return(-100);
+	
+	return(ret);
+}
+
+/**
+ * Destination of the files extracted by ExtractZipArchiveContents
+ */
+struct ZipArchiveSink
+{
+	CFMutableDataRef *fileContents;
+	CFIndex *oldLengths;	// length of each data before its file, or -1
+	CFIndex *writeOffsets;	// where the next bytes of each file go
+};
+
+/**
+ * Sink of unzExtractFiles: each data is grown once to the size given by
+ * the central directory when its file starts, then filled in place.
+ */
+static int ZCALLBACK AppendZipArchiveContent(voidpf opaque, int index, const unz_file_info64 *fileInfo, const void *buf, uLong size)
+{
+	ZipArchiveSink *sink = (ZipArchiveSink *)opaque;
+	CFMutableDataRef data = sink->fileContents[index];
+
+	if (!buf)
+	{
+		if (fileInfo->uncompressed_size > (ZPOS64_T)(LONG_MAX - CFDataGetLength(data)))
+			return(UNZ_PARAMERROR);
+		sink->oldLengths[index] = CFDataGetLength(data);
+		sink->writeOffsets[index] = sink->oldLengths[index];
+		CFDataIncreaseLength(data, (CFIndex)fileInfo->uncompressed_size);
+		return(UNZ_OK);
+	}
+
+	if (size > (uLong)(CFDataGetLength(data) - sink->writeOffsets[index]))
+		return(UNZ_BADZIPFILE);
+	memcpy(CFDataGetMutableBytePtr(data) + sink->writeOffsets[index], buf, size);
+	sink->writeOffsets[index] += size;
+	return(UNZ_OK);
+}
+
+/**
+ * Extract one file of an open zip archive, in a single pass straight into
+ * its data, grown once to the size given by the central directory.  A
+ * deflated file of a mapped archive is inflated with a single call.
+ *
+ * @return noErr on success, else OS error code
+ */
+static OSErr ExtractZipArchiveFile(unzFile f, const char *fileToExtract, CFMutableDataRef fileContents)
+{
+	OSErr ret = -50;
+	unz_file_info64 fileInfo;
+
+	if (unzLocateFile(f, fileToExtract, 0) == UNZ_OK &&
+		unzGetCurrentFileInfo64(f, &fileInfo, NULL, 0, NULL, 0, NULL, 0) == UNZ_OK &&
+		fileInfo.uncompressed_size <= (ZPOS64_T)(LONG_MAX - CFDataGetLength(fileContents)))
+	{
+		CFIndex oldLength = CFDataGetLength(fileContents);
+		CFDataIncreaseLength(fileContents, (CFIndex)fileInfo.uncompressed_size);
+
+		if (unzExtractCurrentFileToBuffer(f, CFDataGetMutableBytePtr(fileContents) + oldLength, fileInfo.uncompressed_size, NULL) == UNZ_OK)
+			ret = noErr;
+		else
+			CFDataSetLength(fileContents, oldLength);
+	}
+
+	return(ret);
+}
+
+/**
+ * Given a path to a zip archive, extract the content of several files of
+ * that zip archive into mutable data structures.
+ *
+ * The files are extracted in a single pass, in the order they are stored
+ * in the archive, so that the archive is read forward whatever the order
+ * of filesToExtract.  A single file is extracted straight into its data,
+ * without going through the sink.
+ *
+ * @param pathToArchive		path to the zip archive on disk
+ * @param filesToExtract	files from the archive that should be extracted
+ * @param fileContents		mutable data that should be filled with the
+ *				contents of each subfile.  File content
+ *				will be appended onto any preexisting data
+ *				already in the ref.
+ * @param fileErrors		if not NULL, filled with noErr or the OS error
+ *				code of each subfile
+ * @param numFiles		number of files to extract
+ * @return noErr if all the files were extracted, else OS error code
+ */
+static OSErr ExtractZipArchiveContents(CFStringRef pathToArchive, const char * const *filesToExtract, CFMutableDataRef *fileContents, OSErr *fileErrors, int numFiles)
 {
 	OSErr ret = -50;
 
+	for (int i = 0; fileErrors && i < numFiles; i++)
+		fileErrors[i] = ret;
+
 	// extract the path as UTF-8 for internationalization
 	
 	CFIndex numChars=CFStringGetLength(pathToArchive);
@@ -351,35 +470,52 @@ static OSErr ExtractZipArchiveContent(CFStringRef pathToArchive, const char *fil
 	memset(filePath, '\0', numBytesUsed+1);
 	CFStringGetBytes(pathToArchive, rangeToConvert, kCFStringEncodingUTF8, 0, false, filePath, numBytesUsed+1, NULL);
 		
-	// open the "content.xml" file living within the sxw and read it into
-	// a CFData structure for use with other CoreFoundation elements.
+	// open the archive and read the files into CFData structures for use
+	// with other CoreFoundation elements.
 	
-	unzFile f = unzOpen((const char *)filePath);
-	if (f)
+	unzFile f = OpenZipArchive((const char *)filePath);
+	if (f && numFiles == 1)
 	{
-		if (unzLocateFile(f, fileToExtract, 0) == UNZ_OK)
-		{
-			if (unzOpenCurrentFile(f) == UNZ_OK)
-			{
-				ret = noErr;
+		// a single file has nothing to merge: it is extracted straight
+		// into its data rather than through the sink
+
+		ret = ExtractZipArchiveFile(f, filesToExtract[0], fileContents[0]);
+		if (fileErrors)
+			fileErrors[0] = ret;
+		unzClose(f);
+	}
+	else if (f)
+	{
+		ZipArchiveSink sink;
+		CFIndex *lengths = new CFIndex[numFiles*2];
+		int *results = new int[numFiles];
 
-				unsigned char buf[UNZIP_BUFFER_SIZE];
-				int bytesRead = 0;
-				while ((bytesRead = unzReadCurrentFile(f, buf, UNZIP_BUFFER_SIZE)) > 0)
-					CFDataAppendBytes(fileContents, buf, bytesRead);
+		sink.fileContents = fileContents;
+		sink.oldLengths = lengths;
+		sink.writeOffsets = lengths + numFiles;
+		for (int i = 0; i < numFiles; i++)
+			sink.oldLengths[i] = -1;
 
-				unzCloseCurrentFile(f);
-			}
+		if (unzExtractFiles(f, filesToExtract, numFiles, 0, AppendZipArchiveContent, &sink, results) == UNZ_OK)
+			ret = noErr;
+
+		// a file which failed is removed from its data
+
+		for (int i = 0; i < numFiles; i++)
+		{
+			if (results[i] != UNZ_OK && sink.oldLengths[i] >= 0)
+				CFDataSetLength(fileContents[i], sink.oldLengths[i]);
+			if (fileErrors)
+				fileErrors[i] = (results[i] == UNZ_OK) ? noErr : -50;
 		}
 
+		delete[] results;
+		delete[] lengths;
 		unzClose(f);
 	}
 
 	delete[] filePath;
 	
-	if (ret == noErr && CFDataGetLength(fileContents) < 28)
-		return(-100);
-	
 	return(ret);
 }
 
@@ -0,0 +1,202 @@
+/* crc32hw.h -- crc32 of the zip files with the CRC instructions of the CPU
+
+   The crc32 of the zip files is the one of zlib : crc32hw(crc,buf,len)
+   gives the same value as crc32(crc,buf,len), faster when the CPU can :
+
+   - on x86 and x86_64 (with gcc or clang), the buffer is folded 64 bytes at
+     a time with carry-less multiplies (PCLMULQDQ), then reduced with a
+     Barrett reduction, as described by Intel in "Fast CRC Computation for
+     Generic Polynomials Using PCLMULQDQ Instruction". The CPU is tested
+     once at run time : without PCLMULQDQ and SSE4.1, zlib is used.
+   - on ARMv8 built with the CRC extension (__ARM_FEATURE_CRC32, always the
+     case for the Apple CPUs), with the crc32b and crc32x instructions,
+     which use the polynomial of zlib.
+
+   The small buffers (and the tail of the large ones) still go to zlib.
+
+   If you don't want the CRC instructions, just define the symbol NOHWCRC32.
+*/
+
+#ifndef NOHWCRC32
+#  if (defined(__x86_64__) || defined(__i386__)) && \
+      (defined(__GNUC__) || defined(__clang__))
+#    define HWCRC32_PCLMUL
+#  elif defined(__aarch64__) && defined(__ARM_FEATURE_CRC32) && \
+        !defined(__ARM_BIG_ENDIAN)
+#    define HWCRC32_ARMV8
+#  endif
+#endif
+
+#ifdef HWCRC32_PCLMUL
+#include <cpuid.h>
+#include <emmintrin.h>
+#include <smmintrin.h>
+#include <wmmintrin.h>
+
+/* the buffers shorter than this go to zlib */
+#define HWCRC32_MINSIZE 64
+
+/***********************************************************************
+ * Return 1 if the CPU has PCLMULQDQ and SSE4.1 (tested at the first call)
+ */
+static int crc32hw_cpu_has_pclmul = -1;
+
+static int crc32hw_cpu()
+{
+    if (crc32hw_cpu_has_pclmul < 0)
+    {
+        unsigned int eax, ebx, ecx, edx;
+        int has = 0;
+        if (__get_cpuid(1,&eax,&ebx,&ecx,&edx))
+            has = ((ecx & (1 << 1)) != 0) &&    /* PCLMULQDQ */
+                  ((ecx & (1 << 19)) != 0);     /* SSE4.1 */
+        crc32hw_cpu_has_pclmul = has;
+    }
+    return crc32hw_cpu_has_pclmul;
+}
+
+/***********************************************************************
+ * crc32 (not inverted) of len bytes, len being a multiple of 16 and at
+ * least 64. The constants are the powers of x modulo the polynomial of
+ * the paper, in the bit reflected domain.
+ */
+__attribute__((target("pclmul,sse4.1")))
+static unsigned int crc32hw_fold(unsigned int crc, const unsigned char* buf,
+                                 unsigned int len)
+{
+    const __m128i k1k2 = _mm_set_epi64x(0x01c6e41596LL, 0x0154442bd4LL);
+    const __m128i k3k4 = _mm_set_epi64x(0x00ccaa009eLL, 0x01751997d0LL);
+    const __m128i k5k0 = _mm_set_epi64x(0, 0x0163cd6124LL);
+    const __m128i poly = _mm_set_epi64x(0x01f7011641LL, 0x01db710641LL);
+    const __m128i mask = _mm_setr_epi32(~0, 0, ~0, 0);
+    __m128i x1, x2, x3, x4, x5, x6, x7, x8;
+
+    x1 = _mm_loadu_si128((const __m128i*)(buf + 0x00));
+    x2 = _mm_loadu_si128((const __m128i*)(buf + 0x10));
+    x3 = _mm_loadu_si128((const __m128i*)(buf + 0x20));
+    x4 = _mm_loadu_si128((const __m128i*)(buf + 0x30));
+    x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128((int)crc));
+    buf += 64;
+    len -= 64;
+
+    /* fold 4 blocks of 16 bytes in parallel */
+    while (len >= 64)
+    {
+        x5 = _mm_clmulepi64_si128(x1, k1k2, 0x00);
+        x6 = _mm_clmulepi64_si128(x2, k1k2, 0x00);
+        x7 = _mm_clmulepi64_si128(x3, k1k2, 0x00);
+        x8 = _mm_clmulepi64_si128(x4, k1k2, 0x00);
+        x1 = _mm_clmulepi64_si128(x1, k1k2, 0x11);
+        x2 = _mm_clmulepi64_si128(x2, k1k2, 0x11);
+        x3 = _mm_clmulepi64_si128(x3, k1k2, 0x11);
+        x4 = _mm_clmulepi64_si128(x4, k1k2, 0x11);
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, x5),
+                           _mm_loadu_si128((const __m128i*)(buf + 0x00)));
+        x2 = _mm_xor_si128(_mm_xor_si128(x2, x6),
+                           _mm_loadu_si128((const __m128i*)(buf + 0x10)));
+        x3 = _mm_xor_si128(_mm_xor_si128(x3, x7),
+                           _mm_loadu_si128((const __m128i*)(buf + 0x20)));
+        x4 = _mm_xor_si128(_mm_xor_si128(x4, x8),
+                           _mm_loadu_si128((const __m128i*)(buf + 0x30)));
+        buf += 64;
+        len -= 64;
+    }
+
+    /* fold the 4 blocks into one */
+    x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+    x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+    x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+
+    /* fold the remaining blocks of 16 bytes */
+    while (len >= 16)
+    {
+        x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+        x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, x5),
+                           _mm_loadu_si128((const __m128i*)buf));
+        buf += 16;
+        len -= 16;
+    }
+
+    /* fold 128 bits to 64 bits */
+    x2 = _mm_clmulepi64_si128(x1, k3k4, 0x10);
+    x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), x2);
+    x2 = _mm_srli_si128(x1, 4);
+    x1 = _mm_and_si128(x1, mask);
+    x1 = _mm_clmulepi64_si128(x1, k5k0, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+
+    /* Barrett reduction to 32 bits */
+    x2 = _mm_and_si128(x1, mask);
+    x2 = _mm_clmulepi64_si128(x2, poly, 0x10);
+    x2 = _mm_and_si128(x2, mask);
+    x2 = _mm_clmulepi64_si128(x2, poly, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+
+    return (unsigned int)_mm_extract_epi32(x1, 1);
+}
+#endif /* HWCRC32_PCLMUL */
+
+#ifdef HWCRC32_ARMV8
+#include <arm_acle.h>
+#include <stdint.h>
+#include <string.h>
+
+/***********************************************************************
+ * crc32 (not inverted) of len bytes, 8 bytes at a time once aligned
+ */
+static unsigned int crc32hw_armv8(unsigned int crc, const unsigned char* buf,
+                                  unsigned int len)
+{
+    while ((len > 0) && (((size_t)buf & 7) != 0))
+    {
+        crc = __crc32b(crc, *buf++);
+        len--;
+    }
+    while (len >= 8)
+    {
+        uint64_t v;
+        memcpy(&v, buf, 8);
+        crc = __crc32d(crc, v);
+        buf += 8;
+        len -= 8;
+    }
+    while (len > 0)
+    {
+        crc = __crc32b(crc, *buf++);
+        len--;
+    }
+    return crc;
+}
+#endif /* HWCRC32_ARMV8 */
+
+/***********************************************************************
+ * Update a running crc32 with the bytes buf[0..len-1], like zlib's crc32
+ */
+static uLong crc32hw(uLong crc, const Bytef* buf, uInt len)
+{
+    if (buf == Z_NULL)
+        return crc32(crc, buf, len);
+#ifdef HWCRC32_PCLMUL
+    if ((len >= HWCRC32_MINSIZE) && (crc32hw_cpu()))
+    {
+        uInt chunk = len & ~(uInt)15;
+        crc = (~crc32hw_fold(~(unsigned int)crc, buf, chunk)) & 0xffffffffUL;
+        buf += chunk;
+        len -= chunk;
+        if (len == 0)
+            return crc;
+    }
+#endif
+#ifdef HWCRC32_ARMV8
+    return (~crc32hw_armv8(~(unsigned int)crc, buf, len)) & 0xffffffffUL;
+#else
+    return crc32(crc, buf, len);
+#endif
+}
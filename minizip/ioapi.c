@@ -13,6 +13,28 @@
 #include "zlib.h"
 #include "ioapi.h"
 
+#if !defined(NOMMAPIOAPI) && \
+    (defined(unix) || defined(__unix__) || defined(__APPLE__))
+#define MMAPIOAPI
+#endif
+
+#if !defined(NOPREADIOAPI) && \
+    (defined(unix) || defined(__unix__) || defined(__APPLE__))
+#define PREADIOAPI
+#endif
+
+#if defined(MMAPIOAPI) || defined(PREADIOAPI)
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#ifdef MMAPIOAPI
+#include <sys/mman.h>
+#endif
+
 
 
 /* I've found an old Unix (a SunOS 4.1.3_U1) without all SEEK_* defined.... */
@@ -174,4 +196,536 @@ void fill_fopen_filefunc (pzlib_filefunc_def)
     pzlib_filefunc_def->zclose_file = fclose_file_func;
     pzlib_filefunc_def->zerror_file = ferror_file_func;
     pzlib_filefunc_def->opaque = NULL;
+    pzlib_filefunc_def->zpread_file = NULL;
+    pzlib_filefunc_def->zmap_file = NULL;
+    pzlib_filefunc_def->zpwrite_file = NULL;
+}
+
+
+#ifdef MMAPIOAPI
+
+/* the whole file is mapped in memory, read and seek only move a position */
+typedef struct
+{
+    unsigned char* base;        /* start of the mapping (NULL if empty file) */
+    ZPOS64_T size;              /* size of the file and of the mapping */
+    ZPOS64_T pos;               /* current position */
+} mmap_file_stream;
+
+voidpf ZCALLBACK mmap_open_file_func OF((
+   voidpf opaque,
+   const char* filename,
+   int mode));
+
+uLong ZCALLBACK mmap_read_file_func OF((
+   voidpf opaque,
+   voidpf stream,
+   void* buf,
+   uLong size));
+
+uLong ZCALLBACK mmap_write_file_func OF((
+   voidpf opaque,
+   voidpf stream,
+   const void* buf,
+   uLong size));
+
+long ZCALLBACK mmap_tell_file_func OF((
+   voidpf opaque,
+   voidpf stream));
+
+long ZCALLBACK mmap_seek_file_func OF((
+   voidpf opaque,
+   voidpf stream,
+   uLong offset,
+   int origin));
+
+int ZCALLBACK mmap_close_file_func OF((
+   voidpf opaque,
+   voidpf stream));
+
+int ZCALLBACK mmap_error_file_func OF((
+   voidpf opaque,
+   voidpf stream));
+
+uLong ZCALLBACK mmap_pread_file_func OF((
+   voidpf opaque,
+   voidpf stream,
+   void* buf,
+   uLong size,
+   ZPOS64_T offset));
+
+const void* ZCALLBACK mmap_map_file_func OF((
+   voidpf opaque,
+   voidpf stream,
+   ZPOS64_T offset,
+   ZPOS64_T size));
+
+
+voidpf ZCALLBACK mmap_open_file_func (opaque, filename, mode)
+   voidpf opaque;
+   const char* filename;
+   int mode;
+{
+    mmap_file_stream* mfs;
+    struct stat st;
+    int fd;
+
+    /* a mapping is only used for reading */
+    if ((filename==NULL) ||
+        ((mode & ZLIB_FILEFUNC_MODE_READWRITEFILTER)!=ZLIB_FILEFUNC_MODE_READ))
+        return NULL;
+
+    fd = open(filename, O_RDONLY);
+    if (fd == -1)
+        return NULL;
+
+    mfs = NULL;
+    if ((fstat(fd, &st) == 0) && (S_ISREG(st.st_mode)) &&
+        ((ZPOS64_T)st.st_size == (ZPOS64_T)(size_t)st.st_size))
+        mfs = (mmap_file_stream*)malloc(sizeof(mmap_file_stream));
+
+    if (mfs != NULL)
+    {
+        mfs->base = NULL;
+        mfs->size = (ZPOS64_T)st.st_size;
+        mfs->pos = 0;
+        if (mfs->size > 0)
+        {
+            void* base = mmap(NULL, (size_t)mfs->size, PROT_READ, MAP_SHARED, fd, 0);
+            if (base == MAP_FAILED)
+            {
+                free(mfs);
+                mfs = NULL;
+            }
+            else
+                mfs->base = (unsigned char*)base;
+        }
+    }
+
+    /* the mapping stays valid after the descriptor is closed */
+    close(fd);
+    return mfs;
+}
+
+
+uLong ZCALLBACK mmap_read_file_func (opaque, stream, buf, size)
+   voidpf opaque;
+   voidpf stream;
+   void* buf;
+   uLong size;
+{
+    mmap_file_stream* mfs = (mmap_file_stream*)stream;
+    if (mfs->pos >= mfs->size)
+        return 0;
+    if (size > mfs->size - mfs->pos)
+        size = (uLong)(mfs->size - mfs->pos);
+    memcpy(buf, mfs->base + mfs->pos, (size_t)size);
+    mfs->pos += size;
+    return size;
+}
+
+
+uLong ZCALLBACK mmap_write_file_func (opaque, stream, buf, size)
+   voidpf opaque;
+   voidpf stream;
+   const void* buf;
+   uLong size;
+{
+    return 0;
+}
+
+long ZCALLBACK mmap_tell_file_func (opaque, stream)
+   voidpf opaque;
+   voidpf stream;
+{
+    return (long)((mmap_file_stream*)stream)->pos;
+}
+
+long ZCALLBACK mmap_seek_file_func (opaque, stream, offset, origin)
+   voidpf opaque;
+   voidpf stream;
+   uLong offset;
+   int origin;
+{
+    mmap_file_stream* mfs = (mmap_file_stream*)stream;
+    ZPOS64_T base;
+    switch (origin)
+    {
+    case ZLIB_FILEFUNC_SEEK_CUR :
+        base = mfs->pos;
+        break;
+    case ZLIB_FILEFUNC_SEEK_END :
+        base = mfs->size;
+        break;
+    case ZLIB_FILEFUNC_SEEK_SET :
+        base = 0;
+        break;
+    default: return -1;
+    }
+
+    /* like fseek, the offset is signed for SEEK_CUR and SEEK_END */
+    if ((origin != ZLIB_FILEFUNC_SEEK_SET) && ((long)offset < 0))
+    {
+        if ((ZPOS64_T)(-(long)offset) > base)
+            return -1;
+        mfs->pos = base - (ZPOS64_T)(-(long)offset);
+    }
+    else
+    {
+        if (offset > mfs->size - base)
+            return -1;
+        mfs->pos = base + offset;
+    }
+    return 0;
+}
+
+int ZCALLBACK mmap_close_file_func (opaque, stream)
+   voidpf opaque;
+   voidpf stream;
+{
+    mmap_file_stream* mfs = (mmap_file_stream*)stream;
+    int ret = 0;
+    if (mfs->base != NULL)
+        ret = munmap(mfs->base, (size_t)mfs->size);
+    free(mfs);
+    return ret;
+}
+
+int ZCALLBACK mmap_error_file_func (opaque, stream)
+   voidpf opaque;
+   voidpf stream;
+{
+    return 0;
+}
+
+uLong ZCALLBACK mmap_pread_file_func (opaque, stream, buf, size, offset)
+   voidpf opaque;
+   voidpf stream;
+   void* buf;
+   uLong size;
+   ZPOS64_T offset;
+{
+    const mmap_file_stream* mfs = (const mmap_file_stream*)stream;
+    if (offset >= mfs->size)
+        return 0;
+    if (size > mfs->size - offset)
+        size = (uLong)(mfs->size - offset);
+    memcpy(buf, mfs->base + offset, (size_t)size);
+    return size;
+}
+
+const void* ZCALLBACK mmap_map_file_func (opaque, stream, offset, size)
+   voidpf opaque;
+   voidpf stream;
+   ZPOS64_T offset;
+   ZPOS64_T size;
+{
+    const mmap_file_stream* mfs = (const mmap_file_stream*)stream;
+    if ((offset > mfs->size) || (size > mfs->size - offset))
+        return NULL;
+    return mfs->base + offset;
+}
+
+void fill_mmap_filefunc (pzlib_filefunc_def)
+  zlib_filefunc_def* pzlib_filefunc_def;
+{
+    pzlib_filefunc_def->zopen_file = mmap_open_file_func;
+    pzlib_filefunc_def->zread_file = mmap_read_file_func;
+    pzlib_filefunc_def->zwrite_file = mmap_write_file_func;
+    pzlib_filefunc_def->ztell_file = mmap_tell_file_func;
+    pzlib_filefunc_def->zseek_file = mmap_seek_file_func;
+    pzlib_filefunc_def->zclose_file = mmap_close_file_func;
+    pzlib_filefunc_def->zerror_file = mmap_error_file_func;
+    pzlib_filefunc_def->opaque = NULL;
+    pzlib_filefunc_def->zpread_file = mmap_pread_file_func;
+    pzlib_filefunc_def->zmap_file = mmap_map_file_func;
+    pzlib_filefunc_def->zpwrite_file = NULL;
+}
+
+#else /* !MMAPIOAPI */
+
+void fill_mmap_filefunc (pzlib_filefunc_def)
+  zlib_filefunc_def* pzlib_filefunc_def;
+{
+    fill_fopen_filefunc(pzlib_filefunc_def);
+}
+
+#endif /* MMAPIOAPI */
+
+
+#ifdef PREADIOAPI
+
+/* a file descriptor, the position is only used by read, write, tell and
+   seek : pread_file_func does not use nor change it */
+typedef struct
+{
+    int fd;
+    ZPOS64_T pos;               /* current position */
+    int error;                  /* errno of the last failed call, or 0 */
+} pread_file_stream;
+
+voidpf ZCALLBACK pread_open_file_func OF((
+   voidpf opaque,
+   const char* filename,
+   int mode));
+
+uLong ZCALLBACK pread_read_file_func OF((
+   voidpf opaque,
+   voidpf stream,
+   void* buf,
+   uLong size));
+
+uLong ZCALLBACK pread_write_file_func OF((
+   voidpf opaque,
+   voidpf stream,
+   const void* buf,
+   uLong size));
+
+long ZCALLBACK pread_tell_file_func OF((
+   voidpf opaque,
+   voidpf stream));
+
+long ZCALLBACK pread_seek_file_func OF((
+   voidpf opaque,
+   voidpf stream,
+   uLong offset,
+   int origin));
+
+int ZCALLBACK pread_close_file_func OF((
+   voidpf opaque,
+   voidpf stream));
+
+int ZCALLBACK pread_error_file_func OF((
+   voidpf opaque,
+   voidpf stream));
+
+uLong ZCALLBACK pread_pread_file_func OF((
+   voidpf opaque,
+   voidpf stream,
+   void* buf,
+   uLong size,
+   ZPOS64_T offset));
+
+uLong ZCALLBACK pread_pwrite_file_func OF((
+   voidpf opaque,
+   voidpf stream,
+   const void* buf,
+   uLong size,
+   ZPOS64_T offset));
+
+
+voidpf ZCALLBACK pread_open_file_func (opaque, filename, mode)
+   voidpf opaque;
+   const char* filename;
+   int mode;
+{
+    pread_file_stream* pfs;
+    int flags = -1;
+    int fd;
+
+    if ((mode & ZLIB_FILEFUNC_MODE_READWRITEFILTER)==ZLIB_FILEFUNC_MODE_READ)
+        flags = O_RDONLY;
+    else
+    if (mode & ZLIB_FILEFUNC_MODE_EXISTING)
+        flags = O_RDWR;
+    else
+    if (mode & ZLIB_FILEFUNC_MODE_CREATE)
+        flags = O_RDWR | O_CREAT | O_TRUNC;
+
+    if ((filename==NULL) || (flags == -1))
+        return NULL;
+
+    fd = open(filename, flags, 0666);
+    if (fd == -1)
+        return NULL;
+#ifdef POSIX_FADV_SEQUENTIAL
+    /* a zipfile opened for reading is mostly read forward : the readahead
+       mode is kept by this descriptor, not by the file */
+    if (flags == O_RDONLY)
+        posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+
+    pfs = (pread_file_stream*)malloc(sizeof(pread_file_stream));
+    if (pfs == NULL)
+    {
+        close(fd);
+        return NULL;
+    }
+    pfs->fd = fd;
+    pfs->pos = 0;
+    pfs->error = 0;
+    return pfs;
+}
+
+
+uLong ZCALLBACK pread_pread_file_func (opaque, stream, buf, size, offset)
+   voidpf opaque;
+   voidpf stream;
+   void* buf;
+   uLong size;
+   ZPOS64_T offset;
+{
+    pread_file_stream* pfs = (pread_file_stream*)stream;
+    uLong done = 0;
+
+    /* pread may return less than asked, it is called until the end of file */
+    while (done < size)
+    {
+        ssize_t ret = pread(pfs->fd, (char*)buf + done, (size_t)(size - done),
+                            (off_t)(offset + done));
+        if (ret < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            pfs->error = errno;
+            break;
+        }
+        if (ret == 0)
+            break;
+        done += (uLong)ret;
+    }
+    return done;
+}
+
+
+uLong ZCALLBACK pread_read_file_func (opaque, stream, buf, size)
+   voidpf opaque;
+   voidpf stream;
+   void* buf;
+   uLong size;
+{
+    pread_file_stream* pfs = (pread_file_stream*)stream;
+    uLong ret = pread_pread_file_func(opaque, stream, buf, size, pfs->pos);
+    pfs->pos += ret;
+    return ret;
+}
+
+
+uLong ZCALLBACK pread_pwrite_file_func (opaque, stream, buf, size, offset)
+   voidpf opaque;
+   voidpf stream;
+   const void* buf;
+   uLong size;
+   ZPOS64_T offset;
+{
+    pread_file_stream* pfs = (pread_file_stream*)stream;
+    uLong done = 0;
+
+    while (done < size)
+    {
+        ssize_t ret = pwrite(pfs->fd, (const char*)buf + done,
+                             (size_t)(size - done), (off_t)(offset + done));
+        if (ret < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            pfs->error = errno;
+            break;
+        }
+        done += (uLong)ret;
+    }
+    return done;
+}
+
+
+uLong ZCALLBACK pread_write_file_func (opaque, stream, buf, size)
+   voidpf opaque;
+   voidpf stream;
+   const void* buf;
+   uLong size;
+{
+    pread_file_stream* pfs = (pread_file_stream*)stream;
+    uLong ret = pread_pwrite_file_func(opaque, stream, buf, size, pfs->pos);
+    pfs->pos += ret;
+    return ret;
+}
+
+long ZCALLBACK pread_tell_file_func (opaque, stream)
+   voidpf opaque;
+   voidpf stream;
+{
+    return (long)((pread_file_stream*)stream)->pos;
+}
+
+long ZCALLBACK pread_seek_file_func (opaque, stream, offset, origin)
+   voidpf opaque;
+   voidpf stream;
+   uLong offset;
+   int origin;
+{
+    pread_file_stream* pfs = (pread_file_stream*)stream;
+    ZPOS64_T base;
+    struct stat st;
+    switch (origin)
+    {
+    case ZLIB_FILEFUNC_SEEK_CUR :
+        base = pfs->pos;
+        break;
+    case ZLIB_FILEFUNC_SEEK_END :
+        if (fstat(pfs->fd, &st) != 0)
+        {
+            pfs->error = errno;
+            return -1;
+        }
+        base = (ZPOS64_T)st.st_size;
+        break;
+    case ZLIB_FILEFUNC_SEEK_SET :
+        base = 0;
+        break;
+    default: return -1;
+    }
+
+    /* like fseek, the offset is signed for SEEK_CUR and SEEK_END */
+    if ((origin != ZLIB_FILEFUNC_SEEK_SET) && ((long)offset < 0))
+    {
+        if ((ZPOS64_T)(-(long)offset) > base)
+            return -1;
+        pfs->pos = base - (ZPOS64_T)(-(long)offset);
+    }
+    else
+        pfs->pos = base + offset;
+    return 0;
+}
+
+int ZCALLBACK pread_close_file_func (opaque, stream)
+   voidpf opaque;
+   voidpf stream;
+{
+    pread_file_stream* pfs = (pread_file_stream*)stream;
+    int ret = close(pfs->fd);
+    free(pfs);
+    return ret;
+}
+
+int ZCALLBACK pread_error_file_func (opaque, stream)
+   voidpf opaque;
+   voidpf stream;
+{
+    return ((pread_file_stream*)stream)->error;
+}
+
+void fill_pread_filefunc (pzlib_filefunc_def)
+  zlib_filefunc_def* pzlib_filefunc_def;
+{
+    pzlib_filefunc_def->zopen_file = pread_open_file_func;
+    pzlib_filefunc_def->zread_file = pread_read_file_func;
+    pzlib_filefunc_def->zwrite_file = pread_write_file_func;
+    pzlib_filefunc_def->ztell_file = pread_tell_file_func;
+    pzlib_filefunc_def->zseek_file = pread_seek_file_func;
+    pzlib_filefunc_def->zclose_file = pread_close_file_func;
+    pzlib_filefunc_def->zerror_file = pread_error_file_func;
+    pzlib_filefunc_def->opaque = NULL;
+    pzlib_filefunc_def->zpread_file = pread_pread_file_func;
+    pzlib_filefunc_def->zmap_file = NULL;
+    pzlib_filefunc_def->zpwrite_file = pread_pwrite_file_func;
+}
+
+#else /* !PREADIOAPI */
+
+void fill_pread_filefunc (pzlib_filefunc_def)
+  zlib_filefunc_def* pzlib_filefunc_def;
+{
+    fill_fopen_filefunc(pzlib_filefunc_def);
 }
+
+#endif /* PREADIOAPI */
@@ -31,6 +31,14 @@
 #endif
 #endif
 
+#ifndef ZPOS64_T
+#if defined(_MSC_VER) || defined(__BORLANDC__)
+typedef unsigned __int64 ZPOS64_T;
+#else
+typedef unsigned long long int ZPOS64_T;
+#endif
+#endif
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -42,6 +50,9 @@ typedef long   (ZCALLBACK *tell_file_func) OF((voidpf opaque, voidpf stream));
 typedef long   (ZCALLBACK *seek_file_func) OF((voidpf opaque, voidpf stream, uLong offset, int origin));
 typedef int    (ZCALLBACK *close_file_func) OF((voidpf opaque, voidpf stream));
 typedef int    (ZCALLBACK *testerror_file_func) OF((voidpf opaque, voidpf stream));
+typedef uLong  (ZCALLBACK *pread_file_func) OF((voidpf opaque, voidpf stream, void* buf, uLong size, ZPOS64_T offset));
+typedef const void* (ZCALLBACK *map_file_func) OF((voidpf opaque, voidpf stream, ZPOS64_T offset, ZPOS64_T size));
+typedef uLong  (ZCALLBACK *pwrite_file_func) OF((voidpf opaque, voidpf stream, const void* buf, uLong size, ZPOS64_T offset));
 
 typedef struct zlib_filefunc_def_s
 {
@@ -53,12 +64,33 @@ typedef struct zlib_filefunc_def_s
     close_file_func     zclose_file;
     testerror_file_func zerror_file;
     voidpf              opaque;
+    pread_file_func     zpread_file;    /* read at an offset without moving
+                                           the position, NULL if the stream
+                                           cannot do it */
+    map_file_func       zmap_file;      /* pointer on the bytes at an offset,
+                                           valid until the stream is closed,
+                                           NULL if the stream cannot do it */
+    pwrite_file_func    zpwrite_file;   /* write at an offset without moving
+                                           the position, NULL if the stream
+                                           cannot do it */
 } zlib_filefunc_def;
 
 
 
 void fill_fopen_filefunc OF((zlib_filefunc_def* pzlib_filefunc_def));
 
+/* Read only access to a file mapped in memory with mmap, for unzOpen2. The
+   file is opened for reading only (opening for writing fails). Without
+   mmap (or if compiled with NOMMAPIOAPI), this is fill_fopen_filefunc. */
+void fill_mmap_filefunc OF((zlib_filefunc_def* pzlib_filefunc_def));
+
+/* File descriptor with positional reads and writes (pread/pwrite). Reads
+   done with ZPREAD do not use a shared position, so several threads can
+   read the same stream at the same time. A file opened for reading only
+   gets POSIX_FADV_SEQUENTIAL where posix_fadvise exists. Without pread (or
+   if compiled with NOPREADIOAPI), this is fill_fopen_filefunc. */
+void fill_pread_filefunc OF((zlib_filefunc_def* pzlib_filefunc_def));
+
 #define ZREAD(filefunc,filestream,buf,size) ((*((filefunc).zread_file))((filefunc).opaque,filestream,buf,size))
 #define ZWRITE(filefunc,filestream,buf,size) ((*((filefunc).zwrite_file))((filefunc).opaque,filestream,buf,size))
 #define ZTELL(filefunc,filestream) ((*((filefunc).ztell_file))((filefunc).opaque,filestream))
@@ -66,6 +98,30 @@ void fill_fopen_filefunc OF((zlib_filefunc_def* pzlib_filefunc_def));
 #define ZCLOSE(filefunc,filestream) ((*((filefunc).zclose_file))((filefunc).opaque,filestream))
 #define ZERROR(filefunc,filestream) ((*((filefunc).zerror_file))((filefunc).opaque,filestream))
 
+/* read size bytes at offset pos. When the stream has no positional read,
+   this is a seek followed by a read, which moves the position of the stream */
+#define ZPREAD(filefunc,filestream,buf,size,pos) \
+    (((filefunc).zpread_file != NULL) ? \
+     ((*((filefunc).zpread_file))((filefunc).opaque,filestream,buf,size,pos)) : \
+     ((ZSEEK(filefunc,filestream,(uLong)(pos),ZLIB_FILEFUNC_SEEK_SET) == 0) ? \
+      ZREAD(filefunc,filestream,buf,size) : (uLong)0))
+
+/* write size bytes at offset pos. When the stream has no positional write,
+   this is a seek followed by a write, which moves the position of the
+   stream */
+#define ZPWRITE(filefunc,filestream,buf,size,pos) \
+    (((filefunc).zpwrite_file != NULL) ? \
+     ((*((filefunc).zpwrite_file))((filefunc).opaque,filestream,buf,size,pos)) : \
+     ((ZSEEK(filefunc,filestream,(uLong)(pos),ZLIB_FILEFUNC_SEEK_SET) == 0) ? \
+      ZWRITE(filefunc,filestream,buf,size) : (uLong)0))
+
+/* pointer on size bytes at offset pos in the stream, or NULL when the stream
+   is not in memory (or the bytes are not all in the stream) */
+#define ZMAP(filefunc,filestream,pos,size) \
+    (((filefunc).zmap_file != NULL) ? \
+     ((*((filefunc).zmap_file))((filefunc).opaque,filestream,pos,size)) : \
+     (const void*)NULL)
+
 
 #ifdef __cplusplus
 }
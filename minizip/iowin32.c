@@ -267,4 +267,7 @@ void fill_win32_filefunc (pzlib_filefunc_def)
     pzlib_filefunc_def->zclose_file = win32_close_file_func;
     pzlib_filefunc_def->zerror_file = win32_error_file_func;
     pzlib_filefunc_def->opaque=NULL;
+    pzlib_filefunc_def->zpread_file = NULL;
+    pzlib_filefunc_def->zmap_file = NULL;
+    pzlib_filefunc_def->zpwrite_file = NULL;
 }
@@ -5,6 +5,9 @@
    Copyright (C) 1998-2005 Gilles Vollant
 */
 
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE     /* for copy_file_range */
+#endif
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -23,9 +26,40 @@
 #endif
 
 #include "unzip.h"
+#include "crc32hw.h"
+
+#if defined(unix) && !defined(NOPTHREAD)
+#define USEPTHREAD
+#include <pthread.h>
+#endif
+
+/* the stored files are copied from the zipfile to the output file without
+   the unzFile : in the kernel with copy_file_range (or sendfile) on Linux,
+   else with pread and write. If you don't want it, define NOCOPYSTORED */
+#if defined(unix) && !defined(NOCOPYSTORED)
+#define USECOPYSTORED
+#include <sys/mman.h>
+#ifdef __linux__
+#include <sys/sendfile.h>
+#if defined(__GLIBC__) && \
+    ((__GLIBC__ > 2) || ((__GLIBC__ == 2) && (__GLIBC_MINOR__ >= 27)))
+#define HAVE_COPY_FILE_RANGE
+#endif
+#endif
+#endif
+
+/* the output files are preallocated to their size, the kernel is told which
+   bytes of the zipfile are read next and which ones are no longer needed,
+   and with -w the output files are written back as they are extracted.
+   If you don't want it, define NOFILEHINTS */
+#if defined(unix) && !defined(NOFILEHINTS)
+#define USEFILEHINTS
+#endif
 
 #define CASESENSITIVITY (0)
 #define WRITEBUFFERSIZE (8192)
+#define COPYBUFFERSIZE (131072) /* size of the pread/write of the stored files */
+#define WRITEBEHINDSIZE (8388608) /* bytes written between two write backs (-w) */
 #define MAXFILENAME (256)
 
 #ifdef WIN32
@@ -36,7 +70,7 @@
   mini unzip, demo of unzip package
 
   usage :
-  Usage : miniunz [-exvlo] file.zip [file_to_extract] [-d extractdir]
+  Usage : miniunz [-exvlo] [-j threads] file.zip [file_to_extract] [-d extractdir]
 
   list the file in the zipfile, and print the content of FILE_ID.ZIP or README.TXT
     if it exists
@@ -155,25 +189,271 @@ void do_banner()
 
 void do_help()
 {
-    printf("Usage : miniunz [-e] [-x] [-v] [-l] [-o] [-p password] file.zip [file_to_extr.] [-d extractdir]\n\n" \
-           "  -e  Extract without pathname (junk paths)\n" \
+#ifdef USEPTHREAD
+    printf("Usage : miniunz [-e] [-x] [-v] [-l] [-o] [-p password] [-j threads] file.zip [file_to_extr.] [-d extractdir]\n\n");
+#else
+    printf("Usage : miniunz [-e] [-x] [-v] [-l] [-o] [-p password] file.zip [file_to_extr.] [-d extractdir]\n\n");
+#endif
+    printf("  -e  Extract without pathname (junk paths)\n" \
            "  -x  Extract with pathname\n" \
            "  -v  list files\n" \
            "  -l  list files\n" \
            "  -d  directory to extract into\n" \
            "  -o  overwrite files without prompting\n" \
-           "  -p  extract crypted file using password\n\n");
+           "  -p  extract crypted file using password\n");
+#ifdef USEPTHREAD
+    printf("  -j  extract the files with several threads\n");
+#endif
+    printf("  -c  do not check the CRC of the files (trusted zipfile)\n" \
+           "  -w  write back the extracted files as they are written (Linux)\n\n");
 }
 
+#if defined(USECOPYSTORED) || defined(USEFILEHINTS)
+static int fd_zipfile = -1;     /* the zipfile, to copy the stored files
+                                   and to give hints about it */
+#endif
+
+#ifdef USECOPYSTORED
+static int check_crc_stored = 1;
+
+/* copy_stored_data : copy size bytes at pos in the zipfile to fd_out.
+    copy_file_range can share the blocks on the filesystems with reflinks.
+    When a way fails (not supported for these files), the next one is used */
+static int copy_stored_data(fd_in,pos,size,fd_out)
+    int fd_in;
+    ZPOS64_T pos;
+    ZPOS64_T size;
+    int fd_out;
+{
+    off_t off_in = (off_t)pos;
+    char* buf = NULL;
+    int err = UNZ_OK;
+#ifdef HAVE_COPY_FILE_RANGE
+    int use_copy_file_range = 1;
+#endif
+#ifdef __linux__
+    int use_sendfile = 1;
+#endif
+
+    while ((size>0) && (err==UNZ_OK))
+    {
+        size_t len = (size > 0x40000000) ? 0x40000000 : (size_t)size;
+        ssize_t done = -1;
+
+#ifdef HAVE_COPY_FILE_RANGE
+        if (use_copy_file_range)
+        {
+            done = copy_file_range(fd_in,&off_in,fd_out,NULL,len,0);
+            if (done<=0)
+                use_copy_file_range = 0;
+        }
+#endif
+#ifdef __linux__
+        if ((done<=0) && (use_sendfile))
+        {
+            done = sendfile(fd_out,fd_in,&off_in,len);
+            if (done<=0)
+                use_sendfile = 0;
+        }
+#endif
+        if (done<=0)
+        {
+            ssize_t written = 0;
+            if (buf==NULL)
+                buf = (char*)malloc(COPYBUFFERSIZE);
+            if (buf==NULL)
+                return UNZ_INTERNALERROR;
+            done = pread(fd_in,buf,(len < COPYBUFFERSIZE) ? len : COPYBUFFERSIZE,
+                         off_in);
+            if (done<=0)
+                err = UNZ_ERRNO;
+            while ((err==UNZ_OK) && (written<done))
+            {
+                ssize_t w = write(fd_out,buf+written,(size_t)(done-written));
+                if (w<=0)
+                    err = UNZ_ERRNO;
+                else
+                    written += w;
+            }
+            off_in += done;
+        }
+        size -= done;
+    }
+
+    free(buf);
+    return err;
+}
+
+/* stored_crc : crc32 of size bytes at pos in the zipfile, from a mapping
+    of these bytes */
+static int stored_crc(fd_in,pos,size,pcrc)
+    int fd_in;
+    ZPOS64_T pos;
+    ZPOS64_T size;
+    uLong* pcrc;
+{
+    ZPOS64_T start = pos - (pos % (ZPOS64_T)sysconf(_SC_PAGESIZE));
+    size_t size_map = (size_t)(pos - start + size);
+    const unsigned char* data;
+    void* map;
+    uLong crc = 0;
+
+    *pcrc = 0;
+    if (size==0)
+        return UNZ_OK;
+    if ((ZPOS64_T)size_map != pos - start + size)
+        return UNZ_PARAMERROR;
+
+    map = mmap(NULL,size_map,PROT_READ,MAP_SHARED,fd_in,(off_t)start);
+    if (map==MAP_FAILED)
+        return UNZ_ERRNO;
+#ifdef MADV_SEQUENTIAL
+    madvise(map,size_map,MADV_SEQUENTIAL);
+#endif
+
+    data = (const unsigned char*)map + (size_t)(pos - start);
+    while (size>0)
+    {
+        uInt uThis = (size > 0x40000000) ? 0x40000000 : (uInt)size;
+        crc = crc32hw(crc,data,uThis);
+        data += uThis;
+        size -= uThis;
+    }
+
+    munmap(map,size_map);
+    *pcrc = crc;
+    return UNZ_OK;
+}
+
+/* copy_stored_file : write the stored file at pos in the zipfile to fd_out,
+    and check its CRC (unless -c) */
+static int copy_stored_file(pos,file_info,fd_out)
+    ZPOS64_T pos;
+    const unz_file_info64* file_info;
+    int fd_out;
+{
+    uLong crc;
+    int err;
+
+    err = copy_stored_data(fd_zipfile,pos,file_info->uncompressed_size,fd_out);
+    if (err!=UNZ_OK)
+    {
+        printf("error in writing extracted file\n");
+        return err;
+    }
+
+    if (check_crc_stored)
+    {
+        err = stored_crc(fd_zipfile,pos,file_info->uncompressed_size,&crc);
+        if ((err==UNZ_OK) && (crc!=file_info->crc))
+            err = UNZ_CRCERROR;
+        if (err!=UNZ_OK)
+            printf("error %d with zipfile in the crc check\n",err);
+    }
+    return err;
+}
+#endif
+
+#ifdef USEFILEHINTS
+static int opt_write_behind = 0;
+
+/* preallocate_file : reserve size bytes for the output file fd, without
+    changing its size, rather than growing it at each write.
+    posix_fallocate is not used : it sets the size of the file, and where the
+    filesystem can't, the C library emulates it by writing zeros */
+static void preallocate_file(fd,size)
+    int fd;
+    ZPOS64_T size;
+{
+    if (size==0)
+        return;
+#if defined(__linux__) && defined(FALLOC_FL_KEEP_SIZE)
+    fallocate(fd,FALLOC_FL_KEEP_SIZE,0,(off_t)size);
+#elif defined(F_PREALLOCATE)
+    {
+        fstore_t store;
+        memset(&store,0,sizeof(store));
+        store.fst_flags = F_ALLOCATECONTIG;
+        store.fst_posmode = F_PEOFPOSMODE;
+        store.fst_offset = 0;
+        store.fst_length = (off_t)size;
+        if (fcntl(fd,F_PREALLOCATE,&store)==-1)
+        {
+            store.fst_flags = F_ALLOCATEALL;
+            fcntl(fd,F_PREALLOCATE,&store);
+        }
+    }
+#else
+    (void)fd;
+#endif
+}
+
+/* advise_zipfile : tell the kernel that the size bytes at pos in the zipfile
+    will be read soon (willneed) or won't be read again */
+static void advise_zipfile(pos,size,willneed)
+    ZPOS64_T pos;
+    ZPOS64_T size;
+    int willneed;
+{
+    if ((fd_zipfile<0) || (pos==0) || (size==0))
+        return;
+#ifdef POSIX_FADV_WILLNEED
+    posix_fadvise(fd_zipfile,(off_t)pos,(off_t)size,
+                  willneed ? POSIX_FADV_WILLNEED : POSIX_FADV_DONTNEED);
+#elif defined(F_RDADVISE)
+    if (willneed)
+    {
+        struct radvisory ra;
+        ra.ra_offset = (off_t)pos;
+        ra.ra_count = (size>0x7fffffff) ? 0x7fffffff : (int)size;
+        fcntl(fd_zipfile,F_RDADVISE,&ra);
+    }
+#endif
+}
+
+/* write_behind : with -w, once WRITEBEHINDSIZE bytes were written to fout
+    since the last call, start the write back of these bytes, wait for the
+    one of the bytes before them and drop those from the page cache. At the
+    end of the file (end), the write back of the last bytes is only started :
+    waiting for it would make the extraction of many small files synchronous.
+    The extraction of a large file then doesn't fill the page cache with
+    dirty pages */
+static void write_behind(fout,pos_written,ppos_started,end)
+    FILE* fout;
+    ZPOS64_T pos_written;
+    ZPOS64_T* ppos_started;
+    int end;
+{
+#if defined(SYNC_FILE_RANGE_WRITE) && defined(POSIX_FADV_DONTNEED)
+    int fd;
+    ZPOS64_T pos_done = *ppos_started;
+    if ((!opt_write_behind) || (pos_written==pos_done) ||
+        ((!end) && (pos_written-pos_done<WRITEBEHINDSIZE)))
+        return;
+    fd = fileno(fout);
+    fflush(fout);
+    sync_file_range(fd,(off_t)pos_done,(off_t)(pos_written-pos_done),
+                    SYNC_FILE_RANGE_WRITE);
+    if ((!end) && (pos_done>0))
+    {
+        sync_file_range(fd,0,(off_t)pos_done,SYNC_FILE_RANGE_WAIT_BEFORE |
+                        SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+        posix_fadvise(fd,0,(off_t)pos_done,POSIX_FADV_DONTNEED);
+    }
+    *ppos_started = pos_written;
+#endif
+}
+#endif
+
 
 static int do_list(uf)
     unzFile uf;
 {
-    uLong i;
-    unz_global_info gi;
+    ZPOS64_T i;
+    unz_global_info64 gi;
     int err;
 
-    err = unzGetGlobalInfo (uf,&gi);
+    err = unzGetGlobalInfo64 (uf,&gi);
     if (err!=UNZ_OK)
         printf("error %d with zipfile in unzGetGlobalInfo \n",err);
     printf(" Length  Method   Size  Ratio   Date    Time   CRC-32     Name\n");
@@ -181,18 +461,18 @@ static int do_list(uf)
     for (i=0;i<gi.number_entry;i++)
     {
         char filename_inzip[256];
-        unz_file_info file_info;
+        unz_file_info64 file_info;
         uLong ratio=0;
         const char *string_method;
         char charCrypt=' ';
-        err = unzGetCurrentFileInfo(uf,&file_info,filename_inzip,sizeof(filename_inzip),NULL,0,NULL,0);
+        err = unzGetCurrentFileInfo64(uf,&file_info,filename_inzip,sizeof(filename_inzip),NULL,0,NULL,0);
         if (err!=UNZ_OK)
         {
             printf("error %d with zipfile in unzGetCurrentFileInfo\n",err);
             break;
         }
         if (file_info.uncompressed_size>0)
-            ratio = (file_info.compressed_size*100)/file_info.uncompressed_size;
+            ratio = (uLong)((file_info.compressed_size*100)/file_info.uncompressed_size);
 
         /* display a '*' if the file is crypted */
         if ((file_info.flag & 1) != 0)
@@ -214,7 +494,7 @@ static int do_list(uf)
         else
             string_method="Unkn. ";
 
-        printf("%7lu  %6s%c%7lu %3lu%%  %2.2lu-%2.2lu-%2.2lu  %2.2lu:%2.2lu  %8.8lx   %s\n",
+        printf("%7llu  %6s%c%7llu %3lu%%  %2.2lu-%2.2lu-%2.2lu  %2.2lu:%2.2lu  %8.8lx   %s\n",
                 file_info.uncompressed_size,string_method,
                 charCrypt,
                 file_info.compressed_size,
@@ -239,6 +519,44 @@ static int do_list(uf)
 }
 
 
+/* ask_overwrite : if write_filename exists, ask if it must be overwritten
+    return 1 if the file must be skipped
+    set *popt_overwrite to 1 if all the files must be overwritten */
+static int ask_overwrite(write_filename,popt_overwrite)
+    const char* write_filename;
+    int* popt_overwrite;
+{
+    char rep=0;
+    FILE* ftestexist;
+    ftestexist = fopen(write_filename,"rb");
+    if (ftestexist!=NULL)
+    {
+        fclose(ftestexist);
+        do
+        {
+            char answer[128];
+            int ret;
+
+            printf("The file %s exists. Overwrite ? [y]es, [n]o, [A]ll: ",write_filename);
+            ret = scanf("%1s",answer);
+            if (ret != 1) 
+            {
+               exit(EXIT_FAILURE);
+            }
+            rep = answer[0] ;
+            if ((rep>='a') && (rep<='z'))
+                rep -= 0x20;
+        }
+        while ((rep!='Y') && (rep!='N') && (rep!='A'));
+    }
+
+    if (rep == 'A')
+        *popt_overwrite=1;
+
+    return (rep == 'N') ? 1 : 0;
+}
+
+
 static int do_extract_currentfile(uf,popt_extract_without_path,popt_overwrite,password)
     unzFile uf;
     const int* popt_extract_without_path;
@@ -252,10 +570,19 @@ static int do_extract_currentfile(uf,popt_extract_without_path,popt_overwrite,pa
     FILE *fout=NULL;
     void* buf;
     uInt size_buf;
+    int copied=0;
+#ifdef USECOPYSTORED
+    ZPOS64_T pos_stored;
+#endif
+#ifdef USEFILEHINTS
+    ZPOS64_T pos_data=0;
+    ZPOS64_T pos_written=0;
+    ZPOS64_T pos_started=0;
+#endif
 
-    unz_file_info file_info;
+    unz_file_info64 file_info;
    /*  uLong ratio=0; */
-    err = unzGetCurrentFileInfo(uf,&file_info,filename_inzip,sizeof(filename_inzip),NULL,0,NULL,0);
+    err = unzGetCurrentFileInfo64(uf,&file_info,filename_inzip,sizeof(filename_inzip),NULL,0,NULL,0);
 
     if (err!=UNZ_OK)
     {
@@ -304,37 +631,7 @@ static int do_extract_currentfile(uf,popt_extract_without_path,popt_overwrite,pa
         }
 
         if (((*popt_overwrite)==0) && (err==UNZ_OK))
-        {
-            char rep=0;
-            FILE* ftestexist;
-            ftestexist = fopen(write_filename,"rb");
-            if (ftestexist!=NULL)
-            {
-                fclose(ftestexist);
-                do
-                {
-                    char answer[128];
-                    int ret;
-
-                    printf("The file %s exists. Overwrite ? [y]es, [n]o, [A]ll: ",write_filename);
-                    ret = scanf("%1s",answer);
-                    if (ret != 1) 
-                    {
-                       exit(EXIT_FAILURE);
-                    }
-                    rep = answer[0] ;
-                    if ((rep>='a') && (rep<='z'))
-                        rep -= 0x20;
-                }
-                while ((rep!='Y') && (rep!='N') && (rep!='A'));
-            }
-
-            if (rep == 'N')
-                skip = 1;
-
-            if (rep == 'A')
-                *popt_overwrite=1;
-        }
+            skip = ask_overwrite(write_filename,popt_overwrite);
 
         if ((skip==0) && (err==UNZ_OK))
         {
@@ -361,6 +658,26 @@ static int do_extract_currentfile(uf,popt_extract_without_path,popt_overwrite,pa
         {
             printf(" extracting: %s\n",write_filename);
 
+#ifdef USEFILEHINTS
+            preallocate_file(fileno(fout),file_info.uncompressed_size);
+            pos_data = unzGetCurrentFileZStreamPos64(uf);
+            advise_zipfile(pos_data,file_info.compressed_size,1);
+#endif
+
+#ifdef USECOPYSTORED
+            /* a stored file is copied as it is from the zipfile */
+            if ((fd_zipfile>=0) &&
+                (unzGetCurrentFileStoredPos(uf,&pos_stored)==UNZ_OK))
+            {
+                err = copy_stored_file(pos_stored,&file_info,fileno(fout));
+                copied = 1;
+#ifdef USEFILEHINTS
+                pos_written = file_info.uncompressed_size;
+#endif
+            }
+#endif
+
+            if (!copied)
             do
             {
                 err = unzReadCurrentFile(uf,buf,size_buf);
@@ -370,14 +687,25 @@ static int do_extract_currentfile(uf,popt_extract_without_path,popt_overwrite,pa
                     break;
                 }
                 if (err>0)
+                {
                     if (fwrite(buf,err,1,fout)!=1)
                     {
                         printf("error in writing extracted file\n");
                         err=UNZ_ERRNO;
                         break;
                     }
+#ifdef USEFILEHINTS
+                    pos_written += err;
+                    write_behind(fout,pos_written,&pos_started,0);
+#endif
+                }
             }
             while (err>0);
+#ifdef USEFILEHINTS
+            if (err==0)
+                write_behind(fout,pos_written,&pos_started,1);
+            advise_zipfile(pos_data,file_info.compressed_size,0);
+#endif
             if (fout)
                     fclose(fout);
 
@@ -409,12 +737,12 @@ static int do_extract(uf,opt_extract_without_path,opt_overwrite,password)
     int opt_overwrite;
     const char* password;
 {
-    uLong i;
-    unz_global_info gi;
+    ZPOS64_T i;
+    unz_global_info64 gi;
     int err;
     /* FILE* fout=NULL; */
 
-    err = unzGetGlobalInfo (uf,&gi);
+    err = unzGetGlobalInfo64 (uf,&gi);
     if (err!=UNZ_OK)
         printf("error %d with zipfile in unzGetGlobalInfo \n",err);
 
@@ -439,6 +767,307 @@ static int do_extract(uf,opt_extract_without_path,opt_overwrite,password)
     return 0;
 }
 
+#ifdef USEPTHREAD
+/*
+  Parallel extraction (-j) : the central dir is walked once by the main
+    thread, which creates the directories, asks about the overwrites, and
+    records the position of each file. Then a pool of threads takes the files
+    one after the other, each reading its file with its own cursor (opened
+    with unzOpenCursor) and writing its own output file.
+*/
+
+typedef struct extract_entry_s
+{
+    unz64_file_pos file_pos;
+    unz_file_info64 file_info;
+    char filename_inzip[256];
+    int skip;                   /* 1 for a directory or a file not to write */
+} extract_entry;
+
+typedef struct extract_job_s
+{
+    unzFile uf;
+    const char* password;
+    int opt_extract_without_path;
+    extract_entry* entries;
+    ZPOS64_T number_entry;
+    ZPOS64_T next_entry;        /* next entry to give to a thread */
+    int err;                    /* first error of the threads */
+    pthread_mutex_t lock;       /* protects next_entry and err */
+    pthread_mutex_t dir_lock;   /* serializes the makedir of the threads */
+} extract_job;
+
+static int do_extract_entry(job,entry)
+    extract_job* job;
+    extract_entry* entry;
+{
+    char* filename_withoutpath;
+    char* p;
+    const char* write_filename;
+    int err=UNZ_OK;
+    FILE *fout=NULL;
+    void* buf;
+    uInt size_buf;
+    unzCursor cursor;
+#ifdef USEFILEHINTS
+    ZPOS64_T pos_written=0;
+    ZPOS64_T pos_started=0;
+#endif
+
+    p = filename_withoutpath = entry->filename_inzip;
+    while ((*p) != '\0')
+    {
+        if (((*p)=='/') || ((*p)=='\\'))
+            filename_withoutpath = p+1;
+        p++;
+    }
+
+    if (job->opt_extract_without_path==0)
+        write_filename = entry->filename_inzip;
+    else
+        write_filename = filename_withoutpath;
+
+    err = unzOpenCursor(job->uf,&entry->file_pos,job->password,&cursor);
+    if (err!=UNZ_OK)
+    {
+        printf("error %d with zipfile in unzOpenCursor\n",err);
+        return err;
+    }
+
+    size_buf = WRITEBUFFERSIZE;
+    buf = (void*)malloc(size_buf);
+    if (buf==NULL)
+    {
+        printf("Error allocating memory\n");
+        unzCloseCursor(cursor);
+        return UNZ_INTERNALERROR;
+    }
+
+    fout=fopen(write_filename,"wb");
+
+    /* some zipfile don't contain directory alone before file : the parent
+       directories shared by several files are created by one thread at once */
+    if ((fout==NULL) && (job->opt_extract_without_path==0) &&
+                        (filename_withoutpath!=(char*)entry->filename_inzip))
+    {
+        char c=*(filename_withoutpath-1);
+        *(filename_withoutpath-1)='\0';
+        pthread_mutex_lock(&job->dir_lock);
+        makedir((char*)write_filename);
+        pthread_mutex_unlock(&job->dir_lock);
+        *(filename_withoutpath-1)=c;
+        fout=fopen(write_filename,"wb");
+    }
+
+    if (fout==NULL)
+    {
+        printf("error opening %s\n",write_filename);
+    }
+    else
+    {
+        printf(" extracting: %s\n",write_filename);
+
+#ifdef USEFILEHINTS
+        preallocate_file(fileno(fout),entry->file_info.uncompressed_size);
+#endif
+        do
+        {
+            err = unzReadCursor(cursor,buf,size_buf);
+            if (err<0)
+            {
+                printf("error %d with zipfile in unzReadCursor\n",err);
+                break;
+            }
+            if (err>0)
+            {
+                if (fwrite(buf,err,1,fout)!=1)
+                {
+                    printf("error in writing extracted file\n");
+                    err=UNZ_ERRNO;
+                    break;
+                }
+#ifdef USEFILEHINTS
+                pos_written += err;
+                write_behind(fout,pos_written,&pos_started,0);
+#endif
+            }
+        }
+        while (err>0);
+#ifdef USEFILEHINTS
+        if (err==0)
+            write_behind(fout,pos_written,&pos_started,1);
+#endif
+        fclose(fout);
+
+        if (err==0)
+            change_file_date(write_filename,entry->file_info.dosDate,
+                             entry->file_info.tmu_date);
+    }
+
+    if (err==UNZ_OK)
+    {
+        err = unzCloseCursor(cursor);
+        if (err!=UNZ_OK)
+        {
+            printf("error %d with zipfile in unzCloseCursor\n",err);
+        }
+    }
+    else
+        unzCloseCursor(cursor); /* don't lose the error */
+
+    free(buf);
+    return err;
+}
+
+static void* extract_thread(arg)
+    void* arg;
+{
+    extract_job* job = (extract_job*)arg;
+
+    for (;;)
+    {
+        extract_entry* entry;
+        int err;
+
+        pthread_mutex_lock(&job->lock);
+        if ((job->err!=UNZ_OK) || (job->next_entry>=job->number_entry))
+        {
+            pthread_mutex_unlock(&job->lock);
+            break;
+        }
+        entry = &job->entries[job->next_entry++];
+        pthread_mutex_unlock(&job->lock);
+
+        if (entry->skip)
+            continue;
+
+        err = do_extract_entry(job,entry);
+        if (err!=UNZ_OK)
+        {
+            pthread_mutex_lock(&job->lock);
+            if (job->err==UNZ_OK)
+                job->err = err;
+            pthread_mutex_unlock(&job->lock);
+        }
+    }
+    return NULL;
+}
+
+static int do_extract_parallel(uf,opt_extract_without_path,opt_overwrite,password,opt_jobs)
+    unzFile uf;
+    int opt_extract_without_path;
+    int opt_overwrite;
+    const char* password;
+    int opt_jobs;
+{
+    ZPOS64_T i;
+    unz_global_info64 gi;
+    int err;
+    int t;
+    int number_thread=0;
+    extract_job job;
+    pthread_t* threads;
+
+    err = unzGetGlobalInfo64 (uf,&gi);
+    if (err!=UNZ_OK)
+    {
+        printf("error %d with zipfile in unzGetGlobalInfo \n",err);
+        return 0;
+    }
+
+    job.uf = uf;
+    job.password = password;
+    job.opt_extract_without_path = opt_extract_without_path;
+    job.number_entry = 0;
+    job.next_entry = 0;
+    job.err = UNZ_OK;
+    job.entries = (extract_entry*)malloc((size_t)gi.number_entry*
+                                         sizeof(extract_entry)+1);
+    threads = (pthread_t*)malloc(opt_jobs*sizeof(pthread_t));
+    if ((job.entries==NULL) || (threads==NULL))
+    {
+        printf("Error allocating memory\n");
+        free(job.entries);
+        free(threads);
+        return 0;
+    }
+
+    for (i=0;i<gi.number_entry;i++)
+    {
+        extract_entry* entry = &job.entries[job.number_entry];
+        char* filename_withoutpath;
+        char* p;
+
+        err = unzGetCurrentFileInfo64(uf,&entry->file_info,
+                                      entry->filename_inzip,
+                                      sizeof(entry->filename_inzip),
+                                      NULL,0,NULL,0);
+        if (err==UNZ_OK)
+            err = unzGetFilePos64(uf,&entry->file_pos);
+        if (err!=UNZ_OK)
+        {
+            printf("error %d with zipfile in unzGetCurrentFileInfo\n",err);
+            break;
+        }
+        job.number_entry++;
+        entry->skip = 0;
+
+        p = filename_withoutpath = entry->filename_inzip;
+        while ((*p) != '\0')
+        {
+            if (((*p)=='/') || ((*p)=='\\'))
+                filename_withoutpath = p+1;
+            p++;
+        }
+
+        if ((*filename_withoutpath)=='\0')
+        {
+            entry->skip = 1;
+            if (opt_extract_without_path==0)
+            {
+                printf("creating directory: %s\n",entry->filename_inzip);
+                mymkdir(entry->filename_inzip);
+            }
+        }
+        else if (opt_overwrite==0)
+            entry->skip = ask_overwrite((opt_extract_without_path==0) ?
+                                        entry->filename_inzip :
+                                        filename_withoutpath,
+                                        &opt_overwrite);
+
+        if ((i+1)<gi.number_entry)
+        {
+            err = unzGoToNextFile(uf);
+            if (err!=UNZ_OK)
+            {
+                printf("error %d with zipfile in unzGoToNextFile\n",err);
+                break;
+            }
+        }
+    }
+
+    pthread_mutex_init(&job.lock,NULL);
+    pthread_mutex_init(&job.dir_lock,NULL);
+
+    for (t=0;t<opt_jobs;t++)
+    {
+        if (pthread_create(&threads[t],NULL,extract_thread,&job)!=0)
+            break;
+        number_thread++;
+    }
+    if (number_thread==0)
+        extract_thread(&job);
+    for (t=0;t<number_thread;t++)
+        pthread_join(threads[t],NULL);
+
+    pthread_mutex_destroy(&job.lock);
+    pthread_mutex_destroy(&job.dir_lock);
+    free(threads);
+    free(job.entries);
+    return 0;
+}
+#endif
+
 static int do_extract_onefile(uf,filename,opt_extract_without_path,opt_overwrite,password)
     unzFile uf;
     const char* filename;
@@ -476,6 +1105,10 @@ int main(argc,argv)
     int opt_do_extract_withoutpath=0;
     int opt_overwrite=0;
     int opt_extractdir=0;
+#ifdef USEPTHREAD
+    int opt_jobs=1;
+#endif
+    int opt_skip_crc=0;
     const char *dirname=NULL;
     unzFile uf=NULL;
 
@@ -506,6 +1139,12 @@ int main(argc,argv)
                         opt_do_extract = opt_do_extract_withoutpath = 1;
                     if ((c=='o') || (c=='O'))
                         opt_overwrite=1;
+                    if ((c=='c') || (c=='C'))
+                        opt_skip_crc=1;
+#ifdef USEFILEHINTS
+                    if ((c=='w') || (c=='W'))
+                        opt_write_behind=1;
+#endif
                     if ((c=='d') || (c=='D'))
                     {
                         opt_extractdir=1;
@@ -517,6 +1156,16 @@ int main(argc,argv)
                         password=argv[i+1];
                         i++;
                     }
+
+                    if (((c=='j') || (c=='J')) && (i+1<argc))
+                    {
+#ifdef USEPTHREAD
+                        opt_jobs=atoi(argv[i+1]);
+#else
+                        printf("-j is not available, the files are extracted by one thread\n");
+#endif
+                        i++;
+                    }
                 }
             }
             else
@@ -532,7 +1181,7 @@ int main(argc,argv)
     if (zipfilename!=NULL)
     {
 
-#        ifdef USEWIN32IOAPI
+#        if defined(USEWIN32IOAPI) || defined(USEPTHREAD)
         zlib_filefunc_def ffunc;
 #        endif
 
@@ -543,13 +1192,17 @@ int main(argc,argv)
 #        ifdef USEWIN32IOAPI
         fill_win32_filefunc(&ffunc);
         uf = unzOpen2(zipfilename,&ffunc);
+#        elif defined(USEPTHREAD)
+        /* the files are read with positional reads, for the cursors of -j */
+        fill_pread_filefunc(&ffunc);
+        uf = unzOpen2(zipfilename,&ffunc);
 #        else
         uf = unzOpen(zipfilename);
 #        endif
         if (uf==NULL)
         {
             strcat(filename_try,".zip");
-#            ifdef USEWIN32IOAPI
+#            if defined(USEWIN32IOAPI) || defined(USEPTHREAD)
             uf = unzOpen2(filename_try,&ffunc);
 #            else
             uf = unzOpen(filename_try);
@@ -564,6 +1217,16 @@ int main(argc,argv)
     }
     printf("%s opened\n",filename_try);
 
+    if (opt_skip_crc)
+        unzSetCrcPolicy(uf,UNZ_CRC_SKIP);
+#if defined(USECOPYSTORED) || defined(USEFILEHINTS)
+    /* opened before the chdir of -d, for a relative path */
+    fd_zipfile = open(filename_try,O_RDONLY);
+#endif
+#ifdef USECOPYSTORED
+    check_crc_stored = !opt_skip_crc;
+#endif
+
     if (opt_do_list==1)
         return do_list(uf);
     else if (opt_do_extract==1)
@@ -574,6 +1237,11 @@ int main(argc,argv)
           exit(-1);
         }
 
+#        ifdef USEPTHREAD
+        if ((filename_to_extract == NULL) && (opt_jobs > 1))
+            return do_extract_parallel(uf,opt_do_extract_withoutpath,
+                                       opt_overwrite,password,opt_jobs);
+#        endif
         if (filename_to_extract == NULL)
             return do_extract(uf,opt_do_extract_withoutpath,opt_overwrite,password);
         else
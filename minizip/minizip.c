@@ -23,6 +23,12 @@
 #endif
 
 #include "zip.h"
+#include "crc32hw.h"
+
+#if defined(unix) && !defined(NOPTHREAD)
+#define USEPTHREAD
+#include <pthread.h>
+#endif
 
 #ifdef WIN32
 #define USEWIN32IOAPI
@@ -33,6 +39,8 @@
 
 #define WRITEBUFFERSIZE (16384)
 #define MAXFILENAME (256)
+#define BLOCKSIZE (131072)  /* size of the blocks compressed in parallel (-j) */
+#define DICTSIZE (32768)    /* size of the dictionary of a block */
 
 #ifdef WIN32
 uLong filetime(f, tmzip, dt)
@@ -128,6 +136,19 @@ int check_exist_file(filename)
     return ret;
 }
 
+/* a file of 4 GB or more needs Zip64 extra fields in the local header */
+int isLargeFile(filename)
+    const char* filename;
+{
+    int ret = 0;
+#ifdef unix
+    struct stat s;
+    if ((stat(filename,&s)==0) && ((ZPOS64_T)s.st_size >= 0xffffffff))
+        ret = 1;
+#endif
+    return ret;
+}
+
 void do_banner()
 {
     printf("MiniZip 1.01b, demo of zLib + Zip package written by Gilles Vollant\n");
@@ -136,12 +157,21 @@ void do_banner()
 
 void do_help()
 {
-    printf("Usage : minizip [-o] [-a] [-0 to -9] [-p password] file.zip [files_to_add]\n\n" \
-           "  -o  Overwrite existing file.zip\n" \
+#ifdef USEPTHREAD
+    printf("Usage : minizip [-o] [-a] [-0 to -9] [-s] [-p password] [-j threads] file.zip [files_to_add]\n\n");
+#else
+    printf("Usage : minizip [-o] [-a] [-0 to -9] [-s] [-p password] file.zip [files_to_add]\n\n");
+#endif
+    printf("  -o  Overwrite existing file.zip\n" \
            "  -a  Append to existing file.zip\n" \
            "  -0  Store only\n" \
            "  -1  Compress faster\n" \
-           "  -9  Compress better\n\n");
+           "  -9  Compress better\n" \
+           "  -s  Store the files which do not compress (PNG, JPEG...)\n");
+#ifdef USEPTHREAD
+    printf("  -j  Compress the files with several threads\n");
+#endif
+    printf("\n");
 }
 
 /* calculate the CRC32 of a file,
@@ -171,7 +201,7 @@ int getFileCrc(const char* filenameinzip,void*buf,unsigned long size_buf,unsigne
             }
 
             if (size_read>0)
-                calculate_crc = crc32(calculate_crc,buf,size_read);
+                calculate_crc = crc32hw(calculate_crc,buf,size_read);
             total_read += size_read;
 
         } while ((err == ZIP_OK) && (size_read>0));
@@ -184,6 +214,453 @@ int getFileCrc(const char* filenameinzip,void*buf,unsigned long size_buf,unsigne
     return err;
 }
 
+/* files stored by -s, and files deflated, to estimate the CPU time saved */
+typedef struct auto_stats_s
+{
+    uLong number_stored;
+    ZPOS64_T size_stored;
+    ZPOS64_T size_deflated;
+} auto_stats;
+
+/* print the files stored by -s and the CPU time saved, estimated with the
+   CPU time per byte of the files deflated */
+void printAutoStats(stats,cpu)
+    const auto_stats* stats;
+    clock_t cpu;
+{
+    printf("%lu file(s) stored without compression (%llu bytes)",
+           stats->number_stored,(unsigned long long)stats->size_stored);
+    if ((stats->size_deflated > 0) && (stats->number_stored > 0))
+        printf(", about %.2f s of CPU saved",
+               ((double)cpu/CLOCKS_PER_SEC) *
+               (double)stats->size_stored / (double)stats->size_deflated);
+    printf("\n");
+}
+
+/* isOption : 1 if arg is an option of the command line, not a file to add */
+int isOption(arg)
+    const char* arg;
+{
+    return ((((*arg)=='-') || ((*arg)=='/')) &&
+            ((arg[1]=='o') || (arg[1]=='O') ||
+             (arg[1]=='a') || (arg[1]=='A') ||
+             (arg[1]=='p') || (arg[1]=='P') ||
+             (arg[1]=='j') || (arg[1]=='J') ||
+             (arg[1]=='s') || (arg[1]=='S') ||
+             ((arg[1]>='0') || (arg[1]<='9'))) &&
+            (strlen(arg) == 2));
+}
+
+#ifdef USEPTHREAD
+/*
+  Parallel compression (-j) : the files are cut in blocks of BLOCKSIZE bytes,
+    compressed by a pool of threads, at most a window of blocks ahead of the
+    main thread. As in pigz, each block is primed with the last DICTSIZE
+    bytes of the previous block as dictionary, and ended by a sync flush
+    (the last block of a file by Z_FINISH), so the blocks of a file form a
+    single deflate stream. The main thread writes the blocks in the zipfile
+    in order, with raw=1 in zipOpenNewFileInZip3_64, and gives the CRC merged
+    with crc32_combine to zipCloseFileInZipRaw64.
+*/
+
+typedef struct compress_entry_s
+{
+    const char* filenameinzip;
+    ZPOS64_T uncompressed_size; /* size of the file when the job starts */
+    int method;                 /* 0 to store, Z_DEFLATED */
+    long first_block;           /* index of its first block in the job */
+    long number_block;
+} compress_entry;
+
+typedef struct compress_block_s
+{
+    compress_entry* entry;
+    ZPOS64_T offset;            /* offset of the block in the file */
+    uLong size;                 /* uncompressed size of the block */
+    int done;                   /* 1 when the compression is finished */
+    int err;
+    uLong crc;                  /* crc32 of the uncompressed block */
+    char* data;                 /* compressed block */
+    uLong size_data;
+} compress_block;
+
+typedef struct compress_job_s
+{
+    compress_entry* entries;
+    int number_entry;
+    compress_block* blocks;
+    long number_block;
+    long next_block;            /* next block to give to a thread */
+    long committed;             /* number of blocks written in the zipfile */
+    long window;                /* max number of blocks ahead of committed */
+    int stop;                   /* set by the main thread on error */
+    int opt_compress_level;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;        /* signaled when done, committed or stop change */
+} compress_job;
+
+/* read len bytes at offset in the file fd, return ZIP_OK or ZIP_ERRNO */
+int readBlock(fd,buf,len,offset)
+    int fd;
+    char* buf;
+    uLong len;
+    ZPOS64_T offset;
+{
+    while (len > 0)
+    {
+        ssize_t size_read = pread(fd,buf,len,(off_t)offset);
+        if ((size_read < 0) && (errno == EINTR))
+            continue;
+        if (size_read <= 0)
+            return ZIP_ERRNO;
+        buf += size_read;
+        len -= size_read;
+        offset += size_read;
+    }
+    return ZIP_OK;
+}
+
+/* compress a block, with the deflate stream of the thread (reset here) and
+   bufin of DICTSIZE+BLOCKSIZE bytes */
+int compressBlock(block,stream,bufin)
+    compress_block* block;
+    z_stream* stream;
+    char* bufin;
+{
+    uLong size_dict = (block->offset >= DICTSIZE) ? DICTSIZE :
+                                                    (uLong)block->offset;
+    uLong alloc_data;
+    int last = (block->offset+block->size ==
+                block->entry->uncompressed_size);
+    int err=ZIP_OK;
+    int fd;
+
+    fd = open(block->entry->filenameinzip,O_RDONLY);
+    if (fd < 0)
+        return ZIP_ERRNO;
+    err = readBlock(fd,bufin,size_dict+block->size,block->offset-size_dict);
+    close(fd);
+    if (err!=ZIP_OK)
+        return err;
+
+    block->crc = crc32hw(0L,(const Bytef*)bufin+size_dict,block->size);
+
+    if (block->entry->method == 0)
+        alloc_data = block->size;
+    else
+        alloc_data = deflateBound(stream,block->size) + 16;
+    block->data = (char*)malloc(alloc_data+1);
+    if (block->data==NULL)
+        return ZIP_INTERNALERROR;
+
+    if (block->entry->method == 0)
+    {
+        memcpy(block->data,bufin+size_dict,block->size);
+        block->size_data = block->size;
+        return ZIP_OK;
+    }
+
+    if (deflateReset(stream)!=Z_OK)
+        return ZIP_INTERNALERROR;
+    if ((size_dict > 0) &&
+        (deflateSetDictionary(stream,(const Bytef*)bufin,size_dict)!=Z_OK))
+        return ZIP_INTERNALERROR;
+
+    stream->next_in = (Bytef*)bufin+size_dict;
+    stream->avail_in = (uInt)block->size;
+    stream->next_out = (Bytef*)block->data;
+    stream->avail_out = (uInt)alloc_data;
+    for (;;)
+    {
+        int zerr = deflate(stream,last ? Z_FINISH : Z_SYNC_FLUSH);
+        if ((zerr==Z_STREAM_END) || ((!last) && (stream->avail_out > 0) &&
+                                     ((zerr==Z_OK) || (zerr==Z_BUF_ERROR))))
+            break;
+        if (((zerr!=Z_OK) && (zerr!=Z_BUF_ERROR)) || (stream->avail_out > 0))
+            return ZIP_INTERNALERROR;
+        else
+        {
+            char* data = (char*)realloc(block->data,alloc_data*2);
+            if (data==NULL)
+                return ZIP_INTERNALERROR;
+            block->data = data;
+            stream->next_out = (Bytef*)block->data+alloc_data;
+            stream->avail_out = (uInt)alloc_data;
+            alloc_data *= 2;
+        }
+    }
+    block->size_data = alloc_data - stream->avail_out;
+    return ZIP_OK;
+}
+
+void* compressThread(arg)
+    void* arg;
+{
+    compress_job* job = (compress_job*)arg;
+    z_stream stream;
+    char* bufin;
+    int stream_initialised = 0;
+
+    stream.zalloc = (alloc_func)0;
+    stream.zfree = (free_func)0;
+    stream.opaque = (voidpf)0;
+    if ((job->opt_compress_level != 0) &&
+        (deflateInit2(&stream, job->opt_compress_level, Z_DEFLATED,
+                      -MAX_WBITS, DEF_MEM_LEVEL, Z_DEFAULT_STRATEGY)==Z_OK))
+        stream_initialised = 1;
+    bufin = (char*)malloc(DICTSIZE+BLOCKSIZE);
+
+    pthread_mutex_lock(&job->lock);
+    for (;;)
+    {
+        compress_block* block;
+
+        while ((!job->stop) && (job->next_block<job->number_block) &&
+               (job->next_block>=job->committed+job->window))
+            pthread_cond_wait(&job->cond,&job->lock);
+        if ((job->stop) || (job->next_block>=job->number_block))
+            break;
+        block = &job->blocks[job->next_block++];
+        pthread_mutex_unlock(&job->lock);
+
+        if ((bufin==NULL) ||
+            ((job->opt_compress_level != 0) && (!stream_initialised)))
+            block->err = ZIP_INTERNALERROR;
+        else
+            block->err = compressBlock(block,&stream,bufin);
+
+        pthread_mutex_lock(&job->lock);
+        block->done = 1;
+        pthread_cond_broadcast(&job->cond);
+    }
+    pthread_mutex_unlock(&job->lock);
+
+    if (stream_initialised)
+        deflateEnd(&stream);
+    free(bufin);
+    return NULL;
+}
+
+/* write in the zipfile a file, as its blocks are compressed by compressThread */
+int commitFile(zf,job,entry,password,buf,size_buf)
+    zipFile zf;
+    compress_job* job;
+    compress_entry* entry;
+    const char* password;
+    void* buf;
+    int size_buf;
+{
+    zip_fileinfo zi;
+    uLong crcFile=0;
+    long b;
+    int err=ZIP_OK;
+
+    zi.tmz_date.tm_sec = zi.tmz_date.tm_min = zi.tmz_date.tm_hour =
+    zi.tmz_date.tm_mday = zi.tmz_date.tm_mon = zi.tmz_date.tm_year = 0;
+    zi.dosDate = 0;
+    zi.internal_fa = 0;
+    zi.external_fa = 0;
+    filetime((char*)entry->filenameinzip,&zi.tmz_date,&zi.dosDate);
+
+    /* the crc is needed before the data for crypting */
+    if (password != NULL)
+        err = getFileCrc(entry->filenameinzip,buf,size_buf,&crcFile);
+
+    if (err == ZIP_OK)
+        err = zipOpenNewFileInZip3_64(zf,entry->filenameinzip,&zi,
+                         NULL,0,NULL,0,NULL /* comment*/,
+                         entry->method,job->opt_compress_level,1,
+                         -MAX_WBITS, DEF_MEM_LEVEL, Z_DEFAULT_STRATEGY,
+                         password,crcFile,
+                         (entry->uncompressed_size >= 0xffffffff));
+    if (err != ZIP_OK)
+    {
+        printf("error in opening %s in zipfile\n",entry->filenameinzip);
+        return err;
+    }
+
+    crcFile = 0;
+    for (b=entry->first_block;b<entry->first_block+entry->number_block;b++)
+    {
+        compress_block* block = &job->blocks[b];
+
+        pthread_mutex_lock(&job->lock);
+        while (!block->done)
+            pthread_cond_wait(&job->cond,&job->lock);
+        pthread_mutex_unlock(&job->lock);
+
+        if (block->err!=ZIP_OK)
+        {
+            printf("error in reading %s\n",entry->filenameinzip);
+            err = ZIP_ERRNO;
+        }
+        else if (block->size_data>0)
+        {
+            err = zipWriteInFileInZip(zf,block->data,(unsigned)block->size_data);
+            if (err<0)
+            {
+                printf("error in writing %s in the zipfile\n",
+                                 entry->filenameinzip);
+                err = ZIP_ERRNO;
+            }
+        }
+        crcFile = crc32_combine(crcFile,block->crc,(z_off_t)block->size);
+        free(block->data);
+        block->data = NULL;
+
+        pthread_mutex_lock(&job->lock);
+        job->committed = b+1;
+        pthread_cond_broadcast(&job->cond);
+        pthread_mutex_unlock(&job->lock);
+
+        if (err!=ZIP_OK)
+            return err;
+    }
+
+    err = zipCloseFileInZipRaw64(zf,entry->uncompressed_size,crcFile);
+    if (err!=ZIP_OK)
+        printf("error in closing %s in the zipfile\n",entry->filenameinzip);
+    return err;
+}
+
+int addFilesParallel(zf,argc,argv,first_arg,opt_compress_level,opt_auto,stats,password,opt_jobs,buf,size_buf)
+    zipFile zf;
+    int argc;
+    char *argv[];
+    int first_arg;
+    int opt_compress_level;
+    int opt_auto;
+    auto_stats* stats;
+    const char* password;
+    int opt_jobs;
+    void* buf;
+    int size_buf;
+{
+    compress_job job;
+    pthread_t* threads;
+    int number_thread=0;
+    int err=ZIP_OK;
+    int i,t;
+    long b;
+
+    job.entries = (compress_entry*)malloc((argc+1)*sizeof(compress_entry));
+    threads = (pthread_t*)malloc(opt_jobs*sizeof(pthread_t));
+    if ((job.entries==NULL) || (threads==NULL))
+    {
+        printf("Error allocating memory\n");
+        free(job.entries);
+        free(threads);
+        return ZIP_INTERNALERROR;
+    }
+
+    job.number_entry = 0;
+    job.number_block = 0;
+    for (i=first_arg;i<argc;i++)
+        if (!isOption(argv[i]))
+        {
+            compress_entry* entry = &job.entries[job.number_entry++];
+            struct stat s;
+            entry->filenameinzip = argv[i];
+            entry->uncompressed_size = 0;
+            if (stat(argv[i],&s)==0)
+                entry->uncompressed_size = (ZPOS64_T)s.st_size;
+            entry->method = (opt_compress_level != 0) ? Z_DEFLATED : 0;
+
+            /* -s : the method is chosen with the beginning of the file,
+               before its blocks are given to the threads */
+            if ((opt_auto) && (entry->method != 0))
+            {
+                int fd = open(argv[i],O_RDONLY);
+                if (fd >= 0)
+                {
+                    ssize_t size_read = read(fd,buf,size_buf);
+                    if (size_read >= 0) /* an empty file is stored */
+                        entry->method = zipChooseMethod(buf,
+                                            (unsigned)size_read,
+                                            opt_compress_level);
+                    close(fd);
+                }
+                if (entry->method == 0)
+                {
+                    stats->number_stored++;
+                    stats->size_stored += entry->uncompressed_size;
+                }
+                else
+                    stats->size_deflated += entry->uncompressed_size;
+            }
+            entry->first_block = job.number_block;
+            entry->number_block = (long)((entry->uncompressed_size +
+                                          BLOCKSIZE - 1) / BLOCKSIZE);
+            if (entry->number_block == 0)
+                entry->number_block = 1;
+            job.number_block += entry->number_block;
+        }
+
+    job.blocks = (compress_block*)malloc((job.number_block+1)*
+                                         sizeof(compress_block));
+    if (job.blocks==NULL)
+    {
+        printf("Error allocating memory\n");
+        free(job.entries);
+        free(threads);
+        return ZIP_INTERNALERROR;
+    }
+    for (i=0;i<job.number_entry;i++)
+    {
+        compress_entry* entry = &job.entries[i];
+        for (b=0;b<entry->number_block;b++)
+        {
+            compress_block* block = &job.blocks[entry->first_block+b];
+            memset(block,0,sizeof(compress_block));
+            block->entry = entry;
+            block->offset = (ZPOS64_T)b*BLOCKSIZE;
+            block->size = BLOCKSIZE;
+            if (block->offset+block->size > entry->uncompressed_size)
+                block->size = (uLong)(entry->uncompressed_size-block->offset);
+        }
+    }
+
+    job.next_block = 0;
+    job.committed = 0;
+    job.window = 4*opt_jobs;
+    job.stop = 0;
+    job.opt_compress_level = opt_compress_level;
+    pthread_mutex_init(&job.lock,NULL);
+    pthread_cond_init(&job.cond,NULL);
+
+    for (t=0;t<opt_jobs;t++)
+    {
+        if (pthread_create(&threads[t],NULL,compressThread,&job)!=0)
+            break;
+        number_thread++;
+    }
+    if (number_thread==0)
+    {
+        job.window = job.number_block;
+        compressThread(&job);
+    }
+
+    for (i=0;(i<job.number_entry) && (err==ZIP_OK);i++)
+        err = commitFile(zf,&job,&job.entries[i],password,buf,size_buf);
+
+    pthread_mutex_lock(&job.lock);
+    job.stop = 1;
+    pthread_cond_broadcast(&job.cond);
+    pthread_mutex_unlock(&job.lock);
+    for (t=0;t<number_thread;t++)
+        pthread_join(threads[t],NULL);
+
+    for (b=0;b<job.number_block;b++)
+        free(job.blocks[b].data);
+    pthread_mutex_destroy(&job.lock);
+    pthread_cond_destroy(&job.cond);
+    free(threads);
+    free(job.blocks);
+    free(job.entries);
+    return err;
+}
+#endif
+
 int main(argc,argv)
     int argc;
     char *argv[];
@@ -191,6 +668,12 @@ int main(argc,argv)
     int i;
     int opt_overwrite=0;
     int opt_compress_level=Z_DEFAULT_COMPRESSION;
+#ifdef USEPTHREAD
+    int opt_jobs=1;
+#endif
+    int opt_auto=0;
+    auto_stats stats;
+    clock_t cpu_start;
     int zipfilenamearg = 0;
     char filename_try[MAXFILENAME+16];
     int zipok;
@@ -223,12 +706,24 @@ int main(argc,argv)
                         opt_overwrite = 2;
                     if ((c>='0') && (c<='9'))
                         opt_compress_level = c-'0';
+                    if ((c=='s') || (c=='S'))
+                        opt_auto = 1;
 
                     if (((c=='p') || (c=='P')) && (i+1<argc))
                     {
                         password=argv[i+1];
                         i++;
                     }
+
+                    if (((c=='j') || (c=='J')) && (i+1<argc))
+                    {
+#ifdef USEPTHREAD
+                        opt_jobs=atoi(argv[i+1]);
+#else
+                        printf("-j is not available, the files are compressed by one thread\n");
+#endif
+                        i++;
+                    }
                 }
             }
             else
@@ -307,7 +802,10 @@ int main(argc,argv)
         fill_win32_filefunc(&ffunc);
         zf = zipOpen2(filename_try,(opt_overwrite==2) ? 2 : 0,NULL,&ffunc);
 #        else
-        zf = zipOpen(filename_try,(opt_overwrite==2) ? 2 : 0);
+        /* the local headers are patched on close with positional writes */
+        zlib_filefunc_def ffunc;
+        fill_pread_filefunc(&ffunc);
+        zf = zipOpen2(filename_try,(opt_overwrite==2) ? 2 : 0,NULL,&ffunc);
 #        endif
 
         if (zf == NULL)
@@ -318,17 +816,24 @@ int main(argc,argv)
         else
             printf("creating %s\n",filename_try);
 
+        stats.number_stored = 0;
+        stats.size_stored = stats.size_deflated = 0;
+        cpu_start = clock();
+
+#        ifdef USEPTHREAD
+        if ((opt_jobs > 1) && (err==ZIP_OK))
+            err = addFilesParallel(zf,argc,argv,zipfilenamearg+1,
+                                   opt_compress_level,opt_auto,&stats,
+                                   password,opt_jobs,buf,size_buf);
+        else
+#        endif
         for (i=zipfilenamearg+1;(i<argc) && (err==ZIP_OK);i++)
         {
-            if (!((((*(argv[i]))=='-') || ((*(argv[i]))=='/')) &&
-                  ((argv[i][1]=='o') || (argv[i][1]=='O') ||
-                   (argv[i][1]=='a') || (argv[i][1]=='A') ||
-                   (argv[i][1]=='p') || (argv[i][1]=='P') ||
-                   ((argv[i][1]>='0') || (argv[i][1]<='9'))) &&
-                  (strlen(argv[i]) == 2)))
+            if (!isOption(argv[i]))
             {
                 FILE * fin;
                 int size_read;
+                ZPOS64_T size_file = 0;
                 const char* filenameinzip = argv[i];
                 zip_fileinfo zi;
                 unsigned long crcFile=0;
@@ -349,13 +854,14 @@ int main(argc,argv)
                 if ((password != NULL) && (err==ZIP_OK))
                     err = getFileCrc(filenameinzip,buf,size_buf,&crcFile);
 
-                err = zipOpenNewFileInZip3(zf,filenameinzip,&zi,
+                err = zipOpenNewFileInZip3_64(zf,filenameinzip,&zi,
                                  NULL,0,NULL,0,NULL /* comment*/,
-                                 (opt_compress_level != 0) ? Z_DEFLATED : 0,
+                                 (opt_compress_level == 0) ? 0 :
+                                 (opt_auto ? ZIP_METHOD_AUTO : Z_DEFLATED),
                                  opt_compress_level,0,
                                  /* -MAX_WBITS, DEF_MEM_LEVEL, Z_DEFAULT_STRATEGY, */
                                  -MAX_WBITS, DEF_MEM_LEVEL, Z_DEFAULT_STRATEGY,
-                                 password,crcFile);
+                                 password,crcFile,isLargeFile(filenameinzip));
 
                 if (err != ZIP_OK)
                     printf("error in opening %s in zipfile\n",filenameinzip);
@@ -383,6 +889,7 @@ int main(argc,argv)
 
                         if (size_read>0)
                         {
+                            size_file += size_read;
                             err = zipWriteInFileInZip (zf,buf,size_read);
                             if (err<0)
                             {
@@ -400,6 +907,18 @@ int main(argc,argv)
                     err=ZIP_ERRNO;
                 else
                 {
+                    if (opt_auto)
+                    {
+                        /* an empty file is stored by zipCloseFileInZip */
+                        if ((size_file == 0) ||
+                            (zipGetCurrentFileMethod(zf) == 0))
+                        {
+                            stats.number_stored++;
+                            stats.size_stored += size_file;
+                        }
+                        else
+                            stats.size_deflated += size_file;
+                    }
                     err = zipCloseFileInZip(zf);
                     if (err!=ZIP_OK)
                         printf("error in closing %s in the zipfile\n",
@@ -410,6 +929,8 @@ int main(argc,argv)
         errclose = zipClose(zf,NULL);
         if (errclose != ZIP_OK)
             printf("error in closing %s\n",filename_try);
+        else if ((opt_auto) && (opt_compress_level != 0) && (err==ZIP_OK))
+            printAutoStats(&stats,clock()-cpu_start);
     }
     else
     {
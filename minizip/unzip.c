@@ -34,6 +34,10 @@ woven in by Terry Thorsen 1/2003.
   version without encryption capabilities).
  */
 
+/* memrchr is a GNU extension */
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -52,6 +56,12 @@ woven in by Terry Thorsen 1/2003.
 #   include <errno.h>
 #endif
 
+/* the deferred checks of crc32 (UNZ_CRC_DEFER) run in a thread */
+#if (defined(unix) || defined(__APPLE__)) && !defined(NOPTHREAD)
+#define UNZ_CRCTHREAD
+#include <pthread.h>
+#endif
+
 
 #ifndef local
 #  define local static
@@ -70,6 +80,14 @@ woven in by Terry Thorsen 1/2003.
 #define UNZ_BUFSIZE (16384)
 #endif
 
+/* the read buffer of a large file doubles at each refill up to this size */
+#ifndef UNZ_MAXBUFSIZE
+#define UNZ_MAXBUFSIZE (262144)
+#endif
+
+/* value of pos_stream when the position of the stream is not known */
+#define UNZ_POS_UNKNOWN ((ZPOS64_T)-1)
+
 #ifndef UNZ_MAXFILENAMEINZIP
 #define UNZ_MAXFILENAMEINZIP (256)
 #endif
@@ -77,12 +95,18 @@ woven in by Terry Thorsen 1/2003.
 #ifndef ALLOC
 # define ALLOC(size) (malloc(size))
 #endif
+#ifndef REALLOC
+# define REALLOC(p,size) (realloc(p,size))
+#endif
 #ifndef TRYFREE
 # define TRYFREE(p) {if (p) free(p);}
 #endif
 
 #define SIZECENTRALDIRITEM (0x2e)
 #define SIZEZIPLOCALHEADER (0x1e)
+#define SIZEENDCENTRALDIR  (0x16)
+#define SIZEZIP64LOCATOR   (0x14)
+#define SIZEZIP64ENDCENTRALDIR (0x38)
 
 
 
@@ -93,7 +117,7 @@ const char unz_copyright[] =
 /* unz_file_info_interntal contain internal info about a file in zipfile*/
 typedef struct unz_file_info_internal_s
 {
-    uLong offset_curfile;/* relative offset of local header 4 bytes */
+    ZPOS64_T offset_curfile;/* relative offset of local header 8 bytes */
 } unz_file_info_internal;
 
 
@@ -102,54 +126,133 @@ typedef struct unz_file_info_internal_s
 typedef struct
 {
     char  *read_buffer;         /* internal buffer for compressed data */
+    uInt  size_read_buffer;     /* size of read_buffer */
+    uInt  max_read_buffer;      /* size up to which read_buffer can grow */
+    alloc_func zalloc;          /* allocator of this structure, read_buffer */
+    free_func  zfree;           /*   and the inflate state (NULL : ALLOC, */
+    voidpf     opaque;          /*   TRYFREE and the zlib default) */
     z_stream stream;            /* zLib stream structure for inflate */
 
-    uLong pos_in_zipfile;       /* position in byte on the zipfile, for fseek*/
+    ZPOS64_T pos_in_zipfile;    /* position in byte on the zipfile, for fseek*/
     uLong stream_initialised;   /* flag set if stream structure is initialised*/
 
-    uLong offset_local_extrafield;/* offset of the local extra field */
+    ZPOS64_T offset_local_extrafield;/* offset of the local extra field */
     uInt  size_local_extrafield;/* size of the local extra field */
-    uLong pos_local_extrafield;   /* position in the local extra field in read*/
+    ZPOS64_T pos_local_extrafield;/* position in the local extra field in read*/
+    ZPOS64_T total_out_64;      /* number of byte uncompressed until now */
 
     uLong crc32;                /* crc32 of all data uncompressed */
     uLong crc32_wait;           /* crc32 we must obtain after decompress all */
-    uLong rest_read_compressed; /* number of byte to be decompressed */
-    uLong rest_read_uncompressed;/*number of byte to be obtained after decomp*/
+    int   check_crc;            /* 0 if the crc32 is not computed (its check
+                                   is skipped, or deferred) */
+    unz64_file_pos file_pos;    /* position of the file in the central dir,
+                                   for a deferred check */
+    ZPOS64_T rest_read_compressed; /* number of byte to be decompressed */
+    ZPOS64_T rest_read_uncompressed;/*number of byte to be obtained after decomp*/
     zlib_filefunc_def z_filefunc;
     voidpf filestream;        /* io structore of the zipfile */
+    ZPOS64_T* ppos_stream;      /* pos_stream of the unz_s of the zipfile */
     uLong compression_method;   /* compression method (0==store) */
-    uLong byte_before_the_zipfile;/* byte before the zipfile, (>0 for sfx)*/
+    ZPOS64_T byte_before_the_zipfile;/* byte before the zipfile, (>0 for sfx)*/
     int   raw;
+
+    int encrypted;
+#    ifndef NOUNCRYPT
+    unsigned long keys[3];     /* keys defining the pseudo-random sequence */
+    const unsigned long* pcrc_32_tab;
+#    endif
 } file_in_zip_read_info_s;
 
 
+/* unz_index_entry_s contain what is needed to jump directly to a file
+    of the central dir, without walking it */
+typedef struct unz_index_entry_s
+{
+    ZPOS64_T pos_in_central_dir;/* pos of the file in the central dir */
+    ZPOS64_T num_file;          /* number of the file in the zipfile */
+    uLong name_offset;          /* offset of the filename in the name arena */
+} unz_index_entry;
+
+/* unz_index_s contain an in-memory index of the central dir, built once when
+    the zipfile is opened : the filenames are packed ('\0' terminated) in a
+    single arena and two open addressing hash tables (one on the filename,
+    one on the case folded filename) give the entry of a filename */
+typedef struct unz_index_s
+{
+    char* names;                /* arena with all the filenames */
+    uLong size_names;           /* number of bytes used in the arena */
+    unz_index_entry* entries;   /* one entry per file of the central dir */
+    uLong number_entry;         /* number of entries */
+    uLong* table;               /* slots (entry number + 1, 0 if empty) */
+    uLong* table_folded;        /* same, keyed on the case folded filename */
+    uLong size_table;           /* number of slots, power of 2 */
+} unz_index;
+
+
+#ifdef UNZ_CRCTHREAD
+/* unz_crc_queue_s contain the files of the zipfile waiting for the deferred
+    check of their crc32, and the thread doing it */
+typedef struct unz_crc_queue_s
+{
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond_work;   /* signaled when a file is queued, or stop */
+    pthread_cond_t cond_idle;   /* signaled when all the files are checked */
+    unz64_file_pos* files;      /* files queued */
+    uLong number_file;          /* number of files queued (0 when all the
+                                   files are checked) */
+    uLong next_file;            /* number of files taken by the thread */
+    uLong size_files;           /* number of slots of files */
+    int err;                    /* first error of the checks */
+    int stop;                   /* set to end the thread */
+} unz_crc_queue;
+#endif
+
 /* unz_s contain internal information about the zipfile
 */
 typedef struct
 {
     zlib_filefunc_def z_filefunc;
     voidpf filestream;        /* io structore of the zipfile */
-    unz_global_info gi;       /* public global information */
-    uLong byte_before_the_zipfile;/* byte before the zipfile, (>0 for sfx)*/
-    uLong num_file;             /* number of the current file in the zipfile*/
-    uLong pos_in_central_dir;   /* pos of the current file in the central dir*/
+    ZPOS64_T pos_stream;        /* position of the stream, when the set has no
+                                   positional read and it is known (else
+                                   UNZ_POS_UNKNOWN) : a read there does not
+                                   need a seek */
+    uInt size_read_buffer;      /* size of the read buffer of the files */
+    uInt max_read_buffer;       /* size up to which it can grow */
+    alloc_func zalloc;          /* allocator given by unzSetAllocator */
+    free_func  zfree;
+    voidpf     opaque;
+    unz_global_info64 gi;     /* public global information */
+    ZPOS64_T byte_before_the_zipfile;/* byte before the zipfile, (>0 for sfx)*/
+    ZPOS64_T num_file;          /* number of the current file in the zipfile*/
+    ZPOS64_T pos_in_central_dir;/* pos of the current file in the central dir*/
     uLong current_file_ok;      /* flag about the usability of the current file*/
-    uLong central_pos;          /* position of the beginning of the central dir*/
+    ZPOS64_T central_pos;       /* position of the end of central dir record */
+    int zip64;                  /* 1 if the zipfile has a Zip64 end of central
+                                   dir record */
 
-    uLong size_central_dir;     /* size of the central directory  */
-    uLong offset_central_dir;   /* offset of start of central directory with
+    ZPOS64_T size_central_dir;  /* size of the central directory  */
+    ZPOS64_T offset_central_dir;/* offset of start of central directory with
                                    respect to the starting disk number */
+    unsigned char* central_dir; /* whole central dir read in memory (NULL if
+                                   it could not be, then it is read from
+                                   the zipfile when needed) */
 
-    unz_file_info cur_file_info; /* public info about the current file in zip*/
+    unz_file_info64 cur_file_info; /* public info about the current file in zip*/
     unz_file_info_internal cur_file_info_internal; /* private info about it*/
     file_in_zip_read_info_s* pfile_in_zip_read; /* structure about the current
                                         file if we are decompressing it */
-
-    int encrypted;
-#    ifndef NOUNCRYPT
-    unsigned long keys[3];     /* keys defining the pseudo-random sequence */
-    const unsigned long* pcrc_32_tab;
-#    endif
+    file_in_zip_read_info_s* pfile_in_zip_read_free; /* structure of the last
+                                        closed current file, with its buffer
+                                        and inflate state, kept to be
+                                        recycled by the next open (or NULL) */
+    unz_index* index;           /* index of the central dir (NULL if none) */
+    int crc_policy;             /* UNZ_CRC_VERIFY, UNZ_CRC_DEFER or
+                                   UNZ_CRC_SKIP */
+#ifdef UNZ_CRCTHREAD
+    unz_crc_queue* crc_queue;   /* deferred checks (NULL until the first) */
+#endif
 } unz_s;
 
 
@@ -157,105 +260,37 @@ typedef struct
 #include "crypt.h"
 #endif
 
+#include "crc32hw.h"
+
 /* ===========================================================================
-     Read a byte from a gz_stream; update next_in and avail_in. Return EOF
-   for end of file.
-   IN assertion: the stream s has been sucessfully opened for reading.
+   Reads a short or a long in LSB order from a memory buffer.
+   The bytes are assembled one by one, so the buffer does not need any
+   alignment (compilers turn this into a single load on little endian CPUs)
 */
+local uLong unzlocal_bufShort OF((const unsigned char* p));
 
-
-local int unzlocal_getByte OF((
-    const zlib_filefunc_def* pzlib_filefunc_def,
-    voidpf filestream,
-    int *pi));
-
-local int unzlocal_getByte(pzlib_filefunc_def,filestream,pi)
-    const zlib_filefunc_def* pzlib_filefunc_def;
-    voidpf filestream;
-    int *pi;
+local uLong unzlocal_bufShort (p)
+    const unsigned char* p;
 {
-    unsigned char c;
-    int err = (int)ZREAD(*pzlib_filefunc_def,filestream,&c,1);
-    if (err==1)
-    {
-        *pi = (int)c;
-        return UNZ_OK;
-    }
-    else
-    {
-        if (ZERROR(*pzlib_filefunc_def,filestream))
-            return UNZ_ERRNO;
-        else
-            return UNZ_EOF;
-    }
+    return (uLong)p[0] | ((uLong)p[1]<<8);
 }
 
+local uLong unzlocal_bufLong OF((const unsigned char* p));
 
-/* ===========================================================================
-   Reads a long in LSB order from the given gz_stream. Sets
-*/
-local int unzlocal_getShort OF((
-    const zlib_filefunc_def* pzlib_filefunc_def,
-    voidpf filestream,
-    uLong *pX));
-
-local int unzlocal_getShort (pzlib_filefunc_def,filestream,pX)
-    const zlib_filefunc_def* pzlib_filefunc_def;
-    voidpf filestream;
-    uLong *pX;
+local uLong unzlocal_bufLong (p)
+    const unsigned char* p;
 {
-    uLong x ;
-    int i;
-    int err;
-
-    err = unzlocal_getByte(pzlib_filefunc_def,filestream,&i);
-    x = (uLong)i;
-
-    if (err==UNZ_OK)
-        err = unzlocal_getByte(pzlib_filefunc_def,filestream,&i);
-    x += ((uLong)i)<<8;
-
-    if (err==UNZ_OK)
-        *pX = x;
-    else
-        *pX = 0;
-    return err;
+    return (uLong)p[0] | ((uLong)p[1]<<8) |
+           ((uLong)p[2]<<16) | ((uLong)p[3]<<24);
 }
 
-local int unzlocal_getLong OF((
-    const zlib_filefunc_def* pzlib_filefunc_def,
-    voidpf filestream,
-    uLong *pX));
+local ZPOS64_T unzlocal_bufLong64 OF((const unsigned char* p));
 
-local int unzlocal_getLong (pzlib_filefunc_def,filestream,pX)
-    const zlib_filefunc_def* pzlib_filefunc_def;
-    voidpf filestream;
-    uLong *pX;
+local ZPOS64_T unzlocal_bufLong64 (p)
+    const unsigned char* p;
 {
-    uLong x ;
-    int i;
-    int err;
-
-    err = unzlocal_getByte(pzlib_filefunc_def,filestream,&i);
-    x = (uLong)i;
-
-    if (err==UNZ_OK)
-        err = unzlocal_getByte(pzlib_filefunc_def,filestream,&i);
-    x += ((uLong)i)<<8;
-
-    if (err==UNZ_OK)
-        err = unzlocal_getByte(pzlib_filefunc_def,filestream,&i);
-    x += ((uLong)i)<<16;
-
-    if (err==UNZ_OK)
-        err = unzlocal_getByte(pzlib_filefunc_def,filestream,&i);
-    x += ((uLong)i)<<24;
-
-    if (err==UNZ_OK)
-        *pX = x;
-    else
-        *pX = 0;
-    return err;
+    return (ZPOS64_T)unzlocal_bufLong(p) |
+           ((ZPOS64_T)unzlocal_bufLong(p+4)<<32);
 }
 
 
@@ -292,8 +327,50 @@ local int strcmpcasenosensitive_internal (fileName1,fileName2)
 
 #ifndef STRCMPCASENOSENTIVEFUNCTION
 #define STRCMPCASENOSENTIVEFUNCTION strcmpcasenosensitive_internal
+/* the case folded hash of the index matches strcmpcasenosensitive_internal */
+#define CASEFOLDEDINDEX
 #endif
 
+/*
+  Read size bytes at offset pos of the zipfile. With a positional read, this
+    is ZPREAD. Else the stream is only seeked when it is not already at pos
+    (*ppos_stream is its position, or UNZ_POS_UNKNOWN), so the sequential
+    refills of a file do not throw away the buffers of the set.
+*/
+local uLong unzlocal_ReadAt OF((
+    const zlib_filefunc_def* pzlib_filefunc_def,
+    voidpf filestream,
+    ZPOS64_T* ppos_stream,
+    void* buf,
+    uLong size,
+    ZPOS64_T pos));
+
+local uLong unzlocal_ReadAt(pzlib_filefunc_def,filestream,ppos_stream,buf,size,pos)
+    const zlib_filefunc_def* pzlib_filefunc_def;
+    voidpf filestream;
+    ZPOS64_T* ppos_stream;
+    void* buf;
+    uLong size;
+    ZPOS64_T pos;
+{
+    uLong uRead;
+
+    if (pzlib_filefunc_def->zpread_file != NULL)
+        return ZPREAD(*pzlib_filefunc_def,filestream,buf,size,pos);
+
+    if (*ppos_stream != pos)
+    {
+        *ppos_stream = UNZ_POS_UNKNOWN;
+        if (ZSEEK(*pzlib_filefunc_def,filestream,(uLong)pos,
+                  ZLIB_FILEFUNC_SEEK_SET)!=0)
+            return 0;
+    }
+    uRead = ZREAD(*pzlib_filefunc_def,filestream,buf,size);
+    *ppos_stream = (uRead == size) ? pos + uRead : UNZ_POS_UNKNOWN;
+    return uRead;
+}
+
+
 /*
    Compare two filename (fileName1,fileName2).
    If iCaseSenisivity = 1, comparision is case sensitivity (like strcmp)
@@ -317,73 +394,448 @@ extern int ZEXPORT unzStringFileNameCompare (fileName1,fileName2,iCaseSensitivit
     return STRCMPCASENOSENTIVEFUNCTION(fileName1,fileName2);
 }
 
-#ifndef BUFREADCOMMENT
-#define BUFREADCOMMENT (0x400)
+/* the end of central dir record is searched in the tail of the zipfile,
+   long enough for the record with the largest comment */
+#define SIZETAILREAD (SIZEENDCENTRALDIR+0xffff)
+
+#if defined(__GLIBC__) && !defined(NOMEMRCHR)
+#define UNZ_MEMRCHR
+#endif
+
+/* unz_tail_s contain the tail of the zipfile, read once by
+    unzlocal_SearchCentralDir : the records of the end of the zipfile, and
+    the central dir of a small zipfile, are then taken from it */
+typedef struct unz_tail_s
+{
+    const unsigned char* data;  /* bytes of the tail (mapped, or buf) */
+    unsigned char* buf;         /* buffer allocated for them, or NULL */
+    ZPOS64_T pos;               /* position of data in the zipfile */
+    uLong size;                 /* number of bytes of data */
+} unz_tail;
+
+/*
+  Read size bytes at offset pos of the zipfile, copied from the tail when
+    they are in it
+*/
+local uLong unzlocal_ReadTail OF((
+    const zlib_filefunc_def* pzlib_filefunc_def,
+    voidpf filestream,
+    const unz_tail* ptail,
+    void* buf,
+    uLong size,
+    ZPOS64_T pos));
+
+local uLong unzlocal_ReadTail(pzlib_filefunc_def,filestream,ptail,buf,size,pos)
+    const zlib_filefunc_def* pzlib_filefunc_def;
+    voidpf filestream;
+    const unz_tail* ptail;
+    void* buf;
+    uLong size;
+    ZPOS64_T pos;
+{
+    ZPOS64_T pos_stream = UNZ_POS_UNKNOWN;
+
+    if ((ptail->data!=NULL) && (pos>=ptail->pos) &&
+        (pos+size<=ptail->pos+ptail->size))
+    {
+        memcpy(buf,ptail->data+(uLong)(pos-ptail->pos),size);
+        return size;
+    }
+    return unzlocal_ReadAt(pzlib_filefunc_def,filestream,&pos_stream,
+                           buf,size,pos);
+}
+
+/*
+  Find the last signature of an end of central dir record ("PK\5\6") which
+    starts in buf[0..size-1], with memrchr when there is one
+  return NULL if there is none
+*/
+local const unsigned char* unzlocal_FindEndCentralDir OF((
+    const unsigned char* buf,
+    uLong size));
+
+local const unsigned char* unzlocal_FindEndCentralDir (buf, size)
+    const unsigned char* buf;
+    uLong size;
+{
+    const unsigned char* p = buf + size;
+    while (p > buf)
+    {
+#ifdef UNZ_MEMRCHR
+        p = (const unsigned char*)memrchr(buf,0x50,(size_t)(p-buf));
+        if (p==NULL)
+            return NULL;
+#else
+        if (*(--p) != 0x50)
+            continue;
 #endif
+        if ((p[1]==0x4b) && (p[2]==0x05) && (p[3]==0x06))
+            return p;
+    }
+    return NULL;
+}
 
 /*
   Locate the Central directory of a zipfile (at the end, just before
-    the global comment)
+    the global comment), with a single read of the tail of the zipfile (or
+    in the mapping of the set) kept in *ptail : ptail->buf must be freed
+    by the caller.
+  A signature is taken only if the record fits in the zipfile with its
+    comment, and if its central dir ends before it ; the record whose
+    comment ends exactly at the end of the zipfile is preferred (so a
+    "PK\5\6" in the comment is skipped).
 */
-local uLong unzlocal_SearchCentralDir OF((
+local ZPOS64_T unzlocal_SearchCentralDir OF((
     const zlib_filefunc_def* pzlib_filefunc_def,
-    voidpf filestream));
+    voidpf filestream,
+    unz_tail* ptail));
 
-local uLong unzlocal_SearchCentralDir(pzlib_filefunc_def,filestream)
+local ZPOS64_T unzlocal_SearchCentralDir(pzlib_filefunc_def,filestream,ptail)
     const zlib_filefunc_def* pzlib_filefunc_def;
     voidpf filestream;
+    unz_tail* ptail;
 {
-    unsigned char* buf;
-    uLong uSizeFile;
-    uLong uBackRead;
-    uLong uMaxBack=0xffff; /* maximum size of global comment */
-    uLong uPosFound=0;
+    const unsigned char* p;
+    ZPOS64_T uSizeFile;
+    ZPOS64_T pos_stream = UNZ_POS_UNKNOWN;
+    ZPOS64_T uPosFound=0;
+
+    ptail->data = NULL;
+    ptail->buf = NULL;
+    ptail->pos = 0;
+    ptail->size = 0;
 
     if (ZSEEK(*pzlib_filefunc_def,filestream,0,ZLIB_FILEFUNC_SEEK_END) != 0)
         return 0;
 
+    uSizeFile = (ZPOS64_T)ZTELL(*pzlib_filefunc_def,filestream);
+    if (uSizeFile<SIZEENDCENTRALDIR)
+        return 0;
+
+    ptail->size = (uSizeFile<SIZETAILREAD) ? (uLong)uSizeFile : SIZETAILREAD;
+    ptail->pos = uSizeFile-ptail->size;
 
-    uSizeFile = ZTELL(*pzlib_filefunc_def,filestream);
+    ptail->data = (const unsigned char*)ZMAP(*pzlib_filefunc_def,filestream,
+                                             ptail->pos,ptail->size);
+    if (ptail->data==NULL)
+    {
+        ptail->buf = (unsigned char*)ALLOC(ptail->size);
+        if (ptail->buf==NULL)
+            return 0;
+        if (unzlocal_ReadAt(pzlib_filefunc_def,filestream,&pos_stream,
+                            ptail->buf,ptail->size,ptail->pos)!=ptail->size)
+            return 0;
+        ptail->data = ptail->buf;
+    }
 
-    if (uMaxBack>uSizeFile)
-        uMaxBack = uSizeFile;
+    /* the last record which is coherent and whose comment ends the zipfile,
+       else (bytes after the zipfile) the last record which is coherent */
+    for (p = unzlocal_FindEndCentralDir(ptail->data,
+                                        ptail->size-SIZEENDCENTRALDIR+1);
+         p != NULL;
+         p = unzlocal_FindEndCentralDir(ptail->data,(uLong)(p-ptail->data)))
+    {
+        ZPOS64_T pos = ptail->pos+(ZPOS64_T)(p-ptail->data);
+        ZPOS64_T end_record = pos+SIZEENDCENTRALDIR+unzlocal_bufShort(p+20);
+        uLong size_central_dir = unzlocal_bufLong(p+12);
+        uLong offset_central_dir = unzlocal_bufLong(p+16);
+
+        if (end_record > uSizeFile)
+            continue;
+        if ((size_central_dir!=0xffffffff) && (offset_central_dir!=0xffffffff) &&
+            ((ZPOS64_T)offset_central_dir+size_central_dir > pos))
+            continue;
+        if (end_record == uSizeFile)
+            return pos;
+        if (uPosFound == 0)
+            uPosFound = pos;
+    }
+    return uPosFound;
+}
 
-    buf = (unsigned char*)ALLOC(BUFREADCOMMENT+4);
-    if (buf==NULL)
+/*
+  Locate the Zip64 end of central dir record of a zipfile, with the Zip64
+    end of central dir locator which is just before the end of central dir
+    record found at central_pos. The SIZEZIP64ENDCENTRALDIR bytes of the
+    record are read in record.
+  return 0 if the zipfile is not a Zip64 archive
+*/
+local ZPOS64_T unzlocal_SearchCentralDir64 OF((
+    const zlib_filefunc_def* pzlib_filefunc_def,
+    voidpf filestream,
+    const unz_tail* ptail,
+    ZPOS64_T central_pos,
+    unsigned char* record));
+
+local ZPOS64_T unzlocal_SearchCentralDir64(pzlib_filefunc_def,filestream,
+                                           ptail,central_pos,record)
+    const zlib_filefunc_def* pzlib_filefunc_def;
+    voidpf filestream;
+    const unz_tail* ptail;
+    ZPOS64_T central_pos;
+    unsigned char* record;
+{
+    unsigned char locator[SIZEZIP64LOCATOR];
+    ZPOS64_T candidates[2];
+    int i;
+
+    if (central_pos<SIZEZIP64LOCATOR+SIZEZIP64ENDCENTRALDIR)
         return 0;
 
-    uBackRead = 4;
-    while (uBackRead<uMaxBack)
+    if (unzlocal_ReadTail(pzlib_filefunc_def,filestream,ptail,locator,
+                          SIZEZIP64LOCATOR,central_pos-SIZEZIP64LOCATOR)!=
+                                                            SIZEZIP64LOCATOR)
+        return 0;
+
+    if (unzlocal_bufLong(locator)!=0x07064b50)
+        return 0;
+
+    /* number of the disk with the start of the zip64 end of central dir */
+    if (unzlocal_bufLong(locator+4)!=0)
+        return 0;
+
+    /* the record is where the locator says, or just before the locator
+       when there are bytes before the zipfile (sfx) */
+    candidates[0] = unzlocal_bufLong64(locator+8);
+    candidates[1] = central_pos-SIZEZIP64LOCATOR-SIZEZIP64ENDCENTRALDIR;
+
+    for (i=0;i<2;i++)
     {
-        uLong uReadSize,uReadPos ;
-        int i;
-        if (uBackRead+BUFREADCOMMENT>uMaxBack)
-            uBackRead = uMaxBack;
-        else
-            uBackRead+=BUFREADCOMMENT;
-        uReadPos = uSizeFile-uBackRead ;
+        if (candidates[i]+SIZEZIP64ENDCENTRALDIR > central_pos-SIZEZIP64LOCATOR)
+            continue;
+        if (unzlocal_ReadTail(pzlib_filefunc_def,filestream,ptail,record,
+                              SIZEZIP64ENDCENTRALDIR,candidates[i])!=
+                                                    SIZEZIP64ENDCENTRALDIR)
+            continue;
+        if (unzlocal_bufLong(record)==0x06064b50)
+            return candidates[i];
+    }
+    return 0;
+}
 
-        uReadSize = ((BUFREADCOMMENT+4) < (uSizeFile-uReadPos)) ?
-                     (BUFREADCOMMENT+4) : (uSizeFile-uReadPos);
-        if (ZSEEK(*pzlib_filefunc_def,filestream,uReadPos,ZLIB_FILEFUNC_SEEK_SET)!=0)
-            break;
+#ifndef UNZ_MININDEXSIZE
+#define UNZ_MININDEXSIZE (16)
+#endif
 
-        if (ZREAD(*pzlib_filefunc_def,filestream,buf,uReadSize)!=uReadSize)
-            break;
+/*
+  Hash a filename (FNV-1a). If folded!=0, the case is folded the same way than
+    strcmpcasenosensitive_internal, so names equal without case sensitivity
+    have the same hash
+*/
+local uLong unzlocal_HashFileName OF((const char* fileName, int folded));
 
-        for (i=(int)uReadSize-3; (i--)>0;)
-            if (((*(buf+i))==0x50) && ((*(buf+i+1))==0x4b) &&
-                ((*(buf+i+2))==0x05) && ((*(buf+i+3))==0x06))
-            {
-                uPosFound = uReadPos+i;
+local uLong unzlocal_HashFileName (fileName, folded)
+    const char* fileName;
+    int folded;
+{
+    uLong h = 2166136261UL;
+    for (;;)
+    {
+        char c=*(fileName++);
+        if (c=='\0')
+            return h;
+        if ((folded) && (c>='a') && (c<='z'))
+            c -= 0x20;
+        h = ((h ^ (uLong)(unsigned char)c) * 16777619UL) & 0xffffffffUL;
+    }
+}
+
+local void unzlocal_FreeIndex OF((unz_index* pindex));
+
+local void unzlocal_FreeIndex (pindex)
+    unz_index* pindex;
+{
+    if (pindex==NULL)
+        return;
+    TRYFREE(pindex->names);
+    TRYFREE(pindex->entries);
+    TRYFREE(pindex->table);
+    TRYFREE(pindex->table_folded);
+    TRYFREE(pindex);
+}
+
+/*
+  Add the entry number num_entry in a table of the index.
+  When several files have the same name, the first one in the central dir
+    is kept, like the linear search of unzLocateFile does
+*/
+local void unzlocal_IndexInsert OF((unz_index* pindex,
+                                    uLong* table,
+                                    uLong num_entry,
+                                    int iCaseSensitivity));
+
+local void unzlocal_IndexInsert (pindex, table, num_entry, iCaseSensitivity)
+    unz_index* pindex;
+    uLong* table;
+    uLong num_entry;
+    int iCaseSensitivity;
+{
+    const char* name = pindex->names + pindex->entries[num_entry].name_offset;
+    uLong mask = pindex->size_table - 1;
+    uLong i;
+
+    /* any value but 1 is not case sensitive for unzStringFileNameCompare */
+    iCaseSensitivity = (iCaseSensitivity==1) ? 1 : 2;
+    i = unzlocal_HashFileName(name,iCaseSensitivity==2) & mask;
+
+    while (table[i]!=0)
+    {
+        if (unzStringFileNameCompare(pindex->names +
+                                        pindex->entries[table[i]-1].name_offset,
+                                     name,iCaseSensitivity)==0)
+            return;
+        i = (i+1) & mask;
+    }
+    table[i] = num_entry+1;
+}
+
+/*
+  Find the entry of szFileName in the index.
+  iCaseSensitivity must be 1 or 2 (see unzStringFileNameCompare)
+  return NULL if there is no such file
+*/
+local const unz_index_entry* unzlocal_IndexLookup OF((const unz_index* pindex,
+                                                       const char* szFileName,
+                                                       int iCaseSensitivity));
+
+local const unz_index_entry* unzlocal_IndexLookup (pindex, szFileName,
+                                                    iCaseSensitivity)
+    const unz_index* pindex;
+    const char* szFileName;
+    int iCaseSensitivity;
+{
+    const uLong* table = (iCaseSensitivity==2) ? pindex->table_folded :
+                                                 pindex->table;
+    uLong mask = pindex->size_table - 1;
+    uLong i = unzlocal_HashFileName(szFileName,iCaseSensitivity==2) & mask;
+
+    while (table[i]!=0)
+    {
+        const unz_index_entry* pentry = &pindex->entries[table[i]-1];
+        if (unzStringFileNameCompare(pindex->names + pentry->name_offset,
+                                     szFileName,iCaseSensitivity)==0)
+            return pentry;
+        i = (i+1) & mask;
+    }
+    return NULL;
+}
+
+/*
+  Walk the central dir one time to build the index used by unzLocateFile.
+  return NULL if the index cannot be built (unzLocateFile will then do
+    a linear search)
+*/
+local unz_index* unzlocal_BuildIndex OF((unzFile file));
+
+local unz_index* unzlocal_BuildIndex (file)
+    unzFile file;
+{
+    unz_s* s=(unz_s*)file;
+    unz_index* pindex;
+    uLong size_entries;
+    uLong size_arena;
+    uLong i;
+    int err;
+
+    pindex = (unz_index*)ALLOC(sizeof(unz_index));
+    if (pindex==NULL)
+        return NULL;
+
+    /* a central dir item is at least SIZECENTRALDIRITEM bytes long, so the
+       count of entries announced by the archive cannot exceed this */
+    if (s->gi.number_entry > s->size_central_dir/SIZECENTRALDIRITEM)
+        size_entries = (uLong)(s->size_central_dir/SIZECENTRALDIRITEM);
+    else
+        size_entries = (uLong)s->gi.number_entry;
+    if (size_entries<UNZ_MININDEXSIZE)
+        size_entries = UNZ_MININDEXSIZE;
+    size_arena = size_entries * 32;
+
+    pindex->names = (char*)ALLOC(size_arena);
+    pindex->size_names = 0;
+    pindex->entries = (unz_index_entry*)ALLOC(size_entries*sizeof(unz_index_entry));
+    pindex->number_entry = 0;
+    pindex->table = NULL;
+    pindex->table_folded = NULL;
+    pindex->size_table = 0;
+    if ((pindex->names==NULL) || (pindex->entries==NULL))
+    {
+        unzlocal_FreeIndex(pindex);
+        return NULL;
+    }
+
+    err = unzGoToFirstFile(file);
+    while (err==UNZ_OK)
+    {
+        uLong size_filename = s->cur_file_info.size_filename;
+        unz_index_entry* pentry;
+
+        if (pindex->number_entry==size_entries)
+        {
+            unz_index_entry* entries = (unz_index_entry*)
+                REALLOC(pindex->entries,2*size_entries*sizeof(unz_index_entry));
+            if (entries==NULL)
                 break;
-            }
+            pindex->entries = entries;
+            size_entries *= 2;
+        }
+
+        if (pindex->size_names+size_filename+1 > size_arena)
+        {
+            uLong new_size_arena = 2*size_arena;
+            char* names;
+            if (new_size_arena < pindex->size_names+size_filename+1)
+                new_size_arena = pindex->size_names+size_filename+1;
+            names = (char*)REALLOC(pindex->names,new_size_arena);
+            if (names==NULL)
+                break;
+            pindex->names = names;
+            size_arena = new_size_arena;
+        }
 
-        if (uPosFound!=0)
+        err = unzGetCurrentFileInfo(file,NULL,
+                                    pindex->names+pindex->size_names,
+                                    size_filename+1,NULL,0,NULL,0);
+        if (err!=UNZ_OK)
             break;
+
+        pentry = &pindex->entries[pindex->number_entry++];
+        pentry->pos_in_central_dir = s->pos_in_central_dir;
+        pentry->num_file = s->num_file;
+        pentry->name_offset = pindex->size_names;
+        pindex->size_names += size_filename+1;
+
+        err = unzGoToNextFile(file);
     }
-    TRYFREE(buf);
-    return uPosFound;
+
+    if (err!=UNZ_END_OF_LIST_OF_FILE)
+    {
+        unzlocal_FreeIndex(pindex);
+        return NULL;
+    }
+
+    /* keep the load factor of the tables under 1/2 */
+    pindex->size_table = UNZ_MININDEXSIZE;
+    while (pindex->size_table < 2*pindex->number_entry)
+        pindex->size_table *= 2;
+
+    pindex->table = (uLong*)ALLOC(pindex->size_table*sizeof(uLong));
+    pindex->table_folded = (uLong*)ALLOC(pindex->size_table*sizeof(uLong));
+    if ((pindex->table==NULL) || (pindex->table_folded==NULL))
+    {
+        unzlocal_FreeIndex(pindex);
+        return NULL;
+    }
+    memset(pindex->table,0,pindex->size_table*sizeof(uLong));
+    memset(pindex->table_folded,0,pindex->size_table*sizeof(uLong));
+
+    for (i=0;i<pindex->number_entry;i++)
+    {
+        unzlocal_IndexInsert(pindex,pindex->table,i,1);
+        unzlocal_IndexInsert(pindex,pindex->table_folded,i,2);
+    }
+
+    return pindex;
 }
 
 /*
@@ -401,13 +853,17 @@ extern unzFile ZEXPORT unzOpen2 (path, pzlib_filefunc_def)
 {
     unz_s us;
     unz_s *s;
-    uLong central_pos,uL;
+    ZPOS64_T central_pos;
+    ZPOS64_T end_central_pos;   /* position of the Zip64 end of central dir
+                                   record if any, else same than central_pos */
+    unsigned char buf_end_central_dir[SIZEZIP64ENDCENTRALDIR];
+    unz_tail tail;
 
     uLong number_disk;          /* number of the current dist, used for
                                    spaning ZIP, unsupported, always 0*/
     uLong number_disk_with_CD;  /* number the the disk with central dir, used
                                    for spaning ZIP, unsupported, always 0*/
-    uLong number_entry_CD;      /* total number of entries in
+    ZPOS64_T number_entry_CD;   /* total number of entries in
                                    the central dir
                                    (same than number_entry on nospan) */
 
@@ -428,71 +884,150 @@ extern unzFile ZEXPORT unzOpen2 (path, pzlib_filefunc_def)
     if (us.filestream==NULL)
         return NULL;
 
-    central_pos = unzlocal_SearchCentralDir(&us.z_filefunc,us.filestream);
-    if (central_pos==0)
+    central_pos = unzlocal_SearchCentralDir(&us.z_filefunc,us.filestream,&tail);
+    if ((central_pos==0) ||
+        (unzlocal_ReadTail(&us.z_filefunc,us.filestream,&tail,
+                           buf_end_central_dir,SIZEENDCENTRALDIR,central_pos)!=
+                                                            SIZEENDCENTRALDIR))
         err=UNZ_ERRNO;
 
-    if (ZSEEK(us.z_filefunc, us.filestream,
-                                      central_pos,ZLIB_FILEFUNC_SEEK_SET)!=0)
-        err=UNZ_ERRNO;
+    if (err==UNZ_OK)
+    {
+        /* the signature, already checked */
 
-    /* the signature, already checked */
-    if (unzlocal_getLong(&us.z_filefunc, us.filestream,&uL)!=UNZ_OK)
-        err=UNZ_ERRNO;
+        /* number of this disk */
+        number_disk = unzlocal_bufShort(buf_end_central_dir+4);
 
-    /* number of this disk */
-    if (unzlocal_getShort(&us.z_filefunc, us.filestream,&number_disk)!=UNZ_OK)
-        err=UNZ_ERRNO;
+        /* number of the disk with the start of the central directory */
+        number_disk_with_CD = unzlocal_bufShort(buf_end_central_dir+6);
 
-    /* number of the disk with the start of the central directory */
-    if (unzlocal_getShort(&us.z_filefunc, us.filestream,&number_disk_with_CD)!=UNZ_OK)
-        err=UNZ_ERRNO;
+        /* total number of entries in the central dir on this disk */
+        us.gi.number_entry = unzlocal_bufShort(buf_end_central_dir+8);
 
-    /* total number of entries in the central dir on this disk */
-    if (unzlocal_getShort(&us.z_filefunc, us.filestream,&us.gi.number_entry)!=UNZ_OK)
-        err=UNZ_ERRNO;
+        /* total number of entries in the central dir */
+        number_entry_CD = unzlocal_bufShort(buf_end_central_dir+10);
 
-    /* total number of entries in the central dir */
-    if (unzlocal_getShort(&us.z_filefunc, us.filestream,&number_entry_CD)!=UNZ_OK)
-        err=UNZ_ERRNO;
+        if ((number_entry_CD!=us.gi.number_entry) ||
+            (number_disk_with_CD!=0) ||
+            (number_disk!=0))
+            err=UNZ_BADZIPFILE;
 
-    if ((number_entry_CD!=us.gi.number_entry) ||
-        (number_disk_with_CD!=0) ||
-        (number_disk!=0))
-        err=UNZ_BADZIPFILE;
+        /* size of the central directory */
+        us.size_central_dir = unzlocal_bufLong(buf_end_central_dir+12);
 
-    /* size of the central directory */
-    if (unzlocal_getLong(&us.z_filefunc, us.filestream,&us.size_central_dir)!=UNZ_OK)
-        err=UNZ_ERRNO;
+        /* offset of start of central directory with respect to the
+              starting disk number */
+        us.offset_central_dir = unzlocal_bufLong(buf_end_central_dir+16);
 
-    /* offset of start of central directory with respect to the
-          starting disk number */
-    if (unzlocal_getLong(&us.z_filefunc, us.filestream,&us.offset_central_dir)!=UNZ_OK)
-        err=UNZ_ERRNO;
+        /* zipfile comment length */
+        us.gi.size_comment = unzlocal_bufShort(buf_end_central_dir+20);
+    }
 
-    /* zipfile comment length */
-    if (unzlocal_getShort(&us.z_filefunc, us.filestream,&us.gi.size_comment)!=UNZ_OK)
-        err=UNZ_ERRNO;
+    /* a Zip64 end of central dir record replaces the values of the end of
+       central dir record (which may be truncated to 0xffff or 0xffffffff) */
+    us.zip64 = 0;
+    end_central_pos = central_pos;
+    if (err==UNZ_OK)
+        end_central_pos = unzlocal_SearchCentralDir64(&us.z_filefunc,
+                                                      us.filestream,&tail,
+                                                      central_pos,
+                                                      buf_end_central_dir);
+    if (end_central_pos==0)
+        end_central_pos = central_pos;
+    else
+    {
+        us.zip64 = 1;
+
+        /* the record, already read in buf_end_central_dir */
+        if (err==UNZ_OK)
+        {
+            /* the signature, already checked,
+               size of the record (8), version made by (2), version needed (2) */
+
+            /* number of this disk */
+            number_disk = unzlocal_bufLong(buf_end_central_dir+16);
+
+            /* number of the disk with the start of the central directory */
+            number_disk_with_CD = unzlocal_bufLong(buf_end_central_dir+20);
+
+            /* total number of entries in the central dir on this disk */
+            us.gi.number_entry = unzlocal_bufLong64(buf_end_central_dir+24);
+
+            /* total number of entries in the central dir */
+            number_entry_CD = unzlocal_bufLong64(buf_end_central_dir+32);
+
+            if ((number_entry_CD!=us.gi.number_entry) ||
+                (number_disk_with_CD!=0) ||
+                (number_disk!=0))
+                err=UNZ_BADZIPFILE;
 
-    if ((central_pos<us.offset_central_dir+us.size_central_dir) &&
+            /* size of the central directory */
+            us.size_central_dir = unzlocal_bufLong64(buf_end_central_dir+40);
+
+            /* offset of start of central directory with respect to the
+                  starting disk number */
+            us.offset_central_dir = unzlocal_bufLong64(buf_end_central_dir+48);
+        }
+    }
+
+    if ((end_central_pos<us.offset_central_dir+us.size_central_dir) &&
         (err==UNZ_OK))
         err=UNZ_BADZIPFILE;
 
     if (err!=UNZ_OK)
     {
+        TRYFREE(tail.buf);
         ZCLOSE(us.z_filefunc, us.filestream);
         return NULL;
     }
 
-    us.byte_before_the_zipfile = central_pos -
+    us.byte_before_the_zipfile = end_central_pos -
                             (us.offset_central_dir+us.size_central_dir);
     us.central_pos = central_pos;
-    us.pfile_in_zip_read = NULL;
-    us.encrypted = 0;
-
 
-    s=(unz_s*)ALLOC(sizeof(unz_s));
-    *s=us;
+    /* read the whole central dir with a single read (or copy it from the
+       tail, where it is for a small zipfile) : the headers of the files are
+       then decoded from memory */
+    us.central_dir = NULL;
+    if ((us.size_central_dir>0) &&
+        (us.size_central_dir==(ZPOS64_T)(uLong)us.size_central_dir))
+        us.central_dir = (unsigned char*)ALLOC((uLong)us.size_central_dir);
+    if (us.central_dir!=NULL)
+    {
+        if (unzlocal_ReadTail(&us.z_filefunc,us.filestream,&tail,
+                              us.central_dir,(uLong)us.size_central_dir,
+                              us.offset_central_dir+us.byte_before_the_zipfile)
+                                                        !=us.size_central_dir)
+        {
+            TRYFREE(us.central_dir);
+            us.central_dir = NULL;
+        }
+    }
+    TRYFREE(tail.buf);
+    us.pfile_in_zip_read = NULL;
+    us.index = NULL;
+    us.pos_stream = UNZ_POS_UNKNOWN;
+    us.size_read_buffer = UNZ_BUFSIZE;
+    us.max_read_buffer = UNZ_MAXBUFSIZE;
+    us.zalloc = (alloc_func)0;
+    us.zfree = (free_func)0;
+    us.opaque = (voidpf)0;
+    us.pfile_in_zip_read_free = NULL;
+    us.crc_policy = UNZ_CRC_VERIFY;
+#ifdef UNZ_CRCTHREAD
+    us.crc_queue = NULL;
+#endif
+
+
+    s=(unz_s*)ALLOC(sizeof(unz_s));
+    if (s==NULL)
+    {
+        TRYFREE(us.central_dir);
+        ZCLOSE(us.z_filefunc, us.filestream);
+        return NULL;
+    }
+    *s=us;
+    s->index = unzlocal_BuildIndex((unzFile)s);
     unzGoToFirstFile((unzFile)s);
     return (unzFile)s;
 }
@@ -504,25 +1039,35 @@ extern unzFile ZEXPORT unzOpen (path)
     return unzOpen2(path, NULL);
 }
 
+local void unzlocal_FreeFile OF((file_in_zip_read_info_s*
+                                 pfile_in_zip_read_info));
+local int unzlocal_WaitCrc OF((unz_s* s, int stop));
+
 /*
   Close a ZipFile opened with unzipOpen.
   If there is files inside the .Zip opened with unzipOpenCurrentFile (see later),
     these files MUST be closed with unzipCloseCurrentFile before call unzipClose.
-  return UNZ_OK if there is no problem. */
+  return UNZ_OK if there is no problem, or the first error of the deferred
+    checks of crc32 (see unzSetCrcPolicy). */
 extern int ZEXPORT unzClose (file)
     unzFile file;
 {
     unz_s* s;
+    int err;
     if (file==NULL)
         return UNZ_PARAMERROR;
     s=(unz_s*)file;
 
     if (s->pfile_in_zip_read!=NULL)
         unzCloseCurrentFile(file);
+    err = unzlocal_WaitCrc(s,1);
+    unzlocal_FreeFile(s->pfile_in_zip_read_free);
 
+    unzlocal_FreeIndex(s->index);
+    TRYFREE(s->central_dir);
     ZCLOSE(s->z_filefunc, s->filestream);
     TRYFREE(s);
-    return UNZ_OK;
+    return err;
 }
 
 
@@ -530,6 +1075,18 @@ extern int ZEXPORT unzClose (file)
   Write info about the ZipFile in the *pglobal_info structure.
   No preparation of the structure is needed
   return UNZ_OK if there is no problem. */
+extern int ZEXPORT unzGetGlobalInfo64 (file,pglobal_info)
+    unzFile file;
+    unz_global_info64 *pglobal_info;
+{
+    unz_s* s;
+    if (file==NULL)
+        return UNZ_PARAMERROR;
+    s=(unz_s*)file;
+    *pglobal_info=s->gi;
+    return UNZ_OK;
+}
+
 extern int ZEXPORT unzGetGlobalInfo (file,pglobal_info)
     unzFile file;
     unz_global_info *pglobal_info;
@@ -538,7 +1095,8 @@ extern int ZEXPORT unzGetGlobalInfo (file,pglobal_info)
     if (file==NULL)
         return UNZ_PARAMERROR;
     s=(unz_s*)file;
-    *pglobal_info=s->gi;
+    pglobal_info->number_entry = (uLong)s->gi.number_entry;
+    pglobal_info->size_comment = s->gi.size_comment;
     return UNZ_OK;
 }
 
@@ -562,27 +1120,99 @@ local void unzlocal_DosDateToTmuDate (ulDosDate, ptm)
 }
 
 /*
-  Get Info about the current file in the zipfile, with internal only info
+  Replace the values of the central dir item which are set to 0xffffffff
+  (or 0xffff for the disk number) by the ones of the Zip64 extra field
+  (header 0x0001) found in extra, in the order they are stored there
 */
-local int unzlocal_GetCurrentFileInfoInternal OF((unzFile file,
-                                                  unz_file_info *pfile_info,
-                                                  unz_file_info_internal
-                                                  *pfile_info_internal,
-                                                  char *szFileName,
-                                                  uLong fileNameBufferSize,
-                                                  void *extraField,
-                                                  uLong extraFieldBufferSize,
-                                                  char *szComment,
-                                                  uLong commentBufferSize));
+local int unzlocal_DecodeZip64Extra OF((const unsigned char* extra,
+                                        uLong size_extra,
+                                        unz_file_info64* pfile_info,
+                                        ZPOS64_T* poffset_curfile));
+
+local int unzlocal_DecodeZip64Extra (extra, size_extra, pfile_info,
+                                     poffset_curfile)
+    const unsigned char* extra;
+    uLong size_extra;
+    unz_file_info64* pfile_info;
+    ZPOS64_T* poffset_curfile;
+{
+    uLong pos=0;
 
-local int unzlocal_GetCurrentFileInfoInternal (file,
-                                              pfile_info,
-                                              pfile_info_internal,
-                                              szFileName, fileNameBufferSize,
-                                              extraField, extraFieldBufferSize,
-                                              szComment,  commentBufferSize)
+    while (pos+4<=size_extra)
+    {
+        uLong header_id = unzlocal_bufShort(extra+pos);
+        uLong data_size = unzlocal_bufShort(extra+pos+2);
+        const unsigned char* pdata = extra+pos+4;
+
+        pos += 4;
+        if (pos+data_size>size_extra)
+            break;
+
+        if (header_id==0x0001)
+        {
+            if (pfile_info->uncompressed_size==0xffffffff)
+            {
+                if (data_size<8)
+                    return UNZ_BADZIPFILE;
+                pfile_info->uncompressed_size = unzlocal_bufLong64(pdata);
+                pdata+=8; data_size-=8;
+            }
+            if (pfile_info->compressed_size==0xffffffff)
+            {
+                if (data_size<8)
+                    return UNZ_BADZIPFILE;
+                pfile_info->compressed_size = unzlocal_bufLong64(pdata);
+                pdata+=8; data_size-=8;
+            }
+            if (*poffset_curfile==0xffffffff)
+            {
+                if (data_size<8)
+                    return UNZ_BADZIPFILE;
+                *poffset_curfile = unzlocal_bufLong64(pdata);
+                pdata+=8; data_size-=8;
+            }
+            if (pfile_info->disk_num_start==0xffff)
+            {
+                if (data_size<4)
+                    return UNZ_BADZIPFILE;
+                pfile_info->disk_num_start = unzlocal_bufLong(pdata);
+            }
+            return UNZ_OK;
+        }
+        pos += data_size;
+    }
+
+    /* no Zip64 extra field, the values are kept as they are */
+    return UNZ_OK;
+}
+
+/*
+  Get Info about the file of the zipfile at pos_in_central_dir, with internal
+    only info. The zipfile is only read with unzlocal_ReadAt, so this does not
+    depend on the position of the stream.
+*/
+local int unzlocal_GetFileInfoInternal OF((unzFile file,
+                                           ZPOS64_T pos_in_central_dir,
+                                           unz_file_info64 *pfile_info,
+                                           unz_file_info_internal
+                                           *pfile_info_internal,
+                                           char *szFileName,
+                                           uLong fileNameBufferSize,
+                                           void *extraField,
+                                           uLong extraFieldBufferSize,
+                                           char *szComment,
+                                           uLong commentBufferSize));
+
+local int unzlocal_GetFileInfoInternal (file,
+                                        pos_in_central_dir,
+                                        pfile_info,
+                                        pfile_info_internal,
+                                        szFileName, fileNameBufferSize,
+                                        extraField, extraFieldBufferSize,
+                                        szComment,  commentBufferSize)
     unzFile file;
-    unz_file_info *pfile_info;
+    ZPOS64_T pos_in_central_dir;
+    unz_file_info64 *pfile_info;
     unz_file_info_internal *pfile_info_internal;
     char *szFileName;
     uLong fileNameBufferSize;
@@ -592,78 +1222,70 @@ local int unzlocal_GetCurrentFileInfoInternal (file,
     uLong commentBufferSize;
 {
     unz_s* s;
-    unz_file_info file_info;
+    unz_file_info64 file_info;
     unz_file_info_internal file_info_internal;
     int err=UNZ_OK;
-    uLong uMagic;
-    long lSeek=0;
+    unsigned char header[SIZECENTRALDIRITEM];
+    const unsigned char* pheader;
+    const unsigned char* pvariable=NULL; /* filename, extra field and comment
+                                            when the central dir is in memory */
+    ZPOS64_T pos_variable;      /* position of the filename in the zipfile */
 
     if (file==NULL)
         return UNZ_PARAMERROR;
     s=(unz_s*)file;
-    if (ZSEEK(s->z_filefunc, s->filestream,
-              s->pos_in_central_dir+s->byte_before_the_zipfile,
-              ZLIB_FILEFUNC_SEEK_SET)!=0)
-        err=UNZ_ERRNO;
-
 
-    /* we check the magic */
-    if (err==UNZ_OK)
+    pos_variable = pos_in_central_dir+s->byte_before_the_zipfile+
+                                                        SIZECENTRALDIRITEM;
+    if ((s->central_dir!=NULL) &&
+        (pos_in_central_dir>=s->offset_central_dir) &&
+        (pos_in_central_dir-s->offset_central_dir+SIZECENTRALDIRITEM <=
+                                                        s->size_central_dir))
+    {
+        pheader = s->central_dir + (pos_in_central_dir-s->offset_central_dir);
+        pvariable = pheader + SIZECENTRALDIRITEM;
+    }
+    else
     {
-        if (unzlocal_getLong(&s->z_filefunc, s->filestream,&uMagic) != UNZ_OK)
+        pheader = header;
+        if (unzlocal_ReadAt(&s->z_filefunc,s->filestream,&s->pos_stream,header,SIZECENTRALDIRITEM,
+                   pos_in_central_dir+s->byte_before_the_zipfile)
+                                                    !=SIZECENTRALDIRITEM)
             err=UNZ_ERRNO;
-        else if (uMagic!=0x02014b50)
-            err=UNZ_BADZIPFILE;
     }
 
-    if (unzlocal_getShort(&s->z_filefunc, s->filestream,&file_info.version) != UNZ_OK)
-        err=UNZ_ERRNO;
-
-    if (unzlocal_getShort(&s->z_filefunc, s->filestream,&file_info.version_needed) != UNZ_OK)
-        err=UNZ_ERRNO;
-
-    if (unzlocal_getShort(&s->z_filefunc, s->filestream,&file_info.flag) != UNZ_OK)
-        err=UNZ_ERRNO;
+    /* we check the magic */
+    if ((err==UNZ_OK) && (unzlocal_bufLong(pheader)!=0x02014b50))
+        err=UNZ_BADZIPFILE;
 
-    if (unzlocal_getShort(&s->z_filefunc, s->filestream,&file_info.compression_method) != UNZ_OK)
-        err=UNZ_ERRNO;
+    if (err!=UNZ_OK)
+        return err;
 
-    if (unzlocal_getLong(&s->z_filefunc, s->filestream,&file_info.dosDate) != UNZ_OK)
-        err=UNZ_ERRNO;
+    file_info.version = unzlocal_bufShort(pheader+4);
+    file_info.version_needed = unzlocal_bufShort(pheader+6);
+    file_info.flag = unzlocal_bufShort(pheader+8);
+    file_info.compression_method = unzlocal_bufShort(pheader+10);
+    file_info.dosDate = unzlocal_bufLong(pheader+12);
 
     unzlocal_DosDateToTmuDate(file_info.dosDate,&file_info.tmu_date);
 
-    if (unzlocal_getLong(&s->z_filefunc, s->filestream,&file_info.crc) != UNZ_OK)
-        err=UNZ_ERRNO;
-
-    if (unzlocal_getLong(&s->z_filefunc, s->filestream,&file_info.compressed_size) != UNZ_OK)
-        err=UNZ_ERRNO;
-
-    if (unzlocal_getLong(&s->z_filefunc, s->filestream,&file_info.uncompressed_size) != UNZ_OK)
-        err=UNZ_ERRNO;
-
-    if (unzlocal_getShort(&s->z_filefunc, s->filestream,&file_info.size_filename) != UNZ_OK)
-        err=UNZ_ERRNO;
-
-    if (unzlocal_getShort(&s->z_filefunc, s->filestream,&file_info.size_file_extra) != UNZ_OK)
-        err=UNZ_ERRNO;
-
-    if (unzlocal_getShort(&s->z_filefunc, s->filestream,&file_info.size_file_comment) != UNZ_OK)
-        err=UNZ_ERRNO;
-
-    if (unzlocal_getShort(&s->z_filefunc, s->filestream,&file_info.disk_num_start) != UNZ_OK)
-        err=UNZ_ERRNO;
-
-    if (unzlocal_getShort(&s->z_filefunc, s->filestream,&file_info.internal_fa) != UNZ_OK)
-        err=UNZ_ERRNO;
-
-    if (unzlocal_getLong(&s->z_filefunc, s->filestream,&file_info.external_fa) != UNZ_OK)
-        err=UNZ_ERRNO;
-
-    if (unzlocal_getLong(&s->z_filefunc, s->filestream,&file_info_internal.offset_curfile) != UNZ_OK)
-        err=UNZ_ERRNO;
+    file_info.crc = unzlocal_bufLong(pheader+16);
+    file_info.compressed_size = unzlocal_bufLong(pheader+20);
+    file_info.uncompressed_size = unzlocal_bufLong(pheader+24);
+    file_info.size_filename = unzlocal_bufShort(pheader+28);
+    file_info.size_file_extra = unzlocal_bufShort(pheader+30);
+    file_info.size_file_comment = unzlocal_bufShort(pheader+32);
+    file_info.disk_num_start = unzlocal_bufShort(pheader+34);
+    file_info.internal_fa = unzlocal_bufShort(pheader+36);
+    file_info.external_fa = unzlocal_bufLong(pheader+38);
+    file_info_internal.offset_curfile = unzlocal_bufLong(pheader+42);
+
+    if ((pvariable!=NULL) &&
+        (pvariable-s->central_dir+file_info.size_filename+
+         file_info.size_file_extra+file_info.size_file_comment >
+                                                        s->size_central_dir))
+        return UNZ_BADZIPFILE;
 
-    lSeek+=file_info.size_filename;
     if ((err==UNZ_OK) && (szFileName!=NULL))
     {
         uLong uSizeRead ;
@@ -676,9 +1298,13 @@ local int unzlocal_GetCurrentFileInfoInternal (file,
             uSizeRead = fileNameBufferSize;
 
         if ((file_info.size_filename>0) && (fileNameBufferSize>0))
-            if (ZREAD(s->z_filefunc, s->filestream,szFileName,uSizeRead)!=uSizeRead)
+        {
+            if (pvariable!=NULL)
+                memcpy(szFileName,pvariable,uSizeRead);
+            else if (unzlocal_ReadAt(&s->z_filefunc,s->filestream,&s->pos_stream,szFileName,uSizeRead,
+                            pos_variable)!=uSizeRead)
                 err=UNZ_ERRNO;
-        lSeek -= uSizeRead;
+        }
     }
 
 
@@ -690,20 +1316,15 @@ local int unzlocal_GetCurrentFileInfoInternal (file,
         else
             uSizeRead = extraFieldBufferSize;
 
-        if (lSeek!=0)
+        if ((file_info.size_file_extra>0) && (extraFieldBufferSize>0))
         {
-            if (ZSEEK(s->z_filefunc, s->filestream,lSeek,ZLIB_FILEFUNC_SEEK_CUR)==0)
-                lSeek=0;
-            else
+            if (pvariable!=NULL)
+                memcpy(extraField,pvariable+file_info.size_filename,uSizeRead);
+            else if (unzlocal_ReadAt(&s->z_filefunc,s->filestream,&s->pos_stream,extraField,uSizeRead,
+                            pos_variable+file_info.size_filename)!=uSizeRead)
                 err=UNZ_ERRNO;
         }
-        if ((file_info.size_file_extra>0) && (extraFieldBufferSize>0))
-            if (ZREAD(s->z_filefunc, s->filestream,extraField,uSizeRead)!=uSizeRead)
-                err=UNZ_ERRNO;
-        lSeek += file_info.size_file_extra - uSizeRead;
     }
-    else
-        lSeek+=file_info.size_file_extra;
 
 
     if ((err==UNZ_OK) && (szComment!=NULL))
@@ -717,20 +1338,53 @@ local int unzlocal_GetCurrentFileInfoInternal (file,
         else
             uSizeRead = commentBufferSize;
 
-        if (lSeek!=0)
+        if ((file_info.size_file_comment>0) && (commentBufferSize>0))
         {
-            if (ZSEEK(s->z_filefunc, s->filestream,lSeek,ZLIB_FILEFUNC_SEEK_CUR)==0)
-                lSeek=0;
-            else
+            if (pvariable!=NULL)
+                memcpy(szComment,pvariable+file_info.size_filename+
+                                    file_info.size_file_extra,uSizeRead);
+            else if (unzlocal_ReadAt(&s->z_filefunc,s->filestream,&s->pos_stream,szComment,uSizeRead,
+                            pos_variable+file_info.size_filename+
+                            file_info.size_file_extra)!=uSizeRead)
                 err=UNZ_ERRNO;
         }
-        if ((file_info.size_file_comment>0) && (commentBufferSize>0))
-            if (ZREAD(s->z_filefunc, s->filestream,szComment,uSizeRead)!=uSizeRead)
-                err=UNZ_ERRNO;
-        lSeek+=file_info.size_file_comment - uSizeRead;
     }
-    else
-        lSeek+=file_info.size_file_comment;
+
+    /* the sizes and offset which do not fit in 32 bits are in the Zip64
+       extra field */
+    if ((err==UNZ_OK) && (file_info.size_file_extra>0) &&
+        ((file_info.uncompressed_size==0xffffffff) ||
+         (file_info.compressed_size==0xffffffff) ||
+         (file_info_internal.offset_curfile==0xffffffff) ||
+         (file_info.disk_num_start==0xffff)))
+    {
+        if (pvariable!=NULL)
+            err = unzlocal_DecodeZip64Extra(pvariable+file_info.size_filename,
+                                            file_info.size_file_extra,
+                                            &file_info,
+                                            &file_info_internal.offset_curfile);
+        else
+        {
+            unsigned char* extra;
+            extra = (unsigned char*)ALLOC(file_info.size_file_extra);
+            if (extra==NULL)
+                err=UNZ_INTERNALERROR;
+            else
+            {
+                if (unzlocal_ReadAt(&s->z_filefunc,s->filestream,&s->pos_stream,extra,
+                           file_info.size_file_extra,
+                           pos_variable+file_info.size_filename)
+                                                    !=file_info.size_file_extra)
+                    err=UNZ_ERRNO;
+                else
+                    err = unzlocal_DecodeZip64Extra(extra,
+                                            file_info.size_file_extra,
+                                            &file_info,
+                                            &file_info_internal.offset_curfile);
+                TRYFREE(extra);
+            }
+        }
+    }
 
     if ((err==UNZ_OK) && (pfile_info!=NULL))
         *pfile_info=file_info;
@@ -741,6 +1395,45 @@ local int unzlocal_GetCurrentFileInfoInternal (file,
     return err;
 }
 
+/*
+  Get Info about the current file in the zipfile, with internal only info
+*/
+local int unzlocal_GetCurrentFileInfoInternal OF((unzFile file,
+                                                  unz_file_info64 *pfile_info,
+                                                  unz_file_info_internal
+                                                  *pfile_info_internal,
+                                                  char *szFileName,
+                                                  uLong fileNameBufferSize,
+                                                  void *extraField,
+                                                  uLong extraFieldBufferSize,
+                                                  char *szComment,
+                                                  uLong commentBufferSize));
+
+local int unzlocal_GetCurrentFileInfoInternal (file,
+                                              pfile_info,
+                                              pfile_info_internal,
+                                              szFileName, fileNameBufferSize,
+                                              extraField, extraFieldBufferSize,
+                                              szComment,  commentBufferSize)
+    unzFile file;
+    unz_file_info64 *pfile_info;
+    unz_file_info_internal *pfile_info_internal;
+    char *szFileName;
+    uLong fileNameBufferSize;
+    void *extraField;
+    uLong extraFieldBufferSize;
+    char *szComment;
+    uLong commentBufferSize;
+{
+    if (file==NULL)
+        return UNZ_PARAMERROR;
+    return unzlocal_GetFileInfoInternal(file,((unz_s*)file)->pos_in_central_dir,
+                                        pfile_info,pfile_info_internal,
+                                        szFileName,fileNameBufferSize,
+                                        extraField,extraFieldBufferSize,
+                                        szComment,commentBufferSize);
+}
+
 
 
 /*
@@ -748,6 +1441,26 @@ local int unzlocal_GetCurrentFileInfoInternal (file,
   No preparation of the structure is needed
   return UNZ_OK if there is no problem.
 */
+extern int ZEXPORT unzGetCurrentFileInfo64 (file,
+                                            pfile_info,
+                                            szFileName, fileNameBufferSize,
+                                            extraField, extraFieldBufferSize,
+                                            szComment,  commentBufferSize)
+    unzFile file;
+    unz_file_info64 *pfile_info;
+    char *szFileName;
+    uLong fileNameBufferSize;
+    void *extraField;
+    uLong extraFieldBufferSize;
+    char *szComment;
+    uLong commentBufferSize;
+{
+    return unzlocal_GetCurrentFileInfoInternal(file,pfile_info,NULL,
+                                                szFileName,fileNameBufferSize,
+                                                extraField,extraFieldBufferSize,
+                                                szComment,commentBufferSize);
+}
+
 extern int ZEXPORT unzGetCurrentFileInfo (file,
                                           pfile_info,
                                           szFileName, fileNameBufferSize,
@@ -762,10 +1475,32 @@ extern int ZEXPORT unzGetCurrentFileInfo (file,
     char *szComment;
     uLong commentBufferSize;
 {
-    return unzlocal_GetCurrentFileInfoInternal(file,pfile_info,NULL,
-                                                szFileName,fileNameBufferSize,
-                                                extraField,extraFieldBufferSize,
-                                                szComment,commentBufferSize);
+    int err;
+    unz_file_info64 file_info64;
+    err = unzlocal_GetCurrentFileInfoInternal(file,
+                                (pfile_info!=NULL) ? &file_info64 : NULL,NULL,
+                                szFileName,fileNameBufferSize,
+                                extraField,extraFieldBufferSize,
+                                szComment,commentBufferSize);
+    if ((err==UNZ_OK) && (pfile_info!=NULL))
+    {
+        pfile_info->version = file_info64.version;
+        pfile_info->version_needed = file_info64.version_needed;
+        pfile_info->flag = file_info64.flag;
+        pfile_info->compression_method = file_info64.compression_method;
+        pfile_info->dosDate = file_info64.dosDate;
+        pfile_info->crc = file_info64.crc;
+        pfile_info->compressed_size = (uLong)file_info64.compressed_size;
+        pfile_info->uncompressed_size = (uLong)file_info64.uncompressed_size;
+        pfile_info->size_filename = file_info64.size_filename;
+        pfile_info->size_file_extra = file_info64.size_file_extra;
+        pfile_info->size_file_comment = file_info64.size_file_comment;
+        pfile_info->disk_num_start = file_info64.disk_num_start;
+        pfile_info->internal_fa = file_info64.internal_fa;
+        pfile_info->external_fa = file_info64.external_fa;
+        pfile_info->tmu_date = file_info64.tmu_date;
+    }
+    return err;
 }
 
 /*
@@ -805,7 +1540,8 @@ extern int ZEXPORT unzGoToNextFile (file)
     s=(unz_s*)file;
     if (!s->current_file_ok)
         return UNZ_END_OF_LIST_OF_FILE;
-    if (s->gi.number_entry != 0xffff)    /* 2^16 files overflow hack */
+    if ((s->zip64) ||
+        (s->gi.number_entry != 0xffff))  /* 2^16 files overflow hack */
       if (s->num_file+1==s->gi.number_entry)
         return UNZ_END_OF_LIST_OF_FILE;
 
@@ -839,10 +1575,10 @@ extern int ZEXPORT unzLocateFile (file, szFileName, iCaseSensitivity)
     /* We remember the 'current' position in the file so that we can jump
      * back there if we fail.
      */
-    unz_file_info cur_file_infoSaved;
+    unz_file_info64 cur_file_infoSaved;
     unz_file_info_internal cur_file_info_internalSaved;
-    uLong num_fileSaved;
-    uLong pos_in_central_dirSaved;
+    ZPOS64_T num_fileSaved;
+    ZPOS64_T pos_in_central_dirSaved;
 
 
     if (file==NULL)
@@ -861,7 +1597,34 @@ extern int ZEXPORT unzLocateFile (file, szFileName, iCaseSensitivity)
     cur_file_infoSaved = s->cur_file_info;
     cur_file_info_internalSaved = s->cur_file_info_internal;
 
-    err = unzGoToFirstFile(file);
+    if (iCaseSensitivity==0)
+        iCaseSensitivity=CASESENSITIVITYDEFAULTVALUE;
+    /* any value but 1 is not case sensitive for unzStringFileNameCompare,
+       and is looked up in the case folded table of the index */
+    iCaseSensitivity = (iCaseSensitivity==1) ? 1 : 2;
+
+#   ifdef CASEFOLDEDINDEX
+    if (s->index!=NULL)
+#   else
+    if ((s->index!=NULL) && (iCaseSensitivity==1))
+#   endif
+    {
+        /* jump directly to the file with the index */
+        const unz_index_entry* pentry;
+        pentry = unzlocal_IndexLookup(s->index,szFileName,iCaseSensitivity);
+        if (pentry==NULL)
+            return UNZ_END_OF_LIST_OF_FILE;
+
+        s->pos_in_central_dir = pentry->pos_in_central_dir;
+        s->num_file = pentry->num_file;
+        err = unzlocal_GetCurrentFileInfoInternal(file,&s->cur_file_info,
+                                                   &s->cur_file_info_internal,
+                                                   NULL,0,NULL,0,NULL,0);
+        if (err == UNZ_OK)
+            return UNZ_OK;
+    }
+    else
+        err = unzGoToFirstFile(file);
 
     while (err == UNZ_OK)
     {
@@ -907,9 +1670,9 @@ typedef struct unz_file_pos_s
 } unz_file_pos;
 */
 
-extern int ZEXPORT unzGetFilePos(file, file_pos)
+extern int ZEXPORT unzGetFilePos64(file, file_pos)
     unzFile file;
-    unz_file_pos* file_pos;
+    unz64_file_pos* file_pos;
 {
     unz_s* s;
 
@@ -925,9 +1688,40 @@ extern int ZEXPORT unzGetFilePos(file, file_pos)
     return UNZ_OK;
 }
 
+extern int ZEXPORT unzGetFilePos(file, file_pos)
+    unzFile file;
+    unz_file_pos* file_pos;
+{
+    unz64_file_pos file_pos64;
+    int err;
+
+    if (file_pos==NULL)
+        return UNZ_PARAMERROR;
+    err = unzGetFilePos64(file,&file_pos64);
+    if (err==UNZ_OK)
+    {
+        file_pos->pos_in_zip_directory = (uLong)file_pos64.pos_in_zip_directory;
+        file_pos->num_of_file          = (uLong)file_pos64.num_of_file;
+    }
+    return err;
+}
+
 extern int ZEXPORT unzGoToFilePos(file, file_pos)
     unzFile file;
     unz_file_pos* file_pos;
+{
+    unz64_file_pos file_pos64;
+
+    if (file_pos==NULL)
+        return UNZ_PARAMERROR;
+    file_pos64.pos_in_zip_directory = file_pos->pos_in_zip_directory;
+    file_pos64.num_of_file          = file_pos->num_of_file;
+    return unzGoToFilePos64(file,&file_pos64);
+}
+
+extern int ZEXPORT unzGoToFilePos64(file, file_pos)
+    unzFile file;
+    const unz64_file_pos* file_pos;
 {
     unz_s* s;
     int err;
@@ -955,21 +1749,32 @@ extern int ZEXPORT unzGoToFilePos(file, file_pos)
 */
 
 /*
-  Read the local header of the current zipfile
-  Check the coherency of the local header and info in the end of central
-        directory about this file
+  Check the coherency of the local header (SIZEZIPLOCALHEADER bytes at
+        header) and info in the end of central directory about this file
+        (pfile_info, pfile_info_internal)
   store in *piSizeVar the size of extra info in local header
         (filename and size of extra field data)
 */
-local int unzlocal_CheckCurrentFileCoherencyHeader (s,piSizeVar,
-                                                    poffset_local_extrafield,
-                                                    psize_local_extrafield)
-    unz_s* s;
+local int unzlocal_CheckLocalHeader OF((const unsigned char* header,
+                                  const unz_file_info64* pfile_info,
+                                  const unz_file_info_internal*
+                                  pfile_info_internal,
+                                  uInt* piSizeVar,
+                                  ZPOS64_T *poffset_local_extrafield,
+                                  uInt  *psize_local_extrafield));
+
+local int unzlocal_CheckLocalHeader (header,pfile_info,pfile_info_internal,
+                                     piSizeVar,
+                                     poffset_local_extrafield,
+                                     psize_local_extrafield)
+    const unsigned char* header;
+    const unz_file_info64* pfile_info;
+    const unz_file_info_internal* pfile_info_internal;
     uInt* piSizeVar;
-    uLong *poffset_local_extrafield;
+    ZPOS64_T *poffset_local_extrafield;
     uInt  *psize_local_extrafield;
 {
-    uLong uMagic,uData,uFlags;
+    uLong uFlags;
     uLong size_filename;
     uLong size_extra_field;
     int err=UNZ_OK;
@@ -978,69 +1783,49 @@ local int unzlocal_CheckCurrentFileCoherencyHeader (s,piSizeVar,
     *poffset_local_extrafield = 0;
     *psize_local_extrafield = 0;
 
-    if (ZSEEK(s->z_filefunc, s->filestream,s->cur_file_info_internal.offset_curfile +
-                                s->byte_before_the_zipfile,ZLIB_FILEFUNC_SEEK_SET)!=0)
-        return UNZ_ERRNO;
-
-
-    if (err==UNZ_OK)
-    {
-        if (unzlocal_getLong(&s->z_filefunc, s->filestream,&uMagic) != UNZ_OK)
-            err=UNZ_ERRNO;
-        else if (uMagic!=0x04034b50)
-            err=UNZ_BADZIPFILE;
-    }
-
-    if (unzlocal_getShort(&s->z_filefunc, s->filestream,&uData) != UNZ_OK)
-        err=UNZ_ERRNO;
+    if (unzlocal_bufLong(header)!=0x04034b50)
+        err=UNZ_BADZIPFILE;
 /*
-    else if ((err==UNZ_OK) && (uData!=s->cur_file_info.wVersion))
+    else if ((err==UNZ_OK) && (unzlocal_bufShort(header+4)!=pfile_info->wVersion))
         err=UNZ_BADZIPFILE;
 */
-    if (unzlocal_getShort(&s->z_filefunc, s->filestream,&uFlags) != UNZ_OK)
-        err=UNZ_ERRNO;
+    uFlags = unzlocal_bufShort(header+6);
 
-    if (unzlocal_getShort(&s->z_filefunc, s->filestream,&uData) != UNZ_OK)
-        err=UNZ_ERRNO;
-    else if ((err==UNZ_OK) && (uData!=s->cur_file_info.compression_method))
+    if ((err==UNZ_OK) &&
+        (unzlocal_bufShort(header+8)!=pfile_info->compression_method))
         err=UNZ_BADZIPFILE;
 
-    if ((err==UNZ_OK) && (s->cur_file_info.compression_method!=0) &&
-                         (s->cur_file_info.compression_method!=Z_DEFLATED))
+    if ((err==UNZ_OK) && (pfile_info->compression_method!=0) &&
+                         (pfile_info->compression_method!=Z_DEFLATED))
         err=UNZ_BADZIPFILE;
 
-    if (unzlocal_getLong(&s->z_filefunc, s->filestream,&uData) != UNZ_OK) /* date/time */
-        err=UNZ_ERRNO;
+    /* header+10 : date/time */
 
-    if (unzlocal_getLong(&s->z_filefunc, s->filestream,&uData) != UNZ_OK) /* crc */
-        err=UNZ_ERRNO;
-    else if ((err==UNZ_OK) && (uData!=s->cur_file_info.crc) &&
-                              ((uFlags & 8)==0))
+    if ((err==UNZ_OK) && (unzlocal_bufLong(header+14)!=pfile_info->crc) &&
+                         ((uFlags & 8)==0))
         err=UNZ_BADZIPFILE;
 
-    if (unzlocal_getLong(&s->z_filefunc, s->filestream,&uData) != UNZ_OK) /* size compr */
-        err=UNZ_ERRNO;
-    else if ((err==UNZ_OK) && (uData!=s->cur_file_info.compressed_size) &&
-                              ((uFlags & 8)==0))
+    /* the sizes are 0xffffffff when they are in the Zip64 extra field */
+    if ((err==UNZ_OK) &&
+        (unzlocal_bufLong(header+18)!=pfile_info->compressed_size) &&
+        (unzlocal_bufLong(header+18)!=0xffffffff) &&
+        ((uFlags & 8)==0))
         err=UNZ_BADZIPFILE;
 
-    if (unzlocal_getLong(&s->z_filefunc, s->filestream,&uData) != UNZ_OK) /* size uncompr */
-        err=UNZ_ERRNO;
-    else if ((err==UNZ_OK) && (uData!=s->cur_file_info.uncompressed_size) &&
-                              ((uFlags & 8)==0))
+    if ((err==UNZ_OK) &&
+        (unzlocal_bufLong(header+22)!=pfile_info->uncompressed_size) &&
+        (unzlocal_bufLong(header+22)!=0xffffffff) &&
+        ((uFlags & 8)==0))
         err=UNZ_BADZIPFILE;
 
-
-    if (unzlocal_getShort(&s->z_filefunc, s->filestream,&size_filename) != UNZ_OK)
-        err=UNZ_ERRNO;
-    else if ((err==UNZ_OK) && (size_filename!=s->cur_file_info.size_filename))
+    size_filename = unzlocal_bufShort(header+26);
+    if ((err==UNZ_OK) && (size_filename!=pfile_info->size_filename))
         err=UNZ_BADZIPFILE;
 
     *piSizeVar += (uInt)size_filename;
 
-    if (unzlocal_getShort(&s->z_filefunc, s->filestream,&size_extra_field) != UNZ_OK)
-        err=UNZ_ERRNO;
-    *poffset_local_extrafield= s->cur_file_info_internal.offset_curfile +
+    size_extra_field = unzlocal_bufShort(header+28);
+    *poffset_local_extrafield= pfile_info_internal->offset_curfile +
                                     SIZEZIPLOCALHEADER + size_filename;
     *psize_local_extrafield = (uInt)size_extra_field;
 
@@ -1050,68 +1835,191 @@ local int unzlocal_CheckCurrentFileCoherencyHeader (s,piSizeVar,
 }
 
 /*
-  Open for reading data the current file in the zipfile.
-  If there is no error and the file is opened, the return value is UNZ_OK.
+  Read the local header of a file of the zipfile, and check it with
+        unzlocal_CheckLocalHeader
 */
-extern int ZEXPORT unzOpenCurrentFile3 (file, method, level, raw, password)
-    unzFile file;
-    int* method;
-    int* level;
-    int raw;
-    const char* password;
-{
-    int err=UNZ_OK;
-    uInt iSizeVar;
+local int unzlocal_CheckFileCoherencyHeader OF((unz_s* s,
+                                  const unz_file_info64* pfile_info,
+                                  const unz_file_info_internal*
+                                  pfile_info_internal,
+                                  uInt* piSizeVar,
+                                  ZPOS64_T *poffset_local_extrafield,
+                                  uInt  *psize_local_extrafield));
+
+local int unzlocal_CheckFileCoherencyHeader (s,pfile_info,pfile_info_internal,
+                                             piSizeVar,
+                                             poffset_local_extrafield,
+                                             psize_local_extrafield)
     unz_s* s;
-    file_in_zip_read_info_s* pfile_in_zip_read_info;
-    uLong offset_local_extrafield;  /* offset of the local extra field */
-    uInt  size_local_extrafield;    /* size of the local extra field */
-#    ifndef NOUNCRYPT
-    char source[12];
-#    else
-    if (password != NULL)
-        return UNZ_PARAMERROR;
-#    endif
+    const unz_file_info64* pfile_info;
+    const unz_file_info_internal* pfile_info_internal;
+    uInt* piSizeVar;
+    ZPOS64_T *poffset_local_extrafield;
+    uInt  *psize_local_extrafield;
+{
+    unsigned char header[SIZEZIPLOCALHEADER];
 
-    if (file==NULL)
-        return UNZ_PARAMERROR;
-    s=(unz_s*)file;
-    if (!s->current_file_ok)
-        return UNZ_PARAMERROR;
+    *piSizeVar = 0;
+    *poffset_local_extrafield = 0;
+    *psize_local_extrafield = 0;
 
-    if (s->pfile_in_zip_read != NULL)
-        unzCloseCurrentFile(file);
+    if (unzlocal_ReadAt(&s->z_filefunc,s->filestream,&s->pos_stream,header,SIZEZIPLOCALHEADER,
+               pfile_info_internal->offset_curfile +
+               s->byte_before_the_zipfile)!=SIZEZIPLOCALHEADER)
+        return UNZ_ERRNO;
 
-    if (unzlocal_CheckCurrentFileCoherencyHeader(s,&iSizeVar,
-                &offset_local_extrafield,&size_local_extrafield)!=UNZ_OK)
+    return unzlocal_CheckLocalHeader(header,pfile_info,pfile_info_internal,
+                                     piSizeVar,poffset_local_extrafield,
+                                     psize_local_extrafield);
+}
+
+/*
+  Allocate and free with the allocator given by unzSetAllocator, or with
+    ALLOC and TRYFREE when there is none
+*/
+local voidpf unzlocal_Alloc OF((alloc_func zalloc, voidpf opaque, uInt size));
+
+local voidpf unzlocal_Alloc (zalloc, opaque, size)
+    alloc_func zalloc;
+    voidpf opaque;
+    uInt size;
+{
+    if (zalloc != (alloc_func)0)
+        return (*zalloc)(opaque,size,1);
+    return ALLOC(size);
+}
+
+local void unzlocal_Free OF((free_func zfree, voidpf opaque, voidpf address));
+
+local void unzlocal_Free (zfree, opaque, address)
+    free_func zfree;
+    voidpf opaque;
+    voidpf address;
+{
+    if (address == NULL)
+        return;
+    if (zfree != (free_func)0)
+        (*zfree)(opaque,address);
+    else
+        TRYFREE(address);
+}
+
+/*
+  Free a file_in_zip_read_info_s, with its buffer and its inflate state
+*/
+local void unzlocal_FreeFile OF((file_in_zip_read_info_s*
+                                 pfile_in_zip_read_info));
+
+local void unzlocal_FreeFile (pfile_in_zip_read_info)
+    file_in_zip_read_info_s* pfile_in_zip_read_info;
+{
+    if (pfile_in_zip_read_info == NULL)
+        return;
+    if (pfile_in_zip_read_info->stream_initialised)
+        inflateEnd(&pfile_in_zip_read_info->stream);
+    unzlocal_Free(pfile_in_zip_read_info->zfree,pfile_in_zip_read_info->opaque,
+                  pfile_in_zip_read_info->read_buffer);
+    unzlocal_Free(pfile_in_zip_read_info->zfree,pfile_in_zip_read_info->opaque,
+                  pfile_in_zip_read_info);
+}
+
+/*
+  Open for reading data a file of the zipfile (described by pfile_info and
+    pfile_info_internal), in a file_in_zip_read_info_s stored in
+    *ppfile_in_zip_read_info. When ppfile_in_zip_read_free!=NULL and
+    *ppfile_in_zip_read_free is a closed file_in_zip_read_info_s, it is
+    recycled (with its buffer, and its inflate state reset), else a new one
+    is allocated.
+  The file_in_zip_read_info_s only refers to the io set and the stream of s,
+    so several of them can be opened at the same time on the same zipfile.
+  If there is no error and the file is opened, the return value is UNZ_OK.
+*/
+local int unzlocal_OpenFile OF((unz_s* s,
+                                const unz_file_info64* pfile_info,
+                                const unz_file_info_internal*
+                                pfile_info_internal,
+                                int* method,
+                                int* level,
+                                int raw,
+                                const char* password,
+                                file_in_zip_read_info_s**
+                                ppfile_in_zip_read_free,
+                                file_in_zip_read_info_s**
+                                ppfile_in_zip_read_info));
+
+local int unzlocal_OpenFile (s, pfile_info, pfile_info_internal,
+                             method, level, raw, password,
+                             ppfile_in_zip_read_free,
+                             ppfile_in_zip_read_info)
+    unz_s* s;
+    const unz_file_info64* pfile_info;
+    const unz_file_info_internal* pfile_info_internal;
+    int* method;
+    int* level;
+    int raw;
+    const char* password;
+    file_in_zip_read_info_s** ppfile_in_zip_read_free;
+    file_in_zip_read_info_s** ppfile_in_zip_read_info;
+{
+    int err=UNZ_OK;
+    uInt iSizeVar;
+    file_in_zip_read_info_s* pfile_in_zip_read_info;
+    ZPOS64_T offset_local_extrafield;/* offset of the local extra field */
+    uInt  size_local_extrafield;    /* size of the local extra field */
+#    ifndef NOUNCRYPT
+    char source[12];
+#    else
+    if (password != NULL)
+        return UNZ_PARAMERROR;
+#    endif
+
+    if (unzlocal_CheckFileCoherencyHeader(s,pfile_info,pfile_info_internal,
+                &iSizeVar,&offset_local_extrafield,&size_local_extrafield)
+                                                                    !=UNZ_OK)
         return UNZ_BADZIPFILE;
 
-    pfile_in_zip_read_info = (file_in_zip_read_info_s*)
-                                        ALLOC(sizeof(file_in_zip_read_info_s));
-    if (pfile_in_zip_read_info==NULL)
-        return UNZ_INTERNALERROR;
+    if ((ppfile_in_zip_read_free!=NULL) && (*ppfile_in_zip_read_free!=NULL))
+    {
+        pfile_in_zip_read_info = *ppfile_in_zip_read_free;
+        *ppfile_in_zip_read_free = NULL;
+    }
+    else
+    {
+        pfile_in_zip_read_info = (file_in_zip_read_info_s*)
+                    unzlocal_Alloc(s->zalloc,s->opaque,
+                                   sizeof(file_in_zip_read_info_s));
+        if (pfile_in_zip_read_info==NULL)
+            return UNZ_INTERNALERROR;
+
+        pfile_in_zip_read_info->zalloc=s->zalloc;
+        pfile_in_zip_read_info->zfree=s->zfree;
+        pfile_in_zip_read_info->opaque=s->opaque;
+        pfile_in_zip_read_info->stream_initialised=0;
+        pfile_in_zip_read_info->size_read_buffer=s->size_read_buffer;
+        pfile_in_zip_read_info->read_buffer=(char*)
+                    unzlocal_Alloc(s->zalloc,s->opaque,
+                                   pfile_in_zip_read_info->size_read_buffer);
+        if (pfile_in_zip_read_info->read_buffer==NULL)
+        {
+            unzlocal_FreeFile(pfile_in_zip_read_info);
+            return UNZ_INTERNALERROR;
+        }
+    }
 
-    pfile_in_zip_read_info->read_buffer=(char*)ALLOC(UNZ_BUFSIZE);
+    pfile_in_zip_read_info->max_read_buffer=s->max_read_buffer;
     pfile_in_zip_read_info->offset_local_extrafield = offset_local_extrafield;
     pfile_in_zip_read_info->size_local_extrafield = size_local_extrafield;
     pfile_in_zip_read_info->pos_local_extrafield=0;
     pfile_in_zip_read_info->raw=raw;
-
-    if (pfile_in_zip_read_info->read_buffer==NULL)
-    {
-        TRYFREE(pfile_in_zip_read_info);
-        return UNZ_INTERNALERROR;
-    }
-
-    pfile_in_zip_read_info->stream_initialised=0;
+    pfile_in_zip_read_info->encrypted=0;
 
     if (method!=NULL)
-        *method = (int)s->cur_file_info.compression_method;
+        *method = (int)pfile_info->compression_method;
 
     if (level!=NULL)
     {
         *level = 6;
-        switch (s->cur_file_info.flag & 0x06)
+        switch (pfile_info->flag & 0x06)
         {
           case 6 : *level = 1; break;
           case 4 : *level = 2; break;
@@ -1119,35 +2027,43 @@ extern int ZEXPORT unzOpenCurrentFile3 (file, method, level, raw, password)
         }
     }
 
-    if ((s->cur_file_info.compression_method!=0) &&
-        (s->cur_file_info.compression_method!=Z_DEFLATED))
+    if ((pfile_info->compression_method!=0) &&
+        (pfile_info->compression_method!=Z_DEFLATED))
         err=UNZ_BADZIPFILE;
 
-    pfile_in_zip_read_info->crc32_wait=s->cur_file_info.crc;
+    pfile_in_zip_read_info->crc32_wait=pfile_info->crc;
     pfile_in_zip_read_info->crc32=0;
+    pfile_in_zip_read_info->check_crc = (s->crc_policy!=UNZ_CRC_SKIP);
     pfile_in_zip_read_info->compression_method =
-            s->cur_file_info.compression_method;
+            pfile_info->compression_method;
     pfile_in_zip_read_info->filestream=s->filestream;
     pfile_in_zip_read_info->z_filefunc=s->z_filefunc;
+    pfile_in_zip_read_info->ppos_stream=&s->pos_stream;
     pfile_in_zip_read_info->byte_before_the_zipfile=s->byte_before_the_zipfile;
 
     pfile_in_zip_read_info->stream.total_out = 0;
+    pfile_in_zip_read_info->total_out_64 = 0;
 
-    if ((s->cur_file_info.compression_method==Z_DEFLATED) &&
+    if ((pfile_info->compression_method==Z_DEFLATED) &&
         (!raw))
     {
-      pfile_in_zip_read_info->stream.zalloc = (alloc_func)0;
-      pfile_in_zip_read_info->stream.zfree = (free_func)0;
-      pfile_in_zip_read_info->stream.opaque = (voidpf)0;
       pfile_in_zip_read_info->stream.next_in = (voidpf)0;
       pfile_in_zip_read_info->stream.avail_in = 0;
 
-      err=inflateInit2(&pfile_in_zip_read_info->stream, -MAX_WBITS);
-      if (err == Z_OK)
-        pfile_in_zip_read_info->stream_initialised=1;
+      if (pfile_in_zip_read_info->stream_initialised)
+        err=inflateReset(&pfile_in_zip_read_info->stream);
       else
       {
-        TRYFREE(pfile_in_zip_read_info);
+        pfile_in_zip_read_info->stream.zalloc = pfile_in_zip_read_info->zalloc;
+        pfile_in_zip_read_info->stream.zfree = pfile_in_zip_read_info->zfree;
+        pfile_in_zip_read_info->stream.opaque = pfile_in_zip_read_info->opaque;
+        err=inflateInit2(&pfile_in_zip_read_info->stream, -MAX_WBITS);
+        if (err == Z_OK)
+          pfile_in_zip_read_info->stream_initialised=1;
+      }
+      if (err != Z_OK)
+      {
+        unzlocal_FreeFile(pfile_in_zip_read_info);
         return err;
       }
         /* windowBits is passed < 0 to tell that there is no zlib header.
@@ -1159,42 +2075,80 @@ extern int ZEXPORT unzOpenCurrentFile3 (file, method, level, raw, password)
          */
     }
     pfile_in_zip_read_info->rest_read_compressed =
-            s->cur_file_info.compressed_size ;
+            pfile_info->compressed_size ;
     pfile_in_zip_read_info->rest_read_uncompressed =
-            s->cur_file_info.uncompressed_size ;
+            pfile_info->uncompressed_size ;
 
 
     pfile_in_zip_read_info->pos_in_zipfile =
-            s->cur_file_info_internal.offset_curfile + SIZEZIPLOCALHEADER +
+            pfile_info_internal->offset_curfile + SIZEZIPLOCALHEADER +
               iSizeVar;
 
     pfile_in_zip_read_info->stream.avail_in = (uInt)0;
 
-    s->pfile_in_zip_read = pfile_in_zip_read_info;
-
 #    ifndef NOUNCRYPT
     if (password != NULL)
     {
         int i;
-        s->pcrc_32_tab = get_crc_table();
-        init_keys(password,s->keys,s->pcrc_32_tab);
-        if (ZSEEK(s->z_filefunc, s->filestream,
-                  s->pfile_in_zip_read->pos_in_zipfile +
-                     s->pfile_in_zip_read->byte_before_the_zipfile,
-                  SEEK_SET)!=0)
-            return UNZ_INTERNALERROR;
-        if(ZREAD(s->z_filefunc, s->filestream,source, 12)<12)
+        pfile_in_zip_read_info->pcrc_32_tab = get_crc_table();
+        init_keys(password,pfile_in_zip_read_info->keys,
+                  pfile_in_zip_read_info->pcrc_32_tab);
+        if(unzlocal_ReadAt(&s->z_filefunc,s->filestream,&s->pos_stream,source, 12,
+                  pfile_in_zip_read_info->pos_in_zipfile +
+                     pfile_in_zip_read_info->byte_before_the_zipfile)<12)
+        {
+            unzlocal_FreeFile(pfile_in_zip_read_info);
             return UNZ_INTERNALERROR;
+        }
 
         for (i = 0; i<12; i++)
-            zdecode(s->keys,s->pcrc_32_tab,source[i]);
+            zdecode(pfile_in_zip_read_info->keys,
+                    pfile_in_zip_read_info->pcrc_32_tab,source[i]);
 
-        s->pfile_in_zip_read->pos_in_zipfile+=12;
-        s->encrypted=1;
+        pfile_in_zip_read_info->pos_in_zipfile+=12;
+        pfile_in_zip_read_info->encrypted=1;
     }
 #    endif
 
+    *ppfile_in_zip_read_info = pfile_in_zip_read_info;
+
+    return UNZ_OK;
+}
+
+/*
+  Open for reading data the current file in the zipfile.
+  If there is no error and the file is opened, the return value is UNZ_OK.
+*/
+extern int ZEXPORT unzOpenCurrentFile3 (file, method, level, raw, password)
+    unzFile file;
+    int* method;
+    int* level;
+    int raw;
+    const char* password;
+{
+    unz_s* s;
+    int err;
+
+    if (file==NULL)
+        return UNZ_PARAMERROR;
+    s=(unz_s*)file;
+    if (!s->current_file_ok)
+        return UNZ_PARAMERROR;
+
+    if (s->pfile_in_zip_read != NULL)
+        unzCloseCurrentFile(file);
+
+    err = unzlocal_OpenFile(s,&s->cur_file_info,&s->cur_file_info_internal,
+                            method,level,raw,password,
+                            &s->pfile_in_zip_read_free,&s->pfile_in_zip_read);
+    if (err!=UNZ_OK)
+        return err;
 
+    /* a deferred check reads the file again without the password */
+    if ((s->crc_policy==UNZ_CRC_DEFER) && (password==NULL))
+        s->pfile_in_zip_read->check_crc = 0;
+    s->pfile_in_zip_read->file_pos.pos_in_zip_directory = s->pos_in_central_dir;
+    s->pfile_in_zip_read->file_pos.num_of_file = s->num_file;
     return UNZ_OK;
 }
 
@@ -1221,7 +2175,7 @@ extern int ZEXPORT unzOpenCurrentFile2 (file,method,level,raw)
 }
 
 /*
-  Read bytes from the current file.
+  Read bytes from a file opened by unzlocal_OpenFile.
   buf contain buffer where data must be copied
   len the size of buf.
 
@@ -1230,20 +2184,18 @@ extern int ZEXPORT unzOpenCurrentFile2 (file,method,level,raw)
   return <0 with error code if there is an error
     (UNZ_ERRNO for IO error, or zLib error for uncompress error)
 */
-extern int ZEXPORT unzReadCurrentFile  (file, buf, len)
-    unzFile file;
+local int unzlocal_ReadFile OF((file_in_zip_read_info_s*
+                                 pfile_in_zip_read_info,
+                                 voidp buf,
+                                 unsigned len));
+
+local int unzlocal_ReadFile (pfile_in_zip_read_info, buf, len)
+    file_in_zip_read_info_s* pfile_in_zip_read_info;
     voidp buf;
     unsigned len;
 {
     int err=UNZ_OK;
     uInt iRead = 0;
-    unz_s* s;
-    file_in_zip_read_info_s* pfile_in_zip_read_info;
-    if (file==NULL)
-        return UNZ_PARAMERROR;
-    s=(unz_s*)file;
-    pfile_in_zip_read_info=s->pfile_in_zip_read;
-
     if (pfile_in_zip_read_info==NULL)
         return UNZ_PARAMERROR;
 
@@ -1274,31 +2226,60 @@ extern int ZEXPORT unzReadCurrentFile  (file, buf, len)
         if ((pfile_in_zip_read_info->stream.avail_in==0) &&
             (pfile_in_zip_read_info->rest_read_compressed>0))
         {
-            uInt uReadThis = UNZ_BUFSIZE;
+            uInt uReadThis;
+
+            /* the buffer is empty : a large file gets a larger buffer, so
+               it is read with less refills */
+            if ((pfile_in_zip_read_info->rest_read_compressed >
+                                pfile_in_zip_read_info->size_read_buffer) &&
+                (pfile_in_zip_read_info->size_read_buffer <
+                                pfile_in_zip_read_info->max_read_buffer))
+            {
+                uInt size_read_buffer =
+                            pfile_in_zip_read_info->size_read_buffer*2;
+                char* read_buffer;
+                if (size_read_buffer > pfile_in_zip_read_info->max_read_buffer)
+                    size_read_buffer = pfile_in_zip_read_info->max_read_buffer;
+                read_buffer = (char*)unzlocal_Alloc(pfile_in_zip_read_info->zalloc,
+                                                    pfile_in_zip_read_info->opaque,
+                                                    size_read_buffer);
+                if (read_buffer != NULL)
+                {
+                    unzlocal_Free(pfile_in_zip_read_info->zfree,
+                                  pfile_in_zip_read_info->opaque,
+                                  pfile_in_zip_read_info->read_buffer);
+                    pfile_in_zip_read_info->read_buffer = read_buffer;
+                    pfile_in_zip_read_info->size_read_buffer = size_read_buffer;
+                }
+                else
+                    pfile_in_zip_read_info->max_read_buffer =
+                                    pfile_in_zip_read_info->size_read_buffer;
+            }
+
+            uReadThis = pfile_in_zip_read_info->size_read_buffer;
             if (pfile_in_zip_read_info->rest_read_compressed<uReadThis)
                 uReadThis = (uInt)pfile_in_zip_read_info->rest_read_compressed;
             if (uReadThis == 0)
                 return UNZ_EOF;
-            if (ZSEEK(pfile_in_zip_read_info->z_filefunc,
-                      pfile_in_zip_read_info->filestream,
-                      pfile_in_zip_read_info->pos_in_zipfile +
-                         pfile_in_zip_read_info->byte_before_the_zipfile,
-                         ZLIB_FILEFUNC_SEEK_SET)!=0)
-                return UNZ_ERRNO;
-            if (ZREAD(pfile_in_zip_read_info->z_filefunc,
-                      pfile_in_zip_read_info->filestream,
-                      pfile_in_zip_read_info->read_buffer,
-                      uReadThis)!=uReadThis)
+            if (unzlocal_ReadAt(&pfile_in_zip_read_info->z_filefunc,
+                       pfile_in_zip_read_info->filestream,
+                       pfile_in_zip_read_info->ppos_stream,
+                       pfile_in_zip_read_info->read_buffer,
+                       uReadThis,
+                       pfile_in_zip_read_info->pos_in_zipfile +
+                          pfile_in_zip_read_info->byte_before_the_zipfile)
+                                                            !=uReadThis)
                 return UNZ_ERRNO;
 
 
 #            ifndef NOUNCRYPT
-            if(s->encrypted)
+            if(pfile_in_zip_read_info->encrypted)
             {
                 uInt i;
                 for(i=0;i<uReadThis;i++)
                   pfile_in_zip_read_info->read_buffer[i] =
-                      zdecode(s->keys,s->pcrc_32_tab,
+                      zdecode(pfile_in_zip_read_info->keys,
+                              pfile_in_zip_read_info->pcrc_32_tab,
                               pfile_in_zip_read_info->read_buffer[i]);
             }
 #            endif
@@ -1315,7 +2296,7 @@ extern int ZEXPORT unzReadCurrentFile  (file, buf, len)
 
         if ((pfile_in_zip_read_info->compression_method==0) || (pfile_in_zip_read_info->raw))
         {
-            uInt uDoCopy,i ;
+            uInt uDoCopy ;
 
             if ((pfile_in_zip_read_info->stream.avail_in == 0) &&
                 (pfile_in_zip_read_info->rest_read_compressed == 0))
@@ -1327,19 +2308,21 @@ extern int ZEXPORT unzReadCurrentFile  (file, buf, len)
             else
                 uDoCopy = pfile_in_zip_read_info->stream.avail_in ;
 
-            for (i=0;i<uDoCopy;i++)
-                *(pfile_in_zip_read_info->stream.next_out+i) =
-                        *(pfile_in_zip_read_info->stream.next_in+i);
+            memcpy(pfile_in_zip_read_info->stream.next_out,
+                   pfile_in_zip_read_info->stream.next_in,uDoCopy);
 
-            pfile_in_zip_read_info->crc32 = crc32(pfile_in_zip_read_info->crc32,
-                                pfile_in_zip_read_info->stream.next_out,
-                                uDoCopy);
+            if (pfile_in_zip_read_info->check_crc)
+                pfile_in_zip_read_info->crc32 =
+                    crc32hw(pfile_in_zip_read_info->crc32,
+                            pfile_in_zip_read_info->stream.next_out,
+                            uDoCopy);
             pfile_in_zip_read_info->rest_read_uncompressed-=uDoCopy;
             pfile_in_zip_read_info->stream.avail_in -= uDoCopy;
             pfile_in_zip_read_info->stream.avail_out -= uDoCopy;
             pfile_in_zip_read_info->stream.next_out += uDoCopy;
             pfile_in_zip_read_info->stream.next_in += uDoCopy;
             pfile_in_zip_read_info->stream.total_out += uDoCopy;
+            pfile_in_zip_read_info->total_out_64 += uDoCopy;
             iRead += uDoCopy;
         }
         else
@@ -1366,9 +2349,12 @@ extern int ZEXPORT unzReadCurrentFile  (file, buf, len)
             uTotalOutAfter = pfile_in_zip_read_info->stream.total_out;
             uOutThis = uTotalOutAfter-uTotalOutBefore;
 
-            pfile_in_zip_read_info->crc32 =
-                crc32(pfile_in_zip_read_info->crc32,bufBefore,
-                        (uInt)(uOutThis));
+            pfile_in_zip_read_info->total_out_64 += uOutThis;
+
+            if (pfile_in_zip_read_info->check_crc)
+                pfile_in_zip_read_info->crc32 =
+                    crc32hw(pfile_in_zip_read_info->crc32,bufBefore,
+                            (uInt)(uOutThis));
 
             pfile_in_zip_read_info->rest_read_uncompressed -=
                 uOutThis;
@@ -1388,6 +2374,27 @@ extern int ZEXPORT unzReadCurrentFile  (file, buf, len)
 }
 
 
+/*
+  Read bytes from the current file.
+  buf contain buffer where data must be copied
+  len the size of buf.
+
+  return the number of byte copied if somes bytes are copied
+  return 0 if the end of file was reached
+  return <0 with error code if there is an error
+    (UNZ_ERRNO for IO error, or zLib error for uncompress error)
+*/
+extern int ZEXPORT unzReadCurrentFile  (file, buf, len)
+    unzFile file;
+    voidp buf;
+    unsigned len;
+{
+    if (file==NULL)
+        return UNZ_PARAMERROR;
+    return unzlocal_ReadFile(((unz_s*)file)->pfile_in_zip_read,buf,len);
+}
+
+
 /*
   Give the current position in uncompressed data
 */
@@ -1407,6 +2414,42 @@ extern z_off_t ZEXPORT unztell (file)
     return (z_off_t)pfile_in_zip_read_info->stream.total_out;
 }
 
+extern ZPOS64_T ZEXPORT unztell64 (file)
+    unzFile file;
+{
+    unz_s* s;
+    file_in_zip_read_info_s* pfile_in_zip_read_info;
+    if (file==NULL)
+        return (ZPOS64_T)-1;
+    s=(unz_s*)file;
+    pfile_in_zip_read_info=s->pfile_in_zip_read;
+
+    if (pfile_in_zip_read_info==NULL)
+        return (ZPOS64_T)-1;
+
+    return pfile_in_zip_read_info->total_out_64;
+}
+
+/*
+  Give the position in the zipfile of the next compressed byte to read
+*/
+extern ZPOS64_T ZEXPORT unzGetCurrentFileZStreamPos64 (file)
+    unzFile file;
+{
+    unz_s* s;
+    file_in_zip_read_info_s* pfile_in_zip_read_info;
+    if (file==NULL)
+        return 0;
+    s=(unz_s*)file;
+    pfile_in_zip_read_info=s->pfile_in_zip_read;
+
+    if (pfile_in_zip_read_info==NULL)
+        return 0;
+
+    return pfile_in_zip_read_info->pos_in_zipfile +
+           pfile_in_zip_read_info->byte_before_the_zipfile;
+}
+
 
 /*
   return 1 if the end of file was reached, 0 elsewhere
@@ -1476,132 +2519,1945 @@ extern int ZEXPORT unzGetLocalExtrafield (file,buf,len)
     if (read_now==0)
         return 0;
 
-    if (ZSEEK(pfile_in_zip_read_info->z_filefunc,
-              pfile_in_zip_read_info->filestream,
-              pfile_in_zip_read_info->offset_local_extrafield +
-              pfile_in_zip_read_info->pos_local_extrafield,
-              ZLIB_FILEFUNC_SEEK_SET)!=0)
-        return UNZ_ERRNO;
-
-    if (ZREAD(pfile_in_zip_read_info->z_filefunc,
-              pfile_in_zip_read_info->filestream,
-              buf,read_now)!=read_now)
+    if (unzlocal_ReadAt(&pfile_in_zip_read_info->z_filefunc,
+               pfile_in_zip_read_info->filestream,
+               pfile_in_zip_read_info->ppos_stream,
+               buf,read_now,
+               pfile_in_zip_read_info->offset_local_extrafield +
+               pfile_in_zip_read_info->pos_local_extrafield)!=read_now)
         return UNZ_ERRNO;
 
     return (int)read_now;
 }
 
 /*
-  Close the file in zip opened with unzipOpenCurrentFile
-  Return UNZ_CRCERROR if all the file was read but the CRC is not good
+  Close a file opened by unzlocal_OpenFile. pfile_in_zip_read_info is kept
+    in *ppfile_in_zip_read_free to be recycled when ppfile_in_zip_read_free
+    is not NULL and *ppfile_in_zip_read_free is empty, else it is freed.
+  Return UNZ_CRCERROR if all the file was read but the CRC is not good (when
+    it was computed)
 */
-extern int ZEXPORT unzCloseCurrentFile (file)
-    unzFile file;
-{
-    int err=UNZ_OK;
+local int unzlocal_CloseFile OF((file_in_zip_read_info_s*
+                                 pfile_in_zip_read_info,
+                                 file_in_zip_read_info_s**
+                                 ppfile_in_zip_read_free));
 
-    unz_s* s;
+local int unzlocal_CloseFile (pfile_in_zip_read_info, ppfile_in_zip_read_free)
     file_in_zip_read_info_s* pfile_in_zip_read_info;
-    if (file==NULL)
-        return UNZ_PARAMERROR;
-    s=(unz_s*)file;
-    pfile_in_zip_read_info=s->pfile_in_zip_read;
+    file_in_zip_read_info_s** ppfile_in_zip_read_free;
+{
+    int err=UNZ_OK;
 
     if (pfile_in_zip_read_info==NULL)
         return UNZ_PARAMERROR;
 
 
     if ((pfile_in_zip_read_info->rest_read_uncompressed == 0) &&
-        (!pfile_in_zip_read_info->raw))
+        (!pfile_in_zip_read_info->raw) &&
+        (pfile_in_zip_read_info->check_crc))
     {
         if (pfile_in_zip_read_info->crc32 != pfile_in_zip_read_info->crc32_wait)
             err=UNZ_CRCERROR;
     }
 
 
-    TRYFREE(pfile_in_zip_read_info->read_buffer);
-    pfile_in_zip_read_info->read_buffer = NULL;
-    if (pfile_in_zip_read_info->stream_initialised)
-        inflateEnd(&pfile_in_zip_read_info->stream);
-
-    pfile_in_zip_read_info->stream_initialised = 0;
-    TRYFREE(pfile_in_zip_read_info);
-
-    s->pfile_in_zip_read=NULL;
+    if ((ppfile_in_zip_read_free!=NULL) && (*ppfile_in_zip_read_free==NULL))
+        *ppfile_in_zip_read_free = pfile_in_zip_read_info;
+    else
+        unzlocal_FreeFile(pfile_in_zip_read_info);
 
     return err;
 }
 
+local int unzlocal_DeferCrc OF((unz_s* s, const unz64_file_pos* file_pos));
 
 /*
-  Get the global comment string of the ZipFile, in the szComment buffer.
-  uSizeBuf is the size of the szComment buffer.
-  return the number of byte copied or an error code <0
+  Close the file in zip opened with unzipOpenCurrentFile
+  Return UNZ_CRCERROR if all the file was read but the CRC is not good
 */
-extern int ZEXPORT unzGetGlobalComment (file, szComment, uSizeBuf)
+extern int ZEXPORT unzCloseCurrentFile (file)
     unzFile file;
-    char *szComment;
-    uLong uSizeBuf;
 {
-    /* int err=UNZ_OK; */
+    int err;
+    int defer;
+    unz64_file_pos file_pos;
+    file_in_zip_read_info_s* pfile_in_zip_read_info;
+
     unz_s* s;
-    uLong uReadThis ;
     if (file==NULL)
         return UNZ_PARAMERROR;
     s=(unz_s*)file;
 
-    uReadThis = uSizeBuf;
-    if (uReadThis>s->gi.size_comment)
-        uReadThis = s->gi.size_comment;
+    pfile_in_zip_read_info = s->pfile_in_zip_read;
+    if (pfile_in_zip_read_info==NULL)
+        return UNZ_PARAMERROR;
 
-    if (ZSEEK(s->z_filefunc,s->filestream,s->central_pos+22,ZLIB_FILEFUNC_SEEK_SET)!=0)
-        return UNZ_ERRNO;
+    /* a whole file read without its crc32 is queued to be checked later */
+    defer = (s->crc_policy==UNZ_CRC_DEFER) &&
+            (!pfile_in_zip_read_info->check_crc) &&
+            (!pfile_in_zip_read_info->raw) &&
+            (pfile_in_zip_read_info->rest_read_uncompressed == 0);
+    file_pos = pfile_in_zip_read_info->file_pos;
 
-    if (uReadThis>0)
-    {
-      *szComment='\0';
-      if (ZREAD(s->z_filefunc,s->filestream,szComment,uReadThis)!=uReadThis)
-        return UNZ_ERRNO;
-    }
+    err = unzlocal_CloseFile(pfile_in_zip_read_info,&s->pfile_in_zip_read_free);
+    s->pfile_in_zip_read=NULL;
 
-    if ((szComment != NULL) && (uSizeBuf > s->gi.size_comment))
-        *(szComment+s->gi.size_comment)='\0';
-    return (int)uReadThis;
+    if ((err==UNZ_OK) && (defer))
+        err = unzlocal_DeferCrc(s,&file_pos);
+    return err;
 }
 
-/* Additions by RX '2004 */
-extern uLong ZEXPORT unzGetOffset (file)
-    unzFile file;
-{
-    unz_s* s;
-
-    if (file==NULL)
-          return UNZ_PARAMERROR;
-    s=(unz_s*)file;
-    if (!s->current_file_ok)
-      return 0;
-    if (s->gi.number_entry != 0 && s->gi.number_entry != 0xffff)
-      if (s->num_file==s->gi.number_entry)
-         return 0;
-    return s->pos_in_central_dir;
-}
 
-extern int ZEXPORT unzSetOffset (file, pos)
-        unzFile file;
-        uLong pos;
+/*
+  Open a cursor on a file of the zipfile : it has its own decompression
+    state and buffer, so several cursors can read different files of the
+    same unzFile at the same time.
+*/
+extern int ZEXPORT unzOpenCursor (file, file_pos, password, pcursor)
+    unzFile file;
+    const unz64_file_pos* file_pos;
+    const char* password;
+    unzCursor* pcursor;
 {
     unz_s* s;
+    unz_file_info64 file_info;
+    unz_file_info_internal file_info_internal;
+    file_in_zip_read_info_s* pfile_in_zip_read_info;
     int err;
 
-    if (file==NULL)
+    if ((file==NULL) || (pcursor==NULL))
         return UNZ_PARAMERROR;
     s=(unz_s*)file;
+    *pcursor = NULL;
 
-    s->pos_in_central_dir = pos;
-    s->num_file = s->gi.number_entry;      /* hack */
-    err = unzlocal_GetCurrentFileInfoInternal(file,&s->cur_file_info,
-                                              &s->cur_file_info_internal,
-                                              NULL,0,NULL,0,NULL,0);
-    s->current_file_ok = (err == UNZ_OK);
+    if (file_pos==NULL)
+    {
+        if (!s->current_file_ok)
+            return UNZ_PARAMERROR;
+        file_info = s->cur_file_info;
+        file_info_internal = s->cur_file_info_internal;
+    }
+    else
+    {
+        err = unzlocal_GetFileInfoInternal(file,file_pos->pos_in_zip_directory,
+                                           &file_info,&file_info_internal,
+                                           NULL,0,NULL,0,NULL,0);
+        if (err!=UNZ_OK)
+            return err;
+    }
+
+    err = unzlocal_OpenFile(s,&file_info,&file_info_internal,
+                            NULL,NULL,0,password,NULL,&pfile_in_zip_read_info);
+    if (err==UNZ_OK)
+        *pcursor = (unzCursor)pfile_in_zip_read_info;
+    return err;
+}
+
+extern int ZEXPORT unzReadCursor (cursor, buf, len)
+    unzCursor cursor;
+    voidp buf;
+    unsigned len;
+{
+    return unzlocal_ReadFile((file_in_zip_read_info_s*)cursor,buf,len);
+}
+
+extern int ZEXPORT unzCloseCursor (cursor)
+    unzCursor cursor;
+{
+    return unzlocal_CloseFile((file_in_zip_read_info_s*)cursor,NULL);
+}
+
+
+/*
+  Set the size of the read buffer of the files opened after this call
+*/
+extern int ZEXPORT unzSetReadBufferSize (file, size, max_size)
+    unzFile file;
+    uLong size;
+    uLong max_size;
+{
+    unz_s* s;
+    if ((file==NULL) || (size==0) || (size>0x40000000) || (max_size>0x40000000))
+        return UNZ_PARAMERROR;
+    s=(unz_s*)file;
+    if (max_size < size)
+        max_size = size;
+    unzlocal_WaitCrc(s,0);
+    s->size_read_buffer = (uInt)size;
+    s->max_read_buffer = (uInt)max_size;
+    unzlocal_FreeFile(s->pfile_in_zip_read_free);
+    s->pfile_in_zip_read_free = NULL;
+    return UNZ_OK;
+}
+
+/*
+  Set the allocator of the buffers and inflate states of the files opened
+    after this call
+*/
+extern int ZEXPORT unzSetAllocator (file, zalloc, zfree, opaque)
+    unzFile file;
+    alloc_func zalloc;
+    free_func zfree;
+    voidpf opaque;
+{
+    unz_s* s;
+    if ((file==NULL) || ((zalloc==(alloc_func)0) != (zfree==(free_func)0)))
+        return UNZ_PARAMERROR;
+    s=(unz_s*)file;
+    unzlocal_WaitCrc(s,0);
+    s->zalloc = zalloc;
+    s->zfree = zfree;
+    s->opaque = opaque;
+    unzlocal_FreeFile(s->pfile_in_zip_read_free);
+    s->pfile_in_zip_read_free = NULL;
+    return UNZ_OK;
+}
+
+/*
+  Read again the whole file at file_pos with a cursor (which checks its
+    crc32), through buf
+*/
+local int unzlocal_VerifyFile OF((unz_s* s,
+                                  const unz64_file_pos* file_pos,
+                                  voidp buf,
+                                  unsigned size_buf));
+
+local int unzlocal_VerifyFile (s, file_pos, buf, size_buf)
+    unz_s* s;
+    const unz64_file_pos* file_pos;
+    voidp buf;
+    unsigned size_buf;
+{
+    unzCursor cursor;
+    int err;
+
+    err = unzOpenCursor((unzFile)s,file_pos,NULL,&cursor);
+    if (err!=UNZ_OK)
+        return err;
+    do
+        err = unzReadCursor(cursor,buf,size_buf);
+    while (err>0);
+    if (err==UNZ_EOF)
+        return unzCloseCursor(cursor);
+    unzCloseCursor(cursor);
+    return err;
+}
+
+#ifdef UNZ_CRCTHREAD
+/*
+  Thread of the deferred checks : it checks the queued files one by one,
+    until unzlocal_WaitCrc stops it
+*/
+local void* unzlocal_CrcThread OF((void* arg));
+
+local void* unzlocal_CrcThread (arg)
+    void* arg;
+{
+    unz_s* s = (unz_s*)arg;
+    unz_crc_queue* q = s->crc_queue;
+    char* buf = (char*)ALLOC(UNZ_BUFSIZE);
+
+    pthread_mutex_lock(&q->mutex);
+    for (;;)
+    {
+        unz64_file_pos file_pos;
+        int err;
+
+        while ((q->next_file==q->number_file) && (!q->stop))
+            pthread_cond_wait(&q->cond_work,&q->mutex);
+        if (q->next_file==q->number_file)
+            break;
+        file_pos = q->files[q->next_file++];
+        pthread_mutex_unlock(&q->mutex);
+
+        if (buf==NULL)
+            err = UNZ_INTERNALERROR;
+        else
+            err = unzlocal_VerifyFile(s,&file_pos,buf,UNZ_BUFSIZE);
+
+        pthread_mutex_lock(&q->mutex);
+        if ((err!=UNZ_OK) && (q->err==UNZ_OK))
+            q->err = err;
+        if (q->next_file==q->number_file)
+        {
+            q->next_file = 0;
+            q->number_file = 0;
+            pthread_cond_broadcast(&q->cond_idle);
+        }
+    }
+    pthread_mutex_unlock(&q->mutex);
+    TRYFREE(buf);
+    return NULL;
+}
+#endif
+
+/*
+  Check later the crc32 of the file at file_pos, which was read without
+    computing it : it is queued for the thread of the deferred checks
+    (started by the first call), or checked now if it cannot be
+*/
+local int unzlocal_DeferCrc (s, file_pos)
+    unz_s* s;
+    const unz64_file_pos* file_pos;
+{
+    char* buf;
+    int err;
+
+#ifdef UNZ_CRCTHREAD
+    unz_crc_queue* q = s->crc_queue;
+    if (q==NULL)
+    {
+        q = (unz_crc_queue*)ALLOC(sizeof(unz_crc_queue));
+        if (q!=NULL)
+        {
+            q->files = NULL;
+            q->number_file = 0;
+            q->next_file = 0;
+            q->size_files = 0;
+            q->err = UNZ_OK;
+            q->stop = 0;
+            pthread_mutex_init(&q->mutex,NULL);
+            pthread_cond_init(&q->cond_work,NULL);
+            pthread_cond_init(&q->cond_idle,NULL);
+            s->crc_queue = q;
+            if (pthread_create(&q->thread,NULL,unzlocal_CrcThread,s)!=0)
+            {
+                pthread_cond_destroy(&q->cond_idle);
+                pthread_cond_destroy(&q->cond_work);
+                pthread_mutex_destroy(&q->mutex);
+                TRYFREE(q);
+                q = NULL;
+                s->crc_queue = NULL;
+            }
+        }
+    }
+    if (q!=NULL)
+    {
+        pthread_mutex_lock(&q->mutex);
+        if (q->number_file==q->size_files)
+        {
+            uLong size_files = (q->size_files==0) ? 64 : q->size_files*2;
+            unz64_file_pos* files = (unz64_file_pos*)
+                        REALLOC(q->files,size_files*sizeof(unz64_file_pos));
+            if (files!=NULL)
+            {
+                q->files = files;
+                q->size_files = size_files;
+            }
+        }
+        if (q->number_file<q->size_files)
+        {
+            q->files[q->number_file++] = *file_pos;
+            pthread_cond_signal(&q->cond_work);
+            pthread_mutex_unlock(&q->mutex);
+            return UNZ_OK;
+        }
+        pthread_mutex_unlock(&q->mutex);
+    }
+#endif
+
+    buf = (char*)ALLOC(UNZ_BUFSIZE);
+    if (buf==NULL)
+        return UNZ_INTERNALERROR;
+    err = unzlocal_VerifyFile(s,file_pos,buf,UNZ_BUFSIZE);
+    TRYFREE(buf);
+    return err;
+}
+
+/*
+  Wait until the deferred checks of crc32 are done, and end their thread if
+    stop. Return their first error (kept until unzSetCrcPolicy or unzClose)
+*/
+local int unzlocal_WaitCrc (s, stop)
+    unz_s* s;
+    int stop;
+{
+#ifdef UNZ_CRCTHREAD
+    unz_crc_queue* q = s->crc_queue;
+    int err;
+
+    if (q==NULL)
+        return UNZ_OK;
+    pthread_mutex_lock(&q->mutex);
+    while (q->number_file!=0)
+        pthread_cond_wait(&q->cond_idle,&q->mutex);
+    err = q->err;
+    if (stop)
+    {
+        q->stop = 1;
+        pthread_cond_signal(&q->cond_work);
+    }
+    pthread_mutex_unlock(&q->mutex);
+
+    if (stop)
+    {
+        pthread_join(q->thread,NULL);
+        pthread_cond_destroy(&q->cond_idle);
+        pthread_cond_destroy(&q->cond_work);
+        pthread_mutex_destroy(&q->mutex);
+        TRYFREE(q->files);
+        TRYFREE(q);
+        s->crc_queue = NULL;
+    }
+    return err;
+#else
+    return UNZ_OK;
+#endif
+}
+
+/*
+  Set the check of the crc32 of the files read after this call
+*/
+extern int ZEXPORT unzSetCrcPolicy (file, policy)
+    unzFile file;
+    int policy;
+{
+    unz_s* s;
+    int err;
+    if ((file==NULL) ||
+        ((policy!=UNZ_CRC_VERIFY) && (policy!=UNZ_CRC_DEFER) &&
+         (policy!=UNZ_CRC_SKIP)))
+        return UNZ_PARAMERROR;
+    s=(unz_s*)file;
+
+    /* the thread reads with cursors, which need a positional read */
+#ifdef UNZ_CRCTHREAD
+    if ((policy==UNZ_CRC_DEFER) && (s->z_filefunc.zpread_file==NULL))
+        policy = UNZ_CRC_VERIFY;
+#else
+    if (policy==UNZ_CRC_DEFER)
+        policy = UNZ_CRC_VERIFY;
+#endif
+
+    err = unzlocal_WaitCrc(s,policy!=UNZ_CRC_DEFER);
+#ifdef UNZ_CRCTHREAD
+    if (s->crc_queue!=NULL)
+    {
+        pthread_mutex_lock(&s->crc_queue->mutex);
+        s->crc_queue->err = UNZ_OK;
+        pthread_mutex_unlock(&s->crc_queue->mutex);
+    }
+#endif
+    s->crc_policy = policy;
+    return err;
+}
+
+/*
+  crc32 of a buffer which can be larger than an uInt
+*/
+local uLong unzlocal_crc32 OF((uLong crc, const Bytef* buf, ZPOS64_T len));
+
+local uLong unzlocal_crc32 (crc, buf, len)
+    uLong crc;
+    const Bytef* buf;
+    ZPOS64_T len;
+{
+    while (len > 0)
+    {
+        uInt uThis = (len > 0x40000000) ? 0x40000000 : (uInt)len;
+        crc = crc32hw(crc,buf,uThis);
+        buf += uThis;
+        len -= uThis;
+    }
+    return crc;
+}
+
+/*
+  Give in *ppos the position in the zipfile of the data of the current file,
+    which must be stored (not compressed) and not crypted.
+*/
+local int unzlocal_GetStoredDataPos OF((unz_s* s, ZPOS64_T* ppos));
+
+local int unzlocal_GetStoredDataPos (s, ppos)
+    unz_s* s;
+    ZPOS64_T* ppos;
+{
+    uInt iSizeVar;
+    ZPOS64_T offset_local_extrafield;
+    uInt  size_local_extrafield;
+
+    if (!s->current_file_ok)
+        return UNZ_PARAMERROR;
+    if ((s->cur_file_info.compression_method!=0) ||
+        ((s->cur_file_info.flag & 1)!=0))
+        return UNZ_PARAMERROR;
+    if (s->cur_file_info.compressed_size!=s->cur_file_info.uncompressed_size)
+        return UNZ_BADZIPFILE;
+
+    if (unzlocal_CheckFileCoherencyHeader(s,&s->cur_file_info,
+                &s->cur_file_info_internal,&iSizeVar,
+                &offset_local_extrafield,&size_local_extrafield)!=UNZ_OK)
+        return UNZ_BADZIPFILE;
+
+    *ppos = s->cur_file_info_internal.offset_curfile + SIZEZIPLOCALHEADER +
+            iSizeVar + s->byte_before_the_zipfile;
+    return UNZ_OK;
+}
+
+/*
+  Give a pointer on the data of the current file, stored and not crypted,
+    in the zipfile mapped in memory.
+*/
+extern int ZEXPORT unzMapCurrentFile (file, pdata, psize, check_crc)
+    unzFile file;
+    const void** pdata;
+    ZPOS64_T* psize;
+    int check_crc;
+{
+    unz_s* s;
+    ZPOS64_T pos;
+    const void* data;
+    int err;
+
+    if ((file==NULL) || (pdata==NULL) || (psize==NULL))
+        return UNZ_PARAMERROR;
+    s=(unz_s*)file;
+
+    err = unzlocal_GetStoredDataPos(s,&pos);
+    if (err!=UNZ_OK)
+        return err;
+
+    data = ZMAP(s->z_filefunc,s->filestream,pos,
+                s->cur_file_info.uncompressed_size);
+    if (data==NULL)
+        return UNZ_PARAMERROR;
+
+    if ((check_crc) &&
+        (unzlocal_crc32(0L,(const Bytef*)data,
+                        s->cur_file_info.uncompressed_size) !=
+                                                    s->cur_file_info.crc))
+        return UNZ_CRCERROR;
+
+    *pdata = data;
+    *psize = s->cur_file_info.uncompressed_size;
+    return UNZ_OK;
+}
+
+/*
+  Read the data of the current file, stored and not crypted, in buf with a
+    single read.
+*/
+extern int ZEXPORT unzReadCurrentFileStored (file, buf, size_buf, check_crc)
+    unzFile file;
+    voidp buf;
+    ZPOS64_T size_buf;
+    int check_crc;
+{
+    unz_s* s;
+    ZPOS64_T pos;
+    ZPOS64_T rest;
+    char* p = (char*)buf;
+    int err;
+
+    if ((file==NULL) || (buf==NULL))
+        return UNZ_PARAMERROR;
+    s=(unz_s*)file;
+
+    err = unzlocal_GetStoredDataPos(s,&pos);
+    if (err!=UNZ_OK)
+        return err;
+    if (size_buf < s->cur_file_info.uncompressed_size)
+        return UNZ_PARAMERROR;
+
+    /* a single read, unless the file does not fit in an uLong */
+    for (rest = s->cur_file_info.uncompressed_size; rest > 0; )
+    {
+        uLong uThis = (rest > (uLong)-1) ? (uLong)-1 : (uLong)rest;
+        if (unzlocal_ReadAt(&s->z_filefunc,s->filestream,&s->pos_stream,p,uThis,pos)!=uThis)
+            return UNZ_ERRNO;
+        p += uThis;
+        pos += uThis;
+        rest -= uThis;
+    }
+
+    if ((check_crc) &&
+        (unzlocal_crc32(0L,(const Bytef*)buf,
+                        s->cur_file_info.uncompressed_size) !=
+                                                    s->cur_file_info.crc))
+        return UNZ_CRCERROR;
+
+    return UNZ_OK;
+}
+
+/*
+  Give the position of the data of the current file, stored and not crypted
+*/
+extern int ZEXPORT unzGetCurrentFileStoredPos (file, ppos)
+    unzFile file;
+    ZPOS64_T* ppos;
+{
+    if ((file==NULL) || (ppos==NULL))
+        return UNZ_PARAMERROR;
+    return unzlocal_GetStoredDataPos((unz_s*)file,ppos);
+}
+
+
+/*
+  Extract the whole current file in buf, sized from the central dir.
+*/
+extern int ZEXPORT unzExtractCurrentFileToBuffer (file, buf, size_buf, password)
+    unzFile file;
+    voidp buf;
+    ZPOS64_T size_buf;
+    const char* password;
+{
+    unz_s* s;
+    ZPOS64_T pos;
+    ZPOS64_T size;
+    const Bytef* data;
+    unz64_file_pos file_pos;
+    int check_crc;
+    int err;
+
+    if ((file==NULL) || (buf==NULL))
+        return UNZ_PARAMERROR;
+    s=(unz_s*)file;
+    if (!s->current_file_ok)
+        return UNZ_PARAMERROR;
+    size = s->cur_file_info.uncompressed_size;
+    if (size_buf < size)
+        return UNZ_PARAMERROR;
+    check_crc = (s->crc_policy==UNZ_CRC_VERIFY);
+    file_pos.pos_in_zip_directory = s->pos_in_central_dir;
+    file_pos.num_of_file = s->num_file;
+
+    if ((password==NULL) && ((s->cur_file_info.flag & 1)==0))
+    {
+        /* stored : a copy from the mapping, or a single read */
+        if (s->cur_file_info.compression_method==0)
+        {
+            const void* stored;
+            ZPOS64_T size_stored;
+            err = unzMapCurrentFile(file,&stored,&size_stored,check_crc);
+            if (err==UNZ_OK)
+                memcpy(buf,stored,(size_t)size_stored);
+            else if (err==UNZ_PARAMERROR)
+                err = unzReadCurrentFileStored(file,buf,size_buf,check_crc);
+            if ((err==UNZ_OK) && (s->crc_policy==UNZ_CRC_DEFER))
+                err = unzlocal_DeferCrc(s,&file_pos);
+            return err;
+        }
+
+        /* deflated and mapped : inflated in a single inflate(Z_FINISH),
+           from the mapping to buf, without read_buffer */
+        if ((s->cur_file_info.compression_method==Z_DEFLATED) &&
+            (s->cur_file_info.compressed_size <= 0xffffffff) &&
+            (size <= 0xffffffff))
+        {
+            uInt iSizeVar;
+            ZPOS64_T offset_local_extrafield;
+            uInt  size_local_extrafield;
+
+            if (unzlocal_CheckFileCoherencyHeader(s,&s->cur_file_info,
+                        &s->cur_file_info_internal,&iSizeVar,
+                        &offset_local_extrafield,&size_local_extrafield)
+                                                                    !=UNZ_OK)
+                return UNZ_BADZIPFILE;
+            pos = s->cur_file_info_internal.offset_curfile +
+                  SIZEZIPLOCALHEADER + iSizeVar + s->byte_before_the_zipfile;
+
+            data = (const Bytef*)ZMAP(s->z_filefunc,s->filestream,pos,
+                                      s->cur_file_info.compressed_size);
+            if (data!=NULL)
+            {
+                z_stream stream;
+                z_stream* pstream;
+
+                /* the inflate state kept from the last closed current file
+                   is reset rather than a new one allocated */
+                if ((s->pfile_in_zip_read_free!=NULL) &&
+                    (s->pfile_in_zip_read_free->stream_initialised))
+                {
+                    pstream = &s->pfile_in_zip_read_free->stream;
+                    err = inflateReset(pstream);
+                }
+                else
+                {
+                    pstream = &stream;
+                    stream.zalloc = s->zalloc;
+                    stream.zfree = s->zfree;
+                    stream.opaque = s->opaque;
+                    stream.next_in = (Bytef*)0;
+                    stream.avail_in = 0;
+                    err = inflateInit2(&stream, -MAX_WBITS);
+                }
+                if (err!=Z_OK)
+                    return err;
+                pstream->next_in = (Bytef*)data;
+                pstream->avail_in = (uInt)s->cur_file_info.compressed_size;
+                pstream->next_out = (Bytef*)buf;
+                pstream->avail_out = (uInt)size;
+                err = inflate(pstream, Z_FINISH);
+                if (pstream == &stream)
+                    inflateEnd(&stream);
+                if ((err!=Z_STREAM_END) && (err!=Z_OK) && (err!=Z_BUF_ERROR))
+                    return err;
+
+                /* without the dummy byte after the compressed data, an old
+                   zlib may not return Z_STREAM_END (see unzOpenCurrentFile3) :
+                   all the compressed data must then have been used */
+                if ((pstream->total_out != size) ||
+                    ((err != Z_STREAM_END) && (pstream->avail_in != 0)))
+                    return UNZ_BADZIPFILE;
+                if ((check_crc) &&
+                    (unzlocal_crc32(0L,(const Bytef*)buf,size) !=
+                                                    s->cur_file_info.crc))
+                    return UNZ_CRCERROR;
+                if (s->crc_policy==UNZ_CRC_DEFER)
+                    return unzlocal_DeferCrc(s,&file_pos);
+                return UNZ_OK;
+            }
+        }
+    }
+
+    /* else, read with unzReadCurrentFile directly in buf */
+    err = unzOpenCurrentFile3(file,NULL,NULL,0,password);
+    if (err!=UNZ_OK)
+        return err;
+    for (pos = 0; pos < size; )
+    {
+        ZPOS64_T rest = size - pos;
+        int iRead = unzReadCurrentFile(file,(char*)buf+pos,
+                                   (rest > 0x40000000) ? 0x40000000 :
+                                                         (unsigned)rest);
+        if (iRead<=0)
+        {
+            unzCloseCurrentFile(file);
+            return (iRead<0) ? iRead : UNZ_BADZIPFILE;
+        }
+        pos += iRead;
+    }
+    return unzCloseCurrentFile(file);
+}
+
+
+/***************************************************************************/
+/* Extraction of several files in the order of their data in the zipfile */
+
+/* the files whose data are at most UNZ_READAHEADGAP bytes apart are read
+   together, in a single read of at most UNZ_READAHEADMAX bytes */
+#define UNZ_READAHEADGAP (65536)
+#define UNZ_READAHEADMAX (1048576)
+
+/* bytes read after the estimated end of a file, for a local extra field
+   longer than the one of the central dir */
+#define UNZ_READAHEADSLACK (256)
+
+/* a file which cannot be extracted from the memory : unzOpenCurrentFile */
+#define UNZ_BATCH_FALLBACK (1)
+
+typedef struct
+{
+    int index;                  /* in the names given to unzExtractFiles */
+    unz64_file_pos file_pos;
+    unz_file_info64 file_info;
+    unz_file_info_internal file_info_internal;
+} unz_batch_entry;
+
+typedef struct
+{
+    unz_sink_func sink;
+    voidpf opaque;
+    int stop;                   /* the sink returned an error */
+    z_stream stream;            /* inflate state, used for all the files */
+    int stream_initialised;
+    Bytef* out;                 /* output of inflate, UNZ_BUFSIZE bytes */
+    unsigned char* buffer;      /* data of the files read together */
+    uLong size_buffer;
+} unz_batch;
+
+local int unzlocal_BatchCompare OF((const void* p1, const void* p2));
+
+local int unzlocal_BatchCompare (p1, p2)
+    const void* p1;
+    const void* p2;
+{
+    const unz_batch_entry* pentry1 = (const unz_batch_entry*)p1;
+    const unz_batch_entry* pentry2 = (const unz_batch_entry*)p2;
+    ZPOS64_T offset1 = pentry1->file_info_internal.offset_curfile;
+    ZPOS64_T offset2 = pentry2->file_info_internal.offset_curfile;
+
+    if (offset1!=offset2)
+        return (offset1<offset2) ? -1 : 1;
+    return pentry1->index-pentry2->index;
+}
+
+/*
+  Return 1 if the file can be extracted from its data in memory
+*/
+local int unzlocal_BatchInMemory OF((const unz_batch_entry* pentry));
+
+local int unzlocal_BatchInMemory (pentry)
+    const unz_batch_entry* pentry;
+{
+    return ((pentry->file_info.flag & 1)==0) &&
+           ((pentry->file_info.compression_method==0) ||
+            (pentry->file_info.compression_method==Z_DEFLATED));
+}
+
+/*
+  Size of the local header and data of the file, estimated from the
+    central dir
+*/
+local ZPOS64_T unzlocal_BatchSize OF((const unz_batch_entry* pentry));
+
+local ZPOS64_T unzlocal_BatchSize (pentry)
+    const unz_batch_entry* pentry;
+{
+    return SIZEZIPLOCALHEADER + pentry->file_info.size_filename +
+           pentry->file_info.size_file_extra +
+           pentry->file_info.compressed_size;
+}
+
+/*
+  Give the file to the sink from its local header at data (size_data bytes
+    in memory). Return UNZ_BATCH_FALLBACK if not all its data are there
+*/
+local int unzlocal_BatchFromMemory OF((unz_s* s,
+                                       unz_batch* pbatch,
+                                       const unz_batch_entry* pentry,
+                                       const Bytef* data,
+                                       ZPOS64_T size_data));
+
+local int unzlocal_BatchFromMemory (s, pbatch, pentry, data, size_data)
+    unz_s* s;
+    unz_batch* pbatch;
+    const unz_batch_entry* pentry;
+    const Bytef* data;
+    ZPOS64_T size_data;
+{
+    const unz_file_info64* pfile_info = &pentry->file_info;
+    ZPOS64_T rest = pfile_info->compressed_size;
+    ZPOS64_T total_out = 0;
+    uInt iSizeVar;
+    ZPOS64_T offset_local_extrafield;
+    uInt  size_local_extrafield;
+    uLong crc = 0;
+    int err;
+
+    if (size_data<SIZEZIPLOCALHEADER)
+        return UNZ_BATCH_FALLBACK;
+    if (unzlocal_CheckLocalHeader(data,pfile_info,&pentry->file_info_internal,
+                                  &iSizeVar,&offset_local_extrafield,
+                                  &size_local_extrafield)!=UNZ_OK)
+        return UNZ_BADZIPFILE;
+    if (SIZEZIPLOCALHEADER+iSizeVar+rest>size_data)
+        return UNZ_BATCH_FALLBACK;
+    data += SIZEZIPLOCALHEADER+iSizeVar;
+
+    err = (*pbatch->sink)(pbatch->opaque,pentry->index,pfile_info,NULL,0);
+    if (err!=UNZ_OK)
+    {
+        pbatch->stop = 1;
+        return err;
+    }
+
+    if (pfile_info->compression_method==0)
+    {
+        /* stored : the data are given as they are */
+        if (rest!=pfile_info->uncompressed_size)
+            return UNZ_BADZIPFILE;
+        while (rest>0)
+        {
+            uInt uThis = (rest > 0x40000000) ? 0x40000000 : (uInt)rest;
+            if (s->crc_policy!=UNZ_CRC_SKIP)
+                crc = crc32hw(crc,data,uThis);
+            err = (*pbatch->sink)(pbatch->opaque,pentry->index,pfile_info,
+                                  data,uThis);
+            if (err!=UNZ_OK)
+            {
+                pbatch->stop = 1;
+                return err;
+            }
+            data += uThis;
+            rest -= uThis;
+        }
+        total_out = pfile_info->uncompressed_size;
+    }
+    else
+    {
+        if (!pbatch->stream_initialised)
+        {
+            pbatch->stream.zalloc = s->zalloc;
+            pbatch->stream.zfree = s->zfree;
+            pbatch->stream.opaque = s->opaque;
+            pbatch->stream.next_in = (Bytef*)0;
+            pbatch->stream.avail_in = 0;
+            if (inflateInit2(&pbatch->stream,-MAX_WBITS)!=Z_OK)
+                return UNZ_INTERNALERROR;
+            pbatch->stream_initialised = 1;
+        }
+        else
+            inflateReset(&pbatch->stream);
+
+        for (;;)
+        {
+            uInt uOut;
+            int zerr;
+
+            if ((pbatch->stream.avail_in==0) && (rest>0))
+            {
+                uInt uThis = (rest > 0x40000000) ? 0x40000000 : (uInt)rest;
+                pbatch->stream.next_in = (Bytef*)data;
+                pbatch->stream.avail_in = uThis;
+                data += uThis;
+                rest -= uThis;
+            }
+            pbatch->stream.next_out = pbatch->out;
+            pbatch->stream.avail_out = UNZ_BUFSIZE;
+            zerr = inflate(&pbatch->stream,Z_NO_FLUSH);
+            if ((zerr!=Z_OK) && (zerr!=Z_STREAM_END) && (zerr!=Z_BUF_ERROR))
+                return UNZ_BADZIPFILE;
+
+            uOut = UNZ_BUFSIZE-pbatch->stream.avail_out;
+            if (uOut>0)
+            {
+                if (s->crc_policy!=UNZ_CRC_SKIP)
+                    crc = crc32hw(crc,pbatch->out,uOut);
+                err = (*pbatch->sink)(pbatch->opaque,pentry->index,pfile_info,
+                                      pbatch->out,uOut);
+                if (err!=UNZ_OK)
+                {
+                    pbatch->stop = 1;
+                    return err;
+                }
+                total_out += uOut;
+            }
+
+            /* without the dummy byte after the compressed data, an old zlib
+               may not return Z_STREAM_END : all the input is then used */
+            if (zerr==Z_STREAM_END)
+                break;
+            if ((uOut==0) && (pbatch->stream.avail_in==0) && (rest==0))
+                break;
+        }
+    }
+
+    if (total_out!=pfile_info->uncompressed_size)
+        return UNZ_BADZIPFILE;
+    if ((s->crc_policy!=UNZ_CRC_SKIP) && (crc!=pfile_info->crc))
+        return UNZ_CRCERROR;
+    return UNZ_OK;
+}
+
+/*
+  Give the file to the sink, read with unzOpenCurrentFile
+*/
+local int unzlocal_BatchFromFile OF((unz_s* s,
+                                     unz_batch* pbatch,
+                                     const unz_batch_entry* pentry));
+
+local int unzlocal_BatchFromFile (s, pbatch, pentry)
+    unz_s* s;
+    unz_batch* pbatch;
+    const unz_batch_entry* pentry;
+{
+    unzFile file = (unzFile)s;
+    int iRead;
+    int err;
+
+    err = unzGoToFilePos64(file,&pentry->file_pos);
+    if (err==UNZ_OK)
+        err = unzOpenCurrentFile(file);
+    if (err!=UNZ_OK)
+        return err;
+
+    err = (*pbatch->sink)(pbatch->opaque,pentry->index,&pentry->file_info,
+                          NULL,0);
+    while (err==UNZ_OK)
+    {
+        iRead = unzReadCurrentFile(file,pbatch->out,UNZ_BUFSIZE);
+        if (iRead<=0)
+        {
+            err = unzCloseCurrentFile(file);
+            return (iRead<0) ? iRead : err;
+        }
+        err = (*pbatch->sink)(pbatch->opaque,pentry->index,&pentry->file_info,
+                              pbatch->out,(uLong)iRead);
+    }
+
+    pbatch->stop = 1;
+    unzCloseCurrentFile(file);
+    return err;
+}
+
+extern int ZEXPORT unzExtractFiles (file, names, number, iCaseSensitivity,
+                                    sink, opaque, results)
+    unzFile file;
+    const char* const* names;
+    int number;
+    int iCaseSensitivity;
+    unz_sink_func sink;
+    voidpf opaque;
+    int* results;
+{
+    unz_s* s;
+    unz_batch batch;
+    unz_batch_entry* entries = NULL;
+    int number_found = 0;
+    int number_done = 0;
+    int i;
+    int err=UNZ_OK;
+
+    if ((file==NULL) || (sink==NULL) || (number<0) ||
+        ((names==NULL) && (number>0)))
+        err = UNZ_PARAMERROR;
+    /* every file fails until it is extracted, the early returns included */
+    if (results!=NULL)
+        for (i=0;i<number;i++)
+            results[i] = (err!=UNZ_OK) ? err : UNZ_INTERNALERROR;
+    if (err!=UNZ_OK)
+        return err;
+    s=(unz_s*)file;
+    if (number==0)
+        return UNZ_OK;
+
+    entries = (unz_batch_entry*)ALLOC(number*sizeof(unz_batch_entry));
+    memset(&batch,0,sizeof(batch));
+    batch.sink = sink;
+    batch.opaque = opaque;
+    batch.out = (Bytef*)ALLOC(UNZ_BUFSIZE);
+    if ((entries==NULL) || (batch.out==NULL))
+    {
+        TRYFREE(entries);
+        TRYFREE(batch.out);
+        return UNZ_INTERNALERROR;
+    }
+
+    /* the files are found from the central dir, then sorted by the
+       position of their local header */
+    for (i=0;i<number;i++)
+    {
+        unz_batch_entry* pentry = &entries[number_found];
+        int r = unzLocateFile(file,names[i],iCaseSensitivity);
+        if (r==UNZ_OK)
+            r = unzGetFilePos64(file,&pentry->file_pos);
+        if (results!=NULL)
+            results[i] = r;
+        if (r!=UNZ_OK)
+        {
+            if (err==UNZ_OK)
+                err = r;
+            continue;
+        }
+        pentry->index = i;
+        pentry->file_info = s->cur_file_info;
+        pentry->file_info_internal = s->cur_file_info_internal;
+        number_found++;
+    }
+    qsort(entries,number_found,sizeof(unz_batch_entry),unzlocal_BatchCompare);
+
+    for (i=0;(i<number_found) && (!batch.stop);)
+    {
+        ZPOS64_T start = entries[i].file_info_internal.offset_curfile +
+                         s->byte_before_the_zipfile;
+        ZPOS64_T end = start + unzlocal_BatchSize(&entries[i]);
+        ZPOS64_T size_data = 0;
+        const Bytef* data = NULL;
+        int j = i+1;
+        int k;
+
+        /* the next files near this one are read with it */
+        if (unzlocal_BatchInMemory(&entries[i]))
+            while ((j<number_found) && (unzlocal_BatchInMemory(&entries[j])))
+            {
+                ZPOS64_T start_next =
+                        entries[j].file_info_internal.offset_curfile +
+                        s->byte_before_the_zipfile;
+                ZPOS64_T end_next = start_next +
+                                    unzlocal_BatchSize(&entries[j]);
+                if (end_next<end)
+                    end_next = end;
+                if ((start_next>end+UNZ_READAHEADGAP) ||
+                    (end_next+UNZ_READAHEADSLACK-start>UNZ_READAHEADMAX))
+                    break;
+                end = end_next;
+                j++;
+            }
+
+        if (unzlocal_BatchInMemory(&entries[i]))
+        {
+            /* a mapped zipfile is used as it is, else the files are read
+               with a single read */
+            size_data = end+UNZ_READAHEADSLACK-start;
+            data = (const Bytef*)ZMAP(s->z_filefunc,s->filestream,
+                                      start,size_data);
+            if (data==NULL)
+            {
+                size_data = end-start;
+                data = (const Bytef*)ZMAP(s->z_filefunc,s->filestream,
+                                          start,size_data);
+            }
+            if ((data==NULL) &&
+                (end+UNZ_READAHEADSLACK-start<=UNZ_READAHEADMAX))
+            {
+                uLong uSize = (uLong)(end+UNZ_READAHEADSLACK-start);
+                uLong uRead;
+                if (batch.size_buffer<uSize)
+                {
+                    TRYFREE(batch.buffer);
+                    batch.buffer = (unsigned char*)ALLOC(uSize);
+                    batch.size_buffer = (batch.buffer!=NULL) ? uSize : 0;
+                }
+                if (batch.buffer!=NULL)
+                {
+                    uRead = unzlocal_ReadAt(&s->z_filefunc,s->filestream,
+                                            &s->pos_stream,batch.buffer,
+                                            uSize,start);
+                    if ((uRead>0) && (uRead<=uSize))
+                    {
+                        data = batch.buffer;
+                        size_data = uRead;
+                    }
+                }
+            }
+        }
+
+        for (k=i;(k<j) && (!batch.stop);k++)
+        {
+            int r = UNZ_BATCH_FALLBACK;
+            if (data!=NULL)
+            {
+                ZPOS64_T offset =
+                        entries[k].file_info_internal.offset_curfile +
+                        s->byte_before_the_zipfile - start;
+                r = unzlocal_BatchFromMemory(s,&batch,&entries[k],
+                                             data+offset,size_data-offset);
+            }
+            if (r==UNZ_BATCH_FALLBACK)
+                r = unzlocal_BatchFromFile(s,&batch,&entries[k]);
+            if (results!=NULL)
+                results[entries[k].index] = r;
+            if ((err==UNZ_OK) || (batch.stop))
+                err = r;
+            number_done = k+1;
+        }
+        i = j;
+    }
+
+    /* the files not extracted after a stop of the sink */
+    for (i=number_done;(i<number_found) && (results!=NULL);i++)
+        results[entries[i].index] = err;
+
+    if (batch.stream_initialised)
+        inflateEnd(&batch.stream);
+    TRYFREE(batch.buffer);
+    TRYFREE(batch.out);
+    TRYFREE(entries);
+    return err;
+}
+
+
+/*
+  Get the global comment string of the ZipFile, in the szComment buffer.
+  uSizeBuf is the size of the szComment buffer.
+  return the number of byte copied or an error code <0
+*/
+extern int ZEXPORT unzGetGlobalComment (file, szComment, uSizeBuf)
+    unzFile file;
+    char *szComment;
+    uLong uSizeBuf;
+{
+    /* int err=UNZ_OK; */
+    unz_s* s;
+    uLong uReadThis ;
+    if (file==NULL)
+        return UNZ_PARAMERROR;
+    s=(unz_s*)file;
+
+    uReadThis = uSizeBuf;
+    if (uReadThis>s->gi.size_comment)
+        uReadThis = s->gi.size_comment;
+
+    if (uReadThis>0)
+    {
+      *szComment='\0';
+      if (unzlocal_ReadAt(&s->z_filefunc,s->filestream,&s->pos_stream,
+                          szComment,uReadThis,s->central_pos+22)!=uReadThis)
+        return UNZ_ERRNO;
+    }
+
+    if ((szComment != NULL) && (uSizeBuf > s->gi.size_comment))
+        *(szComment+s->gi.size_comment)='\0';
+    return (int)uReadThis;
+}
+
+/* Additions by RX '2004 */
+extern ZPOS64_T ZEXPORT unzGetOffset64 (file)
+    unzFile file;
+{
+    unz_s* s;
+
+    if (file==NULL)
+          return 0;
+    s=(unz_s*)file;
+    if (!s->current_file_ok)
+      return 0;
+    if (s->gi.number_entry != 0 && ((s->zip64) || (s->gi.number_entry != 0xffff)))
+      if (s->num_file==s->gi.number_entry)
+         return 0;
+    return s->pos_in_central_dir;
+}
+
+extern uLong ZEXPORT unzGetOffset (file)
+    unzFile file;
+{
+    if (file==NULL)
+          return UNZ_PARAMERROR;
+    return (uLong)unzGetOffset64(file);
+}
+
+extern int ZEXPORT unzSetOffset64 (file, pos)
+        unzFile file;
+        ZPOS64_T pos;
+{
+    unz_s* s;
+    int err;
+
+    if (file==NULL)
+        return UNZ_PARAMERROR;
+    s=(unz_s*)file;
+
+    s->pos_in_central_dir = pos;
+    s->num_file = s->gi.number_entry;      /* hack */
+    err = unzlocal_GetCurrentFileInfoInternal(file,&s->cur_file_info,
+                                              &s->cur_file_info_internal,
+                                              NULL,0,NULL,0,NULL,0);
+    s->current_file_ok = (err == UNZ_OK);
+    return err;
+}
+
+extern int ZEXPORT unzSetOffset (file, pos)
+        unzFile file;
+        uLong pos;
+{
+    return unzSetOffset64(file,pos);
+}
+
+/***************************************************************************/
+/* Forward-only reading of the local headers, for the streams which cannot
+   seek : the central dir is never read, the files are found one after the
+   other from their local header, and the end of their data from the
+   deflate stream or from the data descriptor (bit 3 of the flag). */
+
+/* the buffer is large enough for a local header with the longest filename
+   and extra field */
+#define UNZ_STREAM_BUFSIZE (0x21000)
+
+/* a data descriptor is at most its signature, the crc and two 8 bytes sizes */
+#define SIZEDATADESCRIPTOR64 (24)
+
+#define UNZ_STREAM_AVAIL(s) ((s)->filled_buffer-(s)->pos_buffer)
+
+typedef struct
+{
+    zlib_filefunc_def z_filefunc;
+    voidpf filestream;          /* io structore of the zipfile */
+    int close_stream;           /* 1 if unzStreamClose closes filestream */
+    unsigned char* buffer;      /* bytes read from filestream */
+    uLong pos_buffer;           /* first byte of buffer not yet used */
+    uLong filled_buffer;        /* number of bytes read in buffer */
+    int eof;                    /* 1 when filestream has no more bytes */
+    ZPOS64_T num_file;          /* number of the local headers read */
+
+    z_stream stream;            /* inflate state, used for all the files */
+    int stream_initialised;
+    int stream_end;             /* the deflate stream of the file ended */
+
+    unz_file_info64 cur_file_info; /* info about the current file */
+    int current_file_ok;        /* 1 until the data of the file are skipped */
+    int zip64;                  /* the local header has 0xffffffff sizes */
+    int size_known;             /* the compressed size is in the header */
+    ZPOS64_T rest_read_compressed; /* compressed bytes left, if size_known */
+    ZPOS64_T total_in;          /* compressed bytes used */
+    ZPOS64_T total_out;         /* uncompressed bytes given */
+    uLong crc32;                /* crc32 of the bytes given */
+    int end_of_data;            /* all the data (and descriptor) are read */
+    int err;                    /* returned at the end of the data */
+} unz_stream_s;
+
+/*
+  Read more bytes of the stream after the ones not yet used, moved to the
+    start of the buffer. Return the number of bytes read, 0 at the end of
+    the stream, or UNZ_ERRNO
+*/
+local int unzlocal_StreamFill OF((unz_stream_s* s));
+
+local int unzlocal_StreamFill (s)
+    unz_stream_s* s;
+{
+    uLong uRead;
+
+    if (s->pos_buffer>0)
+    {
+        if (s->filled_buffer>s->pos_buffer)
+            memmove(s->buffer,s->buffer+s->pos_buffer,
+                    (size_t)UNZ_STREAM_AVAIL(s));
+        s->filled_buffer -= s->pos_buffer;
+        s->pos_buffer = 0;
+    }
+    if ((s->eof) || (s->filled_buffer==UNZ_STREAM_BUFSIZE))
+        return 0;
+
+    uRead = ZREAD(s->z_filefunc,s->filestream,s->buffer+s->filled_buffer,
+                  UNZ_STREAM_BUFSIZE-s->filled_buffer);
+    if ((uRead==0) || (uRead>UNZ_STREAM_BUFSIZE-s->filled_buffer))
+    {
+        s->eof = 1;
+        if (ZERROR(s->z_filefunc,s->filestream))
+            return UNZ_ERRNO;
+        return 0;
+    }
+    s->filled_buffer += uRead;
+    return (int)uRead;
+}
+
+/*
+  Make sure that at least size bytes are in the buffer. Return UNZ_OK,
+    UNZ_EOF if the stream ends before, or UNZ_ERRNO
+*/
+local int unzlocal_StreamNeed OF((unz_stream_s* s, uLong size));
+
+local int unzlocal_StreamNeed (s, size)
+    unz_stream_s* s;
+    uLong size;
+{
+    while (UNZ_STREAM_AVAIL(s)<size)
+    {
+        int err = unzlocal_StreamFill(s);
+        if (err<0)
+            return UNZ_ERRNO;
+        if (err==0)
+            return UNZ_EOF;
+    }
+    return UNZ_OK;
+}
+
+/*
+  Return the size of the sizes (4 or 8) of the data descriptor without its
+    signature at p (avail bytes), if its compressed size is total_in, else 0
+*/
+local uLong unzlocal_StreamMatchDescriptor OF((const unsigned char* p,
+                                               uLong avail,
+                                               int zip64,
+                                               ZPOS64_T total_in));
+
+local uLong unzlocal_StreamMatchDescriptor (p, avail, zip64, total_in)
+    const unsigned char* p;
+    uLong avail;
+    int zip64;
+    ZPOS64_T total_in;
+{
+    int match32 = (avail>=12) &&
+                  (unzlocal_bufLong(p+4)==(uLong)(total_in&0xffffffff));
+    int match64 = (avail>=20) && (unzlocal_bufLong64(p+4)==total_in);
+
+    /* the Zip64 files have 8 bytes sizes, but some writers do not follow
+       this, so the other size is tried too */
+    if ((zip64) && (match64))
+        return 8;
+    if (match32)
+        return 4;
+    if (match64)
+        return 8;
+    return 0;
+}
+
+/*
+  Read the data descriptor after the data of the current file, and set the
+    crc and sizes of cur_file_info from it
+*/
+local int unzlocal_StreamReadDescriptor OF((unz_stream_s* s));
+
+local int unzlocal_StreamReadDescriptor (s)
+    unz_stream_s* s;
+{
+    const unsigned char* p;
+    uLong avail;
+    uLong size_sizes=0;
+
+    if (unzlocal_StreamNeed(s,SIZEDATADESCRIPTOR64)==UNZ_ERRNO)
+        return UNZ_ERRNO;
+    p = s->buffer+s->pos_buffer;
+    avail = UNZ_STREAM_AVAIL(s);
+
+    /* the signature is optional, and could be the crc too */
+    if ((avail>=4) && (unzlocal_bufLong(p)==0x08074b50))
+    {
+        size_sizes = unzlocal_StreamMatchDescriptor(p+4,avail-4,s->zip64,
+                                                    s->total_in);
+        if (size_sizes!=0)
+        {
+            p += 4;
+            avail -= 4;
+            s->pos_buffer += 4;
+        }
+    }
+    if (size_sizes==0)
+        size_sizes = unzlocal_StreamMatchDescriptor(p,avail,s->zip64,
+                                                    s->total_in);
+    if (size_sizes==0)
+        return UNZ_BADZIPFILE;
+
+    s->cur_file_info.crc = unzlocal_bufLong(p);
+    if (size_sizes==8)
+    {
+        s->cur_file_info.compressed_size = unzlocal_bufLong64(p+4);
+        s->cur_file_info.uncompressed_size = unzlocal_bufLong64(p+12);
+    }
+    else
+    {
+        s->cur_file_info.compressed_size = unzlocal_bufLong(p+4);
+        s->cur_file_info.uncompressed_size = unzlocal_bufLong(p+8);
+    }
+    s->pos_buffer += 4+2*size_sizes;
+    return UNZ_OK;
+}
+
+/*
+  Drop the compressed bytes left of the current file, when its size is known
+*/
+local int unzlocal_StreamDiscard OF((unz_stream_s* s));
+
+local int unzlocal_StreamDiscard (s)
+    unz_stream_s* s;
+{
+    while (s->rest_read_compressed>0)
+    {
+        uLong uSkip = UNZ_STREAM_AVAIL(s);
+        if (uSkip==0)
+        {
+            int err = unzlocal_StreamNeed(s,1);
+            if (err==UNZ_ERRNO)
+                return err;
+            if (err!=UNZ_OK)
+                return UNZ_BADZIPFILE;
+            uSkip = UNZ_STREAM_AVAIL(s);
+        }
+        if ((ZPOS64_T)uSkip>s->rest_read_compressed)
+            uSkip = (uLong)s->rest_read_compressed;
+        s->pos_buffer += uSkip;
+        s->rest_read_compressed -= uSkip;
+        s->total_in += uSkip;
+    }
+    return UNZ_OK;
+}
+
+/*
+  Called when all the data of the current file are read : read the data
+    descriptor if any, and check the crc and the uncompressed size
+*/
+local int unzlocal_StreamEndOfData OF((unz_stream_s* s));
+
+local int unzlocal_StreamEndOfData (s)
+    unz_stream_s* s;
+{
+    int err=UNZ_OK;
+
+    s->end_of_data = 1;
+    err = unzlocal_StreamDiscard(s);
+    if ((err==UNZ_OK) && ((s->cur_file_info.flag & 8)!=0))
+        err = unzlocal_StreamReadDescriptor(s);
+    if (err==UNZ_OK)
+    {
+        if (s->cur_file_info.uncompressed_size!=s->total_out)
+            err = UNZ_BADZIPFILE;
+        else if (s->cur_file_info.crc!=s->crc32)
+            err = UNZ_CRCERROR;
+    }
+    s->err = err;
+    return err;
+}
+
+/*
+  Give at most len bytes of a stored file whose size is not known, stopping
+    before the data descriptor, found from its signature and its sizes equal
+    to the number of bytes before it. Return the number of bytes given, 0 at
+    the descriptor, or an error
+*/
+local int unzlocal_StreamScanStored OF((unz_stream_s* s,
+                                        voidp buf,
+                                        uLong len));
+
+local int unzlocal_StreamScanStored (s, buf, len)
+    unz_stream_s* s;
+    voidp buf;
+    uLong len;
+{
+    const unsigned char* p;
+    const unsigned char* next;
+    uLong avail;
+    uLong i=0;
+    uLong uGive;
+    int err;
+
+    err = unzlocal_StreamNeed(s,SIZEDATADESCRIPTOR64);
+    if (err==UNZ_ERRNO)
+        return err;
+    if (err!=UNZ_OK)
+        return UNZ_BADZIPFILE;
+
+    /* the descriptor can only start where all its bytes are in the buffer */
+    p = s->buffer+s->pos_buffer;
+    avail = UNZ_STREAM_AVAIL(s);
+    while (i+SIZEDATADESCRIPTOR64<=avail)
+    {
+        next = (const unsigned char*)memchr(p+i,0x50,
+                                            avail-SIZEDATADESCRIPTOR64+1-i);
+        if (next==NULL)
+        {
+            i = avail-SIZEDATADESCRIPTOR64+1;
+            break;
+        }
+        i = (uLong)(next-p);
+        if ((unzlocal_bufLong(p+i)==0x08074b50) &&
+            (unzlocal_StreamMatchDescriptor(p+i+4,avail-i-4,s->zip64,
+                                            s->total_in+i)!=0))
+        {
+            const unsigned char* q = p+i+4;
+            ZPOS64_T total = s->total_in+i;
+            if ((unzlocal_bufLong(q+8)==(uLong)(total&0xffffffff)) ||
+                (unzlocal_bufLong64(q+12)==total))
+                break;
+        }
+        i++;
+    }
+
+    uGive = (i<len) ? i : len;
+    if (uGive>0)
+    {
+        memcpy(buf,p,(size_t)uGive);
+        s->pos_buffer += uGive;
+        s->total_in += uGive;
+    }
+    return (int)uGive;
+}
+
+/*
+  Give at most len bytes of the current file. Return the number of bytes
+    given, 0 at the end of the data, or an error
+*/
+local int unzlocal_StreamRead OF((unz_stream_s* s, voidp buf, uLong len));
+
+local int unzlocal_StreamRead (s, buf, len)
+    unz_stream_s* s;
+    voidp buf;
+    uLong len;
+{
+    int err;
+
+    if (s->cur_file_info.compression_method==0)
+    {
+        if (!s->size_known)
+            return unzlocal_StreamScanStored(s,buf,len);
+
+        if ((ZPOS64_T)len>s->rest_read_compressed)
+            len = (uLong)s->rest_read_compressed;
+        if (len==0)
+            return 0;
+        if (UNZ_STREAM_AVAIL(s)==0)
+        {
+            /* large reads go to the caller buffer without a copy */
+            if (len>=UNZ_STREAM_BUFSIZE/2)
+            {
+                uLong uRead = s->eof ? 0 :
+                              ZREAD(s->z_filefunc,s->filestream,buf,len);
+                if ((uRead==0) || (uRead>len))
+                {
+                    s->eof = 1;
+                    if (ZERROR(s->z_filefunc,s->filestream))
+                        return UNZ_ERRNO;
+                    return UNZ_BADZIPFILE;
+                }
+                s->rest_read_compressed -= uRead;
+                s->total_in += uRead;
+                return (int)uRead;
+            }
+            err = unzlocal_StreamNeed(s,1);
+            if (err==UNZ_ERRNO)
+                return err;
+            if (err!=UNZ_OK)
+                return UNZ_BADZIPFILE;
+        }
+        if (len>UNZ_STREAM_AVAIL(s))
+            len = UNZ_STREAM_AVAIL(s);
+        memcpy(buf,s->buffer+s->pos_buffer,(size_t)len);
+        s->pos_buffer += len;
+        s->rest_read_compressed -= len;
+        s->total_in += len;
+        return (int)len;
+    }
+
+    if (s->stream_end)
+        return 0;
+    s->stream.next_out = (Bytef*)buf;
+    s->stream.avail_out = (uInt)len;
+    while (s->stream.avail_out>0)
+    {
+        uLong uAvail;
+        uLong uUsed;
+
+        if ((s->size_known) && (s->rest_read_compressed==0))
+            break;
+        if (UNZ_STREAM_AVAIL(s)==0)
+        {
+            err = unzlocal_StreamNeed(s,1);
+            if (err==UNZ_ERRNO)
+                return err;
+            if (err!=UNZ_OK)
+                return UNZ_BADZIPFILE;
+        }
+
+        uAvail = UNZ_STREAM_AVAIL(s);
+        if ((s->size_known) && ((ZPOS64_T)uAvail>s->rest_read_compressed))
+            uAvail = (uLong)s->rest_read_compressed;
+        s->stream.next_in = (Bytef*)s->buffer+s->pos_buffer;
+        s->stream.avail_in = (uInt)uAvail;
+
+        err = inflate(&s->stream,Z_SYNC_FLUSH);
+
+        uUsed = uAvail-s->stream.avail_in;
+        s->pos_buffer += uUsed;
+        s->total_in += uUsed;
+        if (s->size_known)
+            s->rest_read_compressed -= uUsed;
+
+        if (err==Z_STREAM_END)
+        {
+            /* without the size, the end of the deflate stream is the end
+               of the data */
+            s->stream_end = 1;
+            if (!s->size_known)
+            {
+                s->size_known = 1;
+                s->rest_read_compressed = 0;
+            }
+            break;
+        }
+        if ((err!=Z_OK) && (err!=Z_BUF_ERROR))
+            return UNZ_BADZIPFILE;
+    }
+    return (int)(len-s->stream.avail_out);
+}
+
+/*
+  Open a zipfile for the forward-only reading of its local headers
+*/
+local unzStream unzlocal_StreamOpen OF((zlib_filefunc_def* pzlib_filefunc_def,
+                                        voidpf filestream,
+                                        int close_stream));
+
+local unzStream unzlocal_StreamOpen (pzlib_filefunc_def, filestream,
+                                     close_stream)
+    zlib_filefunc_def* pzlib_filefunc_def;
+    voidpf filestream;
+    int close_stream;
+{
+    unz_stream_s* s;
+
+    s = (unz_stream_s*)ALLOC(sizeof(unz_stream_s));
+    if (s!=NULL)
+    {
+        memset(s,0,sizeof(unz_stream_s));
+        s->buffer = (unsigned char*)ALLOC(UNZ_STREAM_BUFSIZE);
+        if (s->buffer==NULL)
+        {
+            TRYFREE(s);
+            s = NULL;
+        }
+    }
+    if (s==NULL)
+    {
+        if (close_stream)
+            ZCLOSE(*pzlib_filefunc_def,filestream);
+        return NULL;
+    }
+
+    s->z_filefunc = *pzlib_filefunc_def;
+    s->filestream = filestream;
+    s->close_stream = close_stream;
+    return (unzStream)s;
+}
+
+extern unzStream ZEXPORT unzStreamOpen (path, pzlib_filefunc_def)
+    const char *path;
+    zlib_filefunc_def* pzlib_filefunc_def;
+{
+    zlib_filefunc_def z_filefunc;
+    voidpf filestream;
+
+    if (pzlib_filefunc_def==NULL)
+        fill_fopen_filefunc(&z_filefunc);
+    else
+        z_filefunc = *pzlib_filefunc_def;
+
+    filestream = (*(z_filefunc.zopen_file))(z_filefunc.opaque,path,
+                                            ZLIB_FILEFUNC_MODE_READ |
+                                            ZLIB_FILEFUNC_MODE_EXISTING);
+    if (filestream==NULL)
+        return NULL;
+    return unzlocal_StreamOpen(&z_filefunc,filestream,1);
+}
+
+extern unzStream ZEXPORT unzStreamOpen2 (pzlib_filefunc_def, filestream)
+    zlib_filefunc_def* pzlib_filefunc_def;
+    voidpf filestream;
+{
+    if ((pzlib_filefunc_def==NULL) || (filestream==NULL))
+        return NULL;
+    return unzlocal_StreamOpen(pzlib_filefunc_def,filestream,0);
+}
+
+/*
+  Skip what is left of the data of the current file, and its descriptor
+*/
+local int unzlocal_StreamSkipFile OF((unz_stream_s* s));
+
+local int unzlocal_StreamSkipFile (s)
+    unz_stream_s* s;
+{
+    int err=UNZ_OK;
+
+    s->current_file_ok = 0;
+    if (s->end_of_data)
+        return (s->err==UNZ_CRCERROR) ? UNZ_OK : s->err;
+
+    if (s->size_known)
+    {
+        /* the compressed bytes are dropped without being decompressed */
+        err = unzlocal_StreamDiscard(s);
+        if ((err==UNZ_OK) && ((s->cur_file_info.flag & 8)!=0))
+            err = unzlocal_StreamReadDescriptor(s);
+    }
+    else
+    {
+        /* the end of the data is only known by reading them */
+        char buf[UNZ_BUFSIZE];
+        do
+        {
+            err = unzlocal_StreamRead(s,buf,UNZ_BUFSIZE);
+            if (err>0)
+                s->total_out += (uLong)err;
+        } while (err>0);
+        if (err==0)
+            err = (s->cur_file_info.flag & 8)!=0 ?
+                  unzlocal_StreamReadDescriptor(s) : UNZ_OK;
+    }
+
+    s->end_of_data = 1;
+    s->err = err;
+    return err;
+}
+
+extern int ZEXPORT unzStreamNextFile (file, pfile_info, szFileName,
+                                      fileNameBufferSize)
+    unzStream file;
+    unz_file_info64* pfile_info;
+    char* szFileName;
+    uLong fileNameBufferSize;
+{
+    unz_stream_s* s;
+    unz_file_info64 file_info;
+    const unsigned char* p;
+    uLong uMagic;
+    ZPOS64_T offset_curfile=0;
+    int err;
+
+    if (file==NULL)
+        return UNZ_PARAMERROR;
+    s=(unz_stream_s*)file;
+
+    if (s->current_file_ok)
+    {
+        err = unzlocal_StreamSkipFile(s);
+        if (err!=UNZ_OK)
+            return err;
+    }
+    else if ((s->num_file>0) && (s->err!=UNZ_OK) && (s->err!=UNZ_CRCERROR))
+        return s->err;
+
+    err = unzlocal_StreamNeed(s,4);
+    if (err==UNZ_ERRNO)
+        return err;
+    if (err!=UNZ_OK)
+        return UNZ_STREAM_AVAIL(s)==0 ? UNZ_END_OF_LIST_OF_FILE
+                                      : UNZ_BADZIPFILE;
+
+    uMagic = unzlocal_bufLong(s->buffer+s->pos_buffer);
+    if ((s->num_file==0) && ((uMagic==0x08074b50) || (uMagic==0x30304b50)))
+    {
+        /* marker of a spanned archive on a single disk */
+        s->pos_buffer += 4;
+        err = unzlocal_StreamNeed(s,4);
+        if (err==UNZ_ERRNO)
+            return err;
+        if (err!=UNZ_OK)
+            return UNZ_BADZIPFILE;
+        uMagic = unzlocal_bufLong(s->buffer+s->pos_buffer);
+    }
+
+    /* the central dir (or the end of central dir of an archive without
+       files) is after the last local header */
+    if ((uMagic==0x02014b50) || (uMagic==0x06054b50) || (uMagic==0x06064b50))
+        return UNZ_END_OF_LIST_OF_FILE;
+    if (uMagic!=0x04034b50)
+        return UNZ_BADZIPFILE;
+
+    err = unzlocal_StreamNeed(s,SIZEZIPLOCALHEADER);
+    if (err==UNZ_ERRNO)
+        return err;
+    if (err!=UNZ_OK)
+        return UNZ_BADZIPFILE;
+
+    p = s->buffer+s->pos_buffer;
+    memset(&file_info,0,sizeof(file_info));
+    file_info.version_needed = unzlocal_bufShort(p+4);
+    file_info.flag = unzlocal_bufShort(p+6);
+    file_info.compression_method = unzlocal_bufShort(p+8);
+    file_info.dosDate = unzlocal_bufLong(p+10);
+    file_info.crc = unzlocal_bufLong(p+14);
+    file_info.compressed_size = unzlocal_bufLong(p+18);
+    file_info.uncompressed_size = unzlocal_bufLong(p+22);
+    file_info.size_filename = unzlocal_bufShort(p+26);
+    file_info.size_file_extra = unzlocal_bufShort(p+28);
+
+    err = unzlocal_StreamNeed(s,SIZEZIPLOCALHEADER+file_info.size_filename+
+                                file_info.size_file_extra);
+    if (err==UNZ_ERRNO)
+        return err;
+    if (err!=UNZ_OK)
+        return UNZ_BADZIPFILE;
+    p = s->buffer+s->pos_buffer;
+
+    s->zip64 = (file_info.compressed_size==0xffffffff) ||
+               (file_info.uncompressed_size==0xffffffff);
+    err = unzlocal_DecodeZip64Extra(p+SIZEZIPLOCALHEADER+
+                                    file_info.size_filename,
+                                    file_info.size_file_extra,
+                                    &file_info,&offset_curfile);
+    if (err!=UNZ_OK)
+        return err;
+    unzlocal_DosDateToTmuDate(file_info.dosDate,&file_info.tmu_date);
+
+    if (szFileName!=NULL)
+    {
+        uLong uSizeRead = file_info.size_filename;
+        if (uSizeRead<fileNameBufferSize)
+            *(szFileName+uSizeRead)='\0';
+        else
+            uSizeRead = fileNameBufferSize;
+        if (uSizeRead>0)
+            memcpy(szFileName,p+SIZEZIPLOCALHEADER,(size_t)uSizeRead);
+    }
+
+    s->pos_buffer += SIZEZIPLOCALHEADER+file_info.size_filename+
+                     file_info.size_file_extra;
+    s->num_file++;
+
+    /* with the bit 3, the crc and sizes of the header are usually 0, and
+       the end of the data is found from the deflate stream, or the data
+       descriptor of a stored file */
+    s->cur_file_info = file_info;
+    s->size_known = ((file_info.flag & 8)==0) ||
+                    (file_info.compressed_size!=0);
+    s->rest_read_compressed = file_info.compressed_size;
+    s->total_in = 0;
+    s->total_out = 0;
+    s->crc32 = 0;
+    s->end_of_data = 0;
+    s->err = UNZ_OK;
+    s->current_file_ok = 1;
+
+    if ((!s->size_known) &&
+        (((file_info.flag & 1)!=0) ||
+         ((file_info.compression_method!=0) &&
+          (file_info.compression_method!=Z_DEFLATED))))
+    {
+        /* the end of the data cannot be found */
+        s->current_file_ok = 0;
+        s->end_of_data = 1;
+        s->err = UNZ_BADZIPFILE;
+        return UNZ_BADZIPFILE;
+    }
+
+    if (file_info.compression_method==Z_DEFLATED)
+    {
+        if (!s->stream_initialised)
+        {
+            s->stream.zalloc = (alloc_func)0;
+            s->stream.zfree = (free_func)0;
+            s->stream.opaque = (voidpf)0;
+            s->stream.next_in = (voidpf)0;
+            s->stream.avail_in = 0;
+            if (inflateInit2(&s->stream,-MAX_WBITS)!=Z_OK)
+                return UNZ_INTERNALERROR;
+            s->stream_initialised = 1;
+        }
+        else
+            inflateReset(&s->stream);
+    }
+    s->stream_end = 0;
+
+    if (pfile_info!=NULL)
+        *pfile_info = file_info;
+    return UNZ_OK;
+}
+
+extern int ZEXPORT unzStreamReadFile (file, buf, len)
+    unzStream file;
+    voidp buf;
+    unsigned len;
+{
+    unz_stream_s* s;
+    int iRead;
+
+    if (file==NULL)
+        return UNZ_PARAMERROR;
+    s=(unz_stream_s*)file;
+    if (!s->current_file_ok)
+        return UNZ_PARAMERROR;
+    if (s->end_of_data)
+        return s->err;
+    if ((s->cur_file_info.flag & 1)!=0)
+        return UNZ_PARAMERROR;
+    if ((s->cur_file_info.compression_method!=0) &&
+        (s->cur_file_info.compression_method!=Z_DEFLATED))
+        return UNZ_BADZIPFILE;
+    if ((buf==NULL) && (len>0))
+        return UNZ_PARAMERROR;
+    if (len==0)
+        return 0;
+
+    iRead = unzlocal_StreamRead(s,buf,len);
+    if (iRead<0)
+    {
+        s->end_of_data = 1;
+        s->err = iRead;
+        return iRead;
+    }
+    if (iRead==0)
+        return unzlocal_StreamEndOfData(s);
+
+    s->crc32 = crc32hw(s->crc32,(const Bytef*)buf,(uInt)iRead);
+    s->total_out += (uLong)iRead;
+    return iRead;
+}
+
+extern int ZEXPORT unzStreamClose (file)
+    unzStream file;
+{
+    unz_stream_s* s;
+    int err=UNZ_OK;
+
+    if (file==NULL)
+        return UNZ_PARAMERROR;
+    s=(unz_stream_s*)file;
+
+    if (s->stream_initialised)
+        inflateEnd(&s->stream);
+    if ((s->close_stream) && (ZCLOSE(s->z_filefunc,s->filestream)!=0))
+        err = UNZ_ERRNO;
+    TRYFREE(s->buffer);
+    TRYFREE(s);
     return err;
 }
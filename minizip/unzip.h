@@ -7,6 +7,7 @@
      WinZip, InfoZip tools and compatible.
 
    Multi volume ZipFile (span) are not supported.
+   Zip64 archives (more than 4 GB or 65535 files) are supported for reading.
    Encryption compatible with pkzip 2.04g only supported
    Old compressions used by old PKZip 1.x are not supported
 
@@ -62,8 +63,14 @@ extern "C" {
     from (void*) without cast */
 typedef struct TagunzFile__ { int unused; } unzFile__;
 typedef unzFile__ *unzFile;
+typedef struct TagunzCursor__ { int unused; } unzCursor__;
+typedef unzCursor__ *unzCursor;
+typedef struct TagunzStream__ { int unused; } unzStream__;
+typedef unzStream__ *unzStream;
 #else
 typedef voidp unzFile;
+typedef voidp unzCursor;
+typedef voidp unzStream;
 #endif
 
 
@@ -76,6 +83,11 @@ typedef voidp unzFile;
 #define UNZ_INTERNALERROR               (-104)
 #define UNZ_CRCERROR                    (-105)
 
+/* checks of the crc32 of the files read (see unzSetCrcPolicy) */
+#define UNZ_CRC_VERIFY                  (0)
+#define UNZ_CRC_DEFER                   (1)
+#define UNZ_CRC_SKIP                    (2)
+
 /* tm_unz contain date/time info */
 typedef struct tm_unz_s
 {
@@ -97,6 +109,37 @@ typedef struct unz_global_info_s
 } unz_global_info;
 
 
+typedef struct unz_global_info64_s
+{
+    ZPOS64_T number_entry;      /* total number of entries in
+                                   the central dir on this disk */
+    uLong size_comment;         /* size of the global comment of the zipfile */
+} unz_global_info64;
+
+
+/* unz_file_info64 contain information about a file in the zipfile, with
+   the sizes of Zip64 archives */
+typedef struct unz_file_info64_s
+{
+    uLong version;              /* version made by                 2 bytes */
+    uLong version_needed;       /* version needed to extract       2 bytes */
+    uLong flag;                 /* general purpose bit flag        2 bytes */
+    uLong compression_method;   /* compression method              2 bytes */
+    uLong dosDate;              /* last mod file date in Dos fmt   4 bytes */
+    uLong crc;                  /* crc-32                          4 bytes */
+    ZPOS64_T compressed_size;   /* compressed size                 8 bytes */
+    ZPOS64_T uncompressed_size; /* uncompressed size               8 bytes */
+    uLong size_filename;        /* filename length                 2 bytes */
+    uLong size_file_extra;      /* extra field length              2 bytes */
+    uLong size_file_comment;    /* file comment length             2 bytes */
+
+    uLong disk_num_start;       /* disk number start               2 bytes */
+    uLong internal_fa;          /* internal file attributes        2 bytes */
+    uLong external_fa;          /* external file attributes        4 bytes */
+
+    tm_unz tmu_date;
+} unz_file_info64;
+
 /* unz_file_info contain information about a file in the zipfile */
 typedef struct unz_file_info_s
 {
@@ -148,6 +191,9 @@ extern unzFile ZEXPORT unzOpen2 OF((const char *path,
 /*
    Open a Zip file, like unzOpen, but provide a set of file low level API
       for read/write the zip file (see ioapi.h)
+   The local headers and the data of the files are read with ZPREAD : when
+      the set has a positional read (fill_pread_filefunc, fill_mmap_filefunc),
+      it does not depend on the position of the stream.
 */
 
 extern int ZEXPORT unzClose OF((unzFile file));
@@ -165,6 +211,14 @@ extern int ZEXPORT unzGetGlobalInfo OF((unzFile file,
   return UNZ_OK if there is no problem. */
 
 
+extern int ZEXPORT unzGetGlobalInfo64 OF((unzFile file,
+                                          unz_global_info64 *pglobal_info));
+/*
+  Same than unzGetGlobalInfo, but the number of entries is not limited to 32 bits
+    (Zip64 archives).
+  unzGetGlobalInfo truncates the values that do not fit in a uLong */
+
+
 extern int ZEXPORT unzGetGlobalComment OF((unzFile file,
                                            char *szComment,
                                            uLong uSizeBuf));
@@ -197,6 +251,8 @@ extern int ZEXPORT unzLocateFile OF((unzFile file,
 /*
   Try locate the file szFileName in the zipfile.
   For the iCaseSensitivity signification, see unzStringFileNameCompare
+  The central dir is indexed when the zipfile is opened, so the time needed
+    does not depend on the number of files in the zipfile.
 
   return value :
   UNZ_OK if the file is found. It becomes the current file.
@@ -221,6 +277,20 @@ extern int ZEXPORT unzGoToFilePos(
     unzFile file,
     unz_file_pos* file_pos);
 
+typedef struct unz64_file_pos_s
+{
+    ZPOS64_T pos_in_zip_directory;   /* offset in zip file directory */
+    ZPOS64_T num_of_file;            /* # of file */
+} unz64_file_pos;
+
+extern int ZEXPORT unzGetFilePos64(
+    unzFile file,
+    unz64_file_pos* file_pos);
+
+extern int ZEXPORT unzGoToFilePos64(
+    unzFile file,
+    const unz64_file_pos* file_pos);
+
 /* ****************************************** */
 
 extern int ZEXPORT unzGetCurrentFileInfo OF((unzFile file,
@@ -244,6 +314,20 @@ extern int ZEXPORT unzGetCurrentFileInfo OF((unzFile file,
             (commentBufferSize is the size of the buffer)
 */
 
+extern int ZEXPORT unzGetCurrentFileInfo64 OF((unzFile file,
+                         unz_file_info64 *pfile_info,
+                         char *szFileName,
+                         uLong fileNameBufferSize,
+                         void *extraField,
+                         uLong extraFieldBufferSize,
+                         char *szComment,
+                         uLong commentBufferSize));
+/*
+  Same than unzGetCurrentFileInfo, but the sizes are not limited to 32 bits
+    (they are read from the Zip64 extra field when needed).
+  unzGetCurrentFileInfo truncates the sizes that do not fit in a uLong
+*/
+
 /***************************************************************************/
 /* for reading the content of the current zipfile, you can open it, read data
    from it, and close it (you can close it before reading all the file)
@@ -316,6 +400,18 @@ extern z_off_t ZEXPORT unztell OF((unzFile file));
   Give the current position in uncompressed data
 */
 
+extern ZPOS64_T ZEXPORT unztell64 OF((unzFile file));
+/*
+  Give the current position in uncompressed data, not limited to 32 bits
+*/
+
+extern ZPOS64_T ZEXPORT unzGetCurrentFileZStreamPos64 OF((unzFile file));
+/*
+  Give the position in the zipfile of the next compressed byte to read of the
+    current file (its first one just after unzOpenCurrentFile, to give hints
+    to the system about the bytes of the file), or 0 if no file is opened
+*/
+
 extern int ZEXPORT unzeof OF((unzFile file));
 /*
   return 1 if the end of file was reached, 0 elsewhere
@@ -337,6 +433,247 @@ extern int ZEXPORT unzGetLocalExtrafield OF((unzFile file,
     the error code
 */
 
+extern int ZEXPORT unzSetReadBufferSize OF((unzFile file,
+                                            uLong size,
+                                            uLong max_size));
+/*
+  Set the size of the buffer used to read the compressed data of the files
+    opened after this call (by unzOpenCurrentFile or unzOpenCursor).
+  size is the size of the first read (UNZ_BUFSIZE, 16 KB, by default). For a
+    large file, the buffer doubles at each refill up to max_size
+    (UNZ_MAXBUFSIZE, 256 KB, by default) : max_size<=size keeps it fixed.
+  If there is no error, the return value is UNZ_OK.
+*/
+
+extern int ZEXPORT unzSetAllocator OF((unzFile file,
+                                       alloc_func zalloc,
+                                       free_func zfree,
+                                       voidpf opaque));
+/*
+  Set the functions allocating the read buffers, the inflate states and the
+    internal structures of the files opened after this call, as zalloc and
+    zfree of zlib (called with opaque). zalloc and zfree NULL (the default)
+    use malloc and free.
+  The buffer and the inflate state of a file closed by unzCloseCurrentFile
+    are kept in the unzFile and recycled (with inflateReset) by the next
+    unzOpenCurrentFile, until unzClose ; the ones of a cursor are freed by
+    unzCloseCursor. So the memory given by zalloc must stay valid until
+    unzClose.
+  If there is no error, the return value is UNZ_OK.
+*/
+
+extern int ZEXPORT unzSetCrcPolicy OF((unzFile file, int policy));
+/*
+  Set how the crc32 of the files read after this call is checked :
+  - UNZ_CRC_VERIFY (the default) : it is computed while the file is read,
+    and unzCloseCurrentFile (or unzCloseCursor) returns UNZ_CRCERROR if it
+    does not match.
+  - UNZ_CRC_DEFER : the file is read without computing it ; when the whole
+    file was read, unzCloseCurrentFile (and unzExtractCurrentFileToBuffer)
+    queue it, and a thread of the unzFile reads it again with a cursor to
+    check it. A bad crc32 (or another error of this check) is returned by
+    the next unzSetCrcPolicy or by unzClose, which wait for the pending
+    checks. The crypted files and the cursors are still checked as they
+    are read. Without a positional read in the set of the unzFile (see
+    unzOpenCursor), or without threads, this is UNZ_CRC_VERIFY.
+  - UNZ_CRC_SKIP : it is neither computed nor checked, for the zipfiles
+    which are trusted (the calls with a check_crc argument still follow it).
+  The crc32 is computed with the CRC instructions of the CPU when it has
+    them (see crc32hw.h).
+  The return value is UNZ_OK, or the first error of the deferred checks
+    done since the last call.
+*/
+
+/***************************************************************************/
+/* Direct access to the data of a stored (not compressed) and not crypted
+   file, without unzOpenCurrentFile and without intermediate copy.
+   */
+
+extern int ZEXPORT unzMapCurrentFile OF((unzFile file,
+                                         const void** pdata,
+                                         ZPOS64_T* psize,
+                                         int check_crc));
+/*
+  Give in *pdata a pointer on the data of the current file, and in *psize its
+    size. The pointer is in the zipfile mapped in memory, it is valid until
+    unzClose.
+  The set of the zipfile must be able to map it (fill_mmap_filefunc, see
+    ZMAP in ioapi.h), and the current file must be stored and not crypted,
+    else the return value is UNZ_PARAMERROR : the file must then be read
+    with unzOpenCurrentFile.
+  if check_crc!=0, the CRC of the data is checked (UNZ_CRCERROR if bad).
+  If there is no error, the return value is UNZ_OK.
+*/
+
+extern int ZEXPORT unzReadCurrentFileStored OF((unzFile file,
+                                                voidp buf,
+                                                ZPOS64_T size_buf,
+                                                int check_crc));
+/*
+  Read the data of the current file, stored and not crypted, in buf with a
+    single read, for the sets which cannot map the zipfile. size_buf must be
+    at least the uncompressed size of the file.
+  Return UNZ_PARAMERROR if the file is compressed or crypted.
+  if check_crc!=0, the CRC of the data is checked (UNZ_CRCERROR if bad).
+  If there is no error, the return value is UNZ_OK.
+*/
+
+extern int ZEXPORT unzGetCurrentFileStoredPos OF((unzFile file,
+                                                  ZPOS64_T* ppos));
+/*
+  Give in *ppos the position in the zipfile of the data of the current file,
+    stored and not crypted (their size is the uncompressed size), to copy them
+    without the unzFile (with copy_file_range or sendfile...). The CRC is then
+    up to the caller.
+  Return UNZ_PARAMERROR if the file is compressed or crypted.
+*/
+
+extern int ZEXPORT unzExtractCurrentFileToBuffer OF((unzFile file,
+                                                     voidp buf,
+                                                     ZPOS64_T size_buf,
+                                                     const char* password));
+/*
+  Extract the whole current file in buf, which the caller allocates from the
+    uncompressed_size of unzGetCurrentFileInfo64 (size_buf must be at least
+    this size).
+  When the zipfile is mapped (see unzMapCurrentFile) and the file is not
+    crypted, a stored file is copied from the mapping and a deflated file is
+    inflated from the mapping to buf by a single call to inflate. Else the
+    file is read with unzOpenCurrentFile3 and unzReadCurrentFile, directly
+    in buf. password is a crypting password (can be NULL).
+  The CRC is checked : if there is no error, the return value is UNZ_OK.
+*/
+
+typedef int (ZCALLBACK *unz_sink_func) OF((voidpf opaque,
+                                          int index,
+                                          const unz_file_info64* pfile_info,
+                                          const void* buf,
+                                          uLong size));
+
+extern int ZEXPORT unzExtractFiles OF((unzFile file,
+                                       const char* const* names,
+                                       int number,
+                                       int iCaseSensitivity,
+                                       unz_sink_func sink,
+                                       voidpf opaque,
+                                       int* results));
+/*
+  Extract the number files named names[0..number-1] (found like with
+    unzLocateFile) in one pass : they are extracted in the order of their
+    local headers in the zipfile rather than in the order of names, and the
+    files near one another (not crypted, stored or deflated) are read with a
+    single read of at most 1 MB, so the zipfile is read forward.
+  For each file, sink is called with index (in names), the info of the file,
+    and buf==NULL and size==0 at the start of the file (to allocate from
+    pfile_info->uncompressed_size), then with each block of its data. The
+    sink returns UNZ_OK to go on, any other value stops the extraction and
+    is returned.
+  The CRC is checked, except with UNZ_CRC_SKIP (see unzSetCrcPolicy).
+  If results!=NULL, results[i] is set to the status of names[i] (UNZ_OK,
+    UNZ_END_OF_LIST_OF_FILE if not found, UNZ_CRCERROR...), for every i
+    even when the function fails before extracting anything.
+  The return value is UNZ_OK if all the files were extracted, else the first
+    error. The current file of the unzFile is changed.
+*/
+
+/***************************************************************************/
+/* Cursors, for reading several files of the same zipfile at the same time.
+   Each cursor has its own decompression state and buffer, and does not use
+   the current file of the unzFile.
+   The data are read with ZPREAD : when the set of the unzFile has a
+   positional read (fill_pread_filefunc, fill_mmap_filefunc), different
+   threads can read different cursors at the same time. The other functions
+   on the unzFile must not be called concurrently with unzOpenCursor.
+   All the cursors must be closed before unzClose.
+   */
+
+extern int ZEXPORT unzOpenCursor OF((unzFile file,
+                                     const unz64_file_pos* file_pos,
+                                     const char* password,
+                                     unzCursor* pcursor));
+/*
+  Open for reading data the file at file_pos (from unzGetFilePos64), or the
+    current file if file_pos==NULL, in a new cursor stored in *pcursor.
+  password is a crypting password (can be NULL)
+  If there is no error, the return value is UNZ_OK.
+*/
+
+extern int ZEXPORT unzReadCursor OF((unzCursor cursor,
+                                     voidp buf,
+                                     unsigned len));
+/*
+  Read bytes from the file of the cursor, like unzReadCurrentFile.
+*/
+
+extern int ZEXPORT unzCloseCursor OF((unzCursor cursor));
+/*
+  Close and free the cursor.
+  Return UNZ_CRCERROR if all the file was read but the CRC is not good
+*/
+
+/***************************************************************************/
+/* Forward-only reading of a zipfile, for the streams which cannot seek (a
+   pipe, a download...). The central dir is never read : the files are given
+   one after the other from their local header, and each one can be read or
+   skipped. The end of the data of a file with a data descriptor (bit 3 of
+   the flag) is found from its deflate stream, or for a stored file from the
+   signature of its descriptor.
+   Only zopen_file (for unzStreamOpen), zread_file, zerror_file and
+   zclose_file of the zlib_filefunc_def are used.
+   The info of the local header is less complete than the one of the central
+   dir : version, size_file_comment, disk_num_start, internal_fa and
+   external_fa are 0, and with the bit 3 the crc and sizes are usually 0
+   (they are in the data descriptor, checked at the end of the file).
+   */
+
+extern unzStream ZEXPORT unzStreamOpen OF((const char *path,
+                                           zlib_filefunc_def* pzlib_filefunc_def));
+/*
+  Open a zipfile for the forward-only reading, like unzOpen2 (with the fopen
+    functions if pzlib_filefunc_def==NULL). The stream is closed by
+    unzStreamClose.
+*/
+
+extern unzStream ZEXPORT unzStreamOpen2 OF((zlib_filefunc_def* pzlib_filefunc_def,
+                                            voidpf filestream));
+/*
+  Same than unzStreamOpen, on a filestream already opened with the functions
+    of pzlib_filefunc_def (a FILE* of popen or fdopen(0,"rb") with the fopen
+    functions). The filestream is not closed by unzStreamClose.
+*/
+
+extern int ZEXPORT unzStreamNextFile OF((unzStream file,
+                                         unz_file_info64 *pfile_info,
+                                         char *szFileName,
+                                         uLong fileNameBufferSize));
+/*
+  Skip what is left of the current file (if any), and read the local header
+    of the next file, like unzGetCurrentFileInfo64.
+  return UNZ_OK if there is no problem
+  return UNZ_END_OF_LIST_OF_FILE after the last file (at the central dir)
+  return UNZ_BADZIPFILE if the end of the current file could not be found,
+    or for a crypted file (or one with an unknown method) with a data
+    descriptor : the next files cannot be found.
+  To stop before the end (the wanted file is found), just call unzStreamClose.
+*/
+
+extern int ZEXPORT unzStreamReadFile OF((unzStream file,
+                                         voidp buf,
+                                         unsigned len));
+/*
+  Read bytes from the current file, like unzReadCurrentFile (the crypted
+    files cannot be read).
+  return the number of byte copied if somes bytes are copied
+  return 0 at the end of the file, when its crc is good
+  return <0 with error code if there is an error
+    (UNZ_CRCERROR at the end of a file whose crc is not good)
+*/
+
+extern int ZEXPORT unzStreamClose OF((unzStream file));
+/*
+  Close and free the forward-only reader.
+*/
+
 /***************************************************************************/
 
 /* Get the current file offset */
@@ -345,6 +682,10 @@ extern uLong ZEXPORT unzGetOffset (unzFile file);
 /* Set the current file offset */
 extern int ZEXPORT unzSetOffset (unzFile file, uLong pos);
 
+/* Same than unzGetOffset and unzSetOffset, for Zip64 archives */
+extern ZPOS64_T ZEXPORT unzGetOffset64 (unzFile file);
+extern int ZEXPORT unzSetOffset64 (unzFile file, ZPOS64_T pos);
+
 
 
 #ifdef __cplusplus
@@ -9,6 +9,10 @@
    Read zip.h for more info
 */
 
+/* memrchr is a GNU extension */
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -46,16 +50,29 @@
 #define Z_MAXFILENAMEINZIP (256)
 #endif
 
+/* ZIP_METHOD_AUTO deflates the first ZIP_PROBESIZE bytes of a file, and
+   stores the file when it gains less than 1/ZIP_PROBEMINGAIN of them */
+#ifndef ZIP_PROBESIZE
+#define ZIP_PROBESIZE (4096)
+#endif
+
+#ifndef ZIP_PROBEMINGAIN
+#define ZIP_PROBEMINGAIN (32)
+#endif
+
 #ifndef ALLOC
 # define ALLOC(size) (malloc(size))
 #endif
+#ifndef REALLOC
+# define REALLOC(p,size) (realloc(p,size))
+#endif
 #ifndef TRYFREE
 # define TRYFREE(p) {if (p) free(p);}
 #endif
 
 /*
 #define SIZECENTRALDIRITEM (0x2e)
-#define SIZEZIPLOCALHEADER (0x1e)
+#define SIZELOCALHEADER (0x1e)
 */
 
 /* I've found an old Unix (a SunOS 4.1.3_U1) without all SEEK_* defined.... */
@@ -83,46 +100,69 @@ const char zip_copyright[] =
    " zip 1.01 Copyright 1998-2004 Gilles Vollant - http://www.winimage.com/zLibDll";
 
 
-#define SIZEDATA_INDATABLOCK (4096-(4*4))
+/* first size of the buffer of the central dir, doubled when it is full */
+#define SIZEDATA_INBUFFER (65536)
 
 #define LOCALHEADERMAGIC    (0x04034b50)
 #define CENTRALHEADERMAGIC  (0x02014b50)
 #define ENDHEADERMAGIC      (0x06054b50)
+#define ZIP64ENDHEADERMAGIC (0x06064b50)
+#define ZIP64ENDLOCHEADERMAGIC (0x07064b50)
 
 #define FLAG_LOCALHEADER_OFFSET (0x06)
 #define CRC_LOCALHEADER_OFFSET  (0x0e)
 
+#define SIZELOCALHEADER (0x1e) /* 30 */
 #define SIZECENTRALHEADER (0x2e) /* 46 */
+#define SIZEZIP64ENDCENTRALDIR (0x38) /* 56 */
+#define SIZEZIP64LOCATOR (0x14) /* 20 */
+#define SIZEENDCENTRALDIR (0x16) /* 22 */
 
-typedef struct linkedlist_datablock_internal_s
-{
-  struct linkedlist_datablock_internal_s* next_datablock;
-  uLong  avail_in_this_block;
-  uLong  filled_in_this_block;
-  uLong  unused; /* for future use and alignement */
-  unsigned char data[SIZEDATA_INDATABLOCK];
-} linkedlist_datablock_internal;
-
-typedef struct linkedlist_data_s
+/* Zip64 extra field : header (4) + uncompressed size, compressed size and
+   offset of the local header (8 each) */
+#define SIZEZIP64EXTRAFIELD (4+8+8+8)
+/* the local header one has only the two sizes */
+#define SIZEZIP64LOCALEXTRAFIELD (4+8+8)
+
+typedef struct buffer_data_s
 {
-    linkedlist_datablock_internal* first_block;
-    linkedlist_datablock_internal* last_block;
-} linkedlist_data;
+    unsigned char* data;        /* contiguous data, or NULL while empty */
+    ZPOS64_T filled_in_buffer;
+    ZPOS64_T size_buffer;       /* allocated size of data */
+} buffer_data;
 
 
 typedef struct
 {
-    z_stream stream;            /* zLib stream structure for inflate */
-    int  stream_initialised;    /* 1 is stream is initialised */
+    z_stream stream;            /* zLib stream structure for deflate */
+    int  stream_initialised;    /* 1 is stream is initialised : it is kept
+                                     from a file to the next one */
+    int  stream_windowBits;     /* parameters given to deflateInit2 */
+    int  stream_memLevel;
+    int  stream_level;          /* parameters of the last file, changed */
+    int  stream_strategy;       /*   with deflateParams */
     uInt pos_in_buffered_data;  /* last written byte in buffered_data */
+    uInt size_header_in_buffered_data; /* headers at the start of
+                                     buffered_data, written with the first
+                                     data and not crypted */
+    int  localheader_in_buffer; /* 1 while the local header is at the start
+                                     of buffered_data, not written yet */
 
-    uLong pos_local_header;     /* offset of the local header of the file
+    ZPOS64_T pos_local_header;  /* offset of the local header of the file
                                      currenty writing */
     char* central_header;       /* central header data for the current file */
     uLong size_centralheader;   /* size of the central header for cur file */
+    uLong size_filename;        /* size of the filename of the current file */
+    uLong size_extrafield_global;/* size of the extra field given by caller */
     uLong flag;                 /* flag of the file currently writing */
+    int  zip64;                 /* 1 if a Zip64 extra field is reserved in
+                                     the local header */
+    ZPOS64_T totalCompressedData;  /* sizes of the file, stream.total_in and */
+    ZPOS64_T totalUncompressedData;/* total_out may be only 32 bits */
 
     int  method;                /* compression method of file currenty wr.*/
+    int  method_auto;           /* 1 while the method is to be chosen with
+                                     the first data (ZIP_METHOD_AUTO) */
     int  raw;                   /* 1 for directly writing raw data */
     Byte buffered_data[Z_BUFSIZE];/* buffer contain compressed data to be writ*/
     uLong dosDate;
@@ -139,13 +179,16 @@ typedef struct
 {
     zlib_filefunc_def z_filefunc;
     voidpf filestream;        /* io structore of the zipfile */
-    linkedlist_data central_dir;/* datablock with central dir in construction*/
+    buffer_data central_dir;    /* central dir in construction */
     int  in_opened_file_inzip;  /* 1 if a file in the zip is currently writ.*/
     curfile_info ci;            /* info on the file curretly writing */
 
-    uLong begin_pos;            /* position of the beginning of the zipfile */
-    uLong add_position_when_writting_offset;
-    uLong number_entry;
+    ZPOS64_T begin_pos;         /* position of the beginning of the zipfile */
+    ZPOS64_T add_position_when_writting_offset;
+    ZPOS64_T number_entry;
+    alloc_func zalloc;          /* allocator given by zipSetAllocator */
+    free_func  zfree;
+    voidpf     opaque;
 #ifndef NO_ADDFILEINEXISTINGZIP
     char *globalcomment;
 #endif
@@ -159,96 +202,60 @@ typedef struct
 #include "crypt.h"
 #endif
 
-local linkedlist_datablock_internal* allocate_new_datablock()
-{
-    linkedlist_datablock_internal* ldi;
-    ldi = (linkedlist_datablock_internal*)
-                 ALLOC(sizeof(linkedlist_datablock_internal));
-    if (ldi!=NULL)
-    {
-        ldi->next_datablock = NULL ;
-        ldi->filled_in_this_block = 0 ;
-        ldi->avail_in_this_block = SIZEDATA_INDATABLOCK ;
-    }
-    return ldi;
-}
+#include "crc32hw.h"
 
-local void free_datablock(ldi)
-    linkedlist_datablock_internal* ldi;
+local void init_buffer(buf)
+    buffer_data* buf;
 {
-    while (ldi!=NULL)
-    {
-        linkedlist_datablock_internal* ldinext = ldi->next_datablock;
-        TRYFREE(ldi);
-        ldi = ldinext;
-    }
+    buf->data = NULL;
+    buf->filled_in_buffer = buf->size_buffer = 0;
 }
 
-local void init_linkedlist(ll)
-    linkedlist_data* ll;
+local void free_buffer(buf)
+    buffer_data* buf;
 {
-    ll->first_block = ll->last_block = NULL;
+    TRYFREE(buf->data);
+    init_buffer(buf);
 }
 
-local void free_linkedlist(ll)
-    linkedlist_data* ll;
+/*
+  Make room for len more bytes in buf, doubling its size so adding n bytes
+    costs O(log n) reallocs
+*/
+local int reserve_in_buffer(buf,len)
+    buffer_data* buf;
+    ZPOS64_T len;
 {
-    free_datablock(ll->first_block);
-    ll->first_block = ll->last_block = NULL;
-}
+    ZPOS64_T size_buffer = buf->size_buffer;
+    unsigned char* data;
 
+    if (buf->filled_in_buffer+len <= size_buffer)
+        return ZIP_OK;
+    if (size_buffer < SIZEDATA_INBUFFER)
+        size_buffer = SIZEDATA_INBUFFER;
+    while (size_buffer < buf->filled_in_buffer+len)
+        size_buffer *= 2;
+    if ((size_t)size_buffer != size_buffer)
+        return ZIP_INTERNALERROR;
 
-local int add_data_in_datablock(ll,buf,len)
-    linkedlist_data* ll;
-    const void* buf;
+    data = (unsigned char*)REALLOC(buf->data,(size_t)size_buffer);
+    if (data==NULL)
+        return ZIP_INTERNALERROR;
+    buf->data = data;
+    buf->size_buffer = size_buffer;
+    return ZIP_OK;
+}
+
+local int add_data_in_buffer(buf,data,len)
+    buffer_data* buf;
+    const void* data;
     uLong len;
 {
-    linkedlist_datablock_internal* ldi;
-    const unsigned char* from_copy;
-
-    if (ll==NULL)
+    if (reserve_in_buffer(buf,len)!=ZIP_OK)
         return ZIP_INTERNALERROR;
-
-    if (ll->last_block == NULL)
-    {
-        ll->first_block = ll->last_block = allocate_new_datablock();
-        if (ll->first_block == NULL)
-            return ZIP_INTERNALERROR;
-    }
-
-    ldi = ll->last_block;
-    from_copy = (unsigned char*)buf;
-
-    while (len>0)
-    {
-        uInt copy_this;
-        uInt i;
-        unsigned char* to_copy;
-
-        if (ldi->avail_in_this_block==0)
-        {
-            ldi->next_datablock = allocate_new_datablock();
-            if (ldi->next_datablock == NULL)
-                return ZIP_INTERNALERROR;
-            ldi = ldi->next_datablock ;
-            ll->last_block = ldi;
-        }
-
-        if (ldi->avail_in_this_block < len)
-            copy_this = (uInt)ldi->avail_in_this_block;
-        else
-            copy_this = (uInt)len;
-
-        to_copy = &(ldi->data[ldi->filled_in_this_block]);
-
-        for (i=0;i<copy_this;i++)
-            *(to_copy+i)=*(from_copy+i);
-
-        ldi->filled_in_this_block += copy_this;
-        ldi->avail_in_this_block -= copy_this;
-        from_copy += copy_this ;
-        len -= copy_this;
-    }
+    if (len>0)
+        memcpy(buf->data+buf->filled_in_buffer,data,len);
+    buf->filled_in_buffer += len;
     return ZIP_OK;
 }
 
@@ -258,43 +265,14 @@ local int add_data_in_datablock(ll,buf,len)
 
 #ifndef NO_ADDFILEINEXISTINGZIP
 /* ===========================================================================
-   Inputs a long in LSB order to the given file
-   nbByte == 1, 2 or 4 (byte, short or long)
+   Inputs a long in LSB order to the given buffer
+   nbByte == 1, 2, 4 or 8 (byte, short, long or Zip64 value)
 */
 
-local int ziplocal_putValue OF((const zlib_filefunc_def* pzlib_filefunc_def,
-                                voidpf filestream, uLong x, int nbByte));
-local int ziplocal_putValue (pzlib_filefunc_def, filestream, x, nbByte)
-    const zlib_filefunc_def* pzlib_filefunc_def;
-    voidpf filestream;
-    uLong x;
-    int nbByte;
-{
-    unsigned char buf[4];
-    int n;
-    for (n = 0; n < nbByte; n++)
-    {
-        buf[n] = (unsigned char)(x & 0xff);
-        x >>= 8;
-    }
-    if (x != 0)
-      {     /* data overflow - hack for ZIP64 (X Roche) */
-      for (n = 0; n < nbByte; n++)
-        {
-          buf[n] = 0xff;
-        }
-      }
-
-    if (ZWRITE(*pzlib_filefunc_def,filestream,buf,nbByte)!=(uLong)nbByte)
-        return ZIP_ERRNO;
-    else
-        return ZIP_OK;
-}
-
-local void ziplocal_putValue_inmemory OF((void* dest, uLong x, int nbByte));
+local void ziplocal_putValue_inmemory OF((void* dest, ZPOS64_T x, int nbByte));
 local void ziplocal_putValue_inmemory (dest, x, nbByte)
     void* dest;
-    uLong x;
+    ZPOS64_T x;
     int nbByte;
 {
     unsigned char* buf=(unsigned char*)dest;
@@ -313,6 +291,24 @@ local void ziplocal_putValue_inmemory (dest, x, nbByte)
     }
 }
 
+/* ===========================================================================
+   Reads a value in LSB order from the given buffer
+   nbByte == 1, 2, 4 or 8 (byte, short, long or Zip64 value)
+*/
+
+local ZPOS64_T ziplocal_getValue_inmemory OF((const void* src, int nbByte));
+local ZPOS64_T ziplocal_getValue_inmemory (src, nbByte)
+    const void* src;
+    int nbByte;
+{
+    const unsigned char* buf=(const unsigned char*)src;
+    ZPOS64_T x = 0;
+    int n;
+    for (n = nbByte; n > 0; n--)
+        x = (x << 8) | buf[n-1];
+    return x;
+}
+
 /****************************************************************************/
 
 
@@ -427,72 +423,198 @@ local int ziplocal_getLong (pzlib_filefunc_def,filestream,pX)
     return err;
 }
 
-#ifndef BUFREADCOMMENT
-#define BUFREADCOMMENT (0x400)
+local int ziplocal_getLong64 OF((
+    const zlib_filefunc_def* pzlib_filefunc_def,
+    voidpf filestream,
+    ZPOS64_T *pX));
+
+local int ziplocal_getLong64 (pzlib_filefunc_def,filestream,pX)
+    const zlib_filefunc_def* pzlib_filefunc_def;
+    voidpf filestream;
+    ZPOS64_T *pX;
+{
+    uLong low,high;
+    int err;
+
+    err = ziplocal_getLong(pzlib_filefunc_def,filestream,&low);
+    if (err==ZIP_OK)
+        err = ziplocal_getLong(pzlib_filefunc_def,filestream,&high);
+
+    if (err==ZIP_OK)
+        *pX = ((ZPOS64_T)high<<32) + low;
+    else
+        *pX = 0;
+    return err;
+}
+
+/* the end of central dir record is searched in the tail of the zipfile,
+   long enough for the record with the largest comment */
+#define SIZETAILREAD (SIZEENDCENTRALDIR+0xffff)
+
+#if defined(__GLIBC__) && !defined(NOMEMRCHR)
+#define ZIP_MEMRCHR
 #endif
+
+/*
+  Find the last signature of an end of central dir record ("PK\5\6") which
+    starts in buf[0..size-1], with memrchr when there is one
+  return NULL if there is none
+*/
+local const unsigned char* ziplocal_FindEndCentralDir OF((
+    const unsigned char* buf,
+    uLong size));
+
+local const unsigned char* ziplocal_FindEndCentralDir (buf, size)
+    const unsigned char* buf;
+    uLong size;
+{
+    const unsigned char* p = buf + size;
+    while (p > buf)
+    {
+#ifdef ZIP_MEMRCHR
+        p = (const unsigned char*)memrchr(buf,0x50,(size_t)(p-buf));
+        if (p==NULL)
+            return NULL;
+#else
+        if (*(--p) != 0x50)
+            continue;
+#endif
+        if ((p[1]==0x4b) && (p[2]==0x05) && (p[3]==0x06))
+            return p;
+    }
+    return NULL;
+}
+
 /*
   Locate the Central directory of a zipfile (at the end, just before
-    the global comment)
+    the global comment), with a single read of the tail of the zipfile.
+  A signature is taken only if the record fits in the zipfile with its
+    comment, and if its central dir ends before it ; the record whose
+    comment ends exactly at the end of the zipfile is preferred (so a
+    "PK\5\6" in the comment is skipped).
 */
-local uLong ziplocal_SearchCentralDir OF((
+local ZPOS64_T ziplocal_SearchCentralDir OF((
     const zlib_filefunc_def* pzlib_filefunc_def,
     voidpf filestream));
 
-local uLong ziplocal_SearchCentralDir(pzlib_filefunc_def,filestream)
+local ZPOS64_T ziplocal_SearchCentralDir(pzlib_filefunc_def,filestream)
     const zlib_filefunc_def* pzlib_filefunc_def;
     voidpf filestream;
 {
     unsigned char* buf;
-    uLong uSizeFile;
-    uLong uBackRead;
-    uLong uMaxBack=0xffff; /* maximum size of global comment */
-    uLong uPosFound=0;
+    const unsigned char* p;
+    ZPOS64_T uSizeFile;
+    ZPOS64_T uReadPos;
+    uLong uReadSize;
+    ZPOS64_T uPosFound=0;
 
     if (ZSEEK(*pzlib_filefunc_def,filestream,0,ZLIB_FILEFUNC_SEEK_END) != 0)
         return 0;
 
+    uSizeFile = (ZPOS64_T)ZTELL(*pzlib_filefunc_def,filestream);
+    if (uSizeFile<SIZEENDCENTRALDIR)
+        return 0;
 
-    uSizeFile = ZTELL(*pzlib_filefunc_def,filestream);
-
-    if (uMaxBack>uSizeFile)
-        uMaxBack = uSizeFile;
+    uReadSize = (uSizeFile<SIZETAILREAD) ? (uLong)uSizeFile : SIZETAILREAD;
+    uReadPos = uSizeFile-uReadSize;
 
-    buf = (unsigned char*)ALLOC(BUFREADCOMMENT+4);
+    buf = (unsigned char*)ALLOC(uReadSize);
     if (buf==NULL)
         return 0;
-
-    uBackRead = 4;
-    while (uBackRead<uMaxBack)
+    if (ZPREAD(*pzlib_filefunc_def,filestream,buf,uReadSize,uReadPos)!=uReadSize)
     {
-        uLong uReadSize,uReadPos ;
-        int i;
-        if (uBackRead+BUFREADCOMMENT>uMaxBack)
-            uBackRead = uMaxBack;
-        else
-            uBackRead+=BUFREADCOMMENT;
-        uReadPos = uSizeFile-uBackRead ;
+        TRYFREE(buf);
+        return 0;
+    }
 
-        uReadSize = ((BUFREADCOMMENT+4) < (uSizeFile-uReadPos)) ?
-                     (BUFREADCOMMENT+4) : (uSizeFile-uReadPos);
-        if (ZSEEK(*pzlib_filefunc_def,filestream,uReadPos,ZLIB_FILEFUNC_SEEK_SET)!=0)
+    for (p = ziplocal_FindEndCentralDir(buf,uReadSize-SIZEENDCENTRALDIR+1);
+         p != NULL;
+         p = ziplocal_FindEndCentralDir(buf,(uLong)(p-buf)))
+    {
+        ZPOS64_T pos = uReadPos+(ZPOS64_T)(p-buf);
+        ZPOS64_T end_record = pos+SIZEENDCENTRALDIR+
+                              ziplocal_getValue_inmemory(p+20,2);
+        ZPOS64_T size_central_dir = ziplocal_getValue_inmemory(p+12,4);
+        ZPOS64_T offset_central_dir = ziplocal_getValue_inmemory(p+16,4);
+
+        if (end_record > uSizeFile)
+            continue;
+        if ((size_central_dir!=0xffffffff) && (offset_central_dir!=0xffffffff) &&
+            (offset_central_dir+size_central_dir > pos))
+            continue;
+        if (end_record == uSizeFile)
+        {
+            uPosFound = pos;
             break;
+        }
+        if (uPosFound == 0)
+            uPosFound = pos;
+    }
+    TRYFREE(buf);
+    return uPosFound;
+}
 
-        if (ZREAD(*pzlib_filefunc_def,filestream,buf,uReadSize)!=uReadSize)
-            break;
+/*
+  Locate the Zip64 end of central dir record of a zipfile, with the locator
+    just before the end of central dir record found at central_pos.
+  return 0 if the zipfile has no Zip64 end of central dir record
+*/
+local ZPOS64_T ziplocal_SearchCentralDir64 OF((
+    const zlib_filefunc_def* pzlib_filefunc_def,
+    voidpf filestream,
+    ZPOS64_T central_pos));
 
-        for (i=(int)uReadSize-3; (i--)>0;)
-            if (((*(buf+i))==0x50) && ((*(buf+i+1))==0x4b) &&
-                ((*(buf+i+2))==0x05) && ((*(buf+i+3))==0x06))
-            {
-                uPosFound = uReadPos+i;
-                break;
-            }
+local ZPOS64_T ziplocal_SearchCentralDir64(pzlib_filefunc_def,filestream,
+                                           central_pos)
+    const zlib_filefunc_def* pzlib_filefunc_def;
+    voidpf filestream;
+    ZPOS64_T central_pos;
+{
+    ZPOS64_T relative_offset;
+    uLong uL;
 
-        if (uPosFound!=0)
-            break;
+    if (central_pos<SIZEZIP64LOCATOR+SIZEZIP64ENDCENTRALDIR)
+        return 0;
+
+    if (ZSEEK(*pzlib_filefunc_def,filestream,central_pos-SIZEZIP64LOCATOR,
+              ZLIB_FILEFUNC_SEEK_SET)!=0)
+        return 0;
+
+    /* the signature */
+    if (ziplocal_getLong(pzlib_filefunc_def,filestream,&uL)!=ZIP_OK)
+        return 0;
+    if (uL != ZIP64ENDLOCHEADERMAGIC)
+        return 0;
+
+    /* number of the disk with the start of the zip64 end of central dir */
+    if (ziplocal_getLong(pzlib_filefunc_def,filestream,&uL)!=ZIP_OK)
+        return 0;
+    if (uL != 0)
+        return 0;
+
+    /* relative offset of the zip64 end of central dir record */
+    if (ziplocal_getLong64(pzlib_filefunc_def,filestream,&relative_offset)!=ZIP_OK)
+        return 0;
+
+    /* the record is where the locator says, or just before the locator
+       when there are bytes before the zipfile */
+    if (relative_offset+SIZEZIP64ENDCENTRALDIR <= central_pos-SIZEZIP64LOCATOR)
+    {
+        if ((ZSEEK(*pzlib_filefunc_def,filestream,relative_offset,
+                   ZLIB_FILEFUNC_SEEK_SET)==0) &&
+            (ziplocal_getLong(pzlib_filefunc_def,filestream,&uL)==ZIP_OK) &&
+            (uL == ZIP64ENDHEADERMAGIC))
+            return relative_offset;
     }
-    TRYFREE(buf);
-    return uPosFound;
+
+    relative_offset = central_pos-SIZEZIP64LOCATOR-SIZEZIP64ENDCENTRALDIR;
+    if ((ZSEEK(*pzlib_filefunc_def,filestream,relative_offset,
+               ZLIB_FILEFUNC_SEEK_SET)==0) &&
+        (ziplocal_getLong(pzlib_filefunc_def,filestream,&uL)==ZIP_OK) &&
+        (uL == ZIP64ENDHEADERMAGIC))
+        return relative_offset;
+
+    return 0;
 }
 #endif /* !NO_ADDFILEINEXISTINGZIP*/
 
@@ -527,7 +649,10 @@ extern zipFile ZEXPORT zipOpen2 (pathname, append, globalcomment, pzlib_filefunc
     ziinit.ci.stream_initialised = 0;
     ziinit.number_entry = 0;
     ziinit.add_position_when_writting_offset = 0;
-    init_linkedlist(&(ziinit.central_dir));
+    ziinit.zalloc = (alloc_func)0;
+    ziinit.zfree = (free_func)0;
+    ziinit.opaque = (voidpf)0;
+    init_buffer(&(ziinit.central_dir));
 
 
     zi = (zip_internal*)ALLOC(sizeof(zip_internal));
@@ -542,18 +667,21 @@ extern zipFile ZEXPORT zipOpen2 (pathname, append, globalcomment, pzlib_filefunc
     ziinit.globalcomment = NULL;
     if (append == APPEND_STATUS_ADDINZIP)
     {
-        uLong byte_before_the_zipfile;/* byte before the zipfile, (>0 for sfx)*/
+        ZPOS64_T byte_before_the_zipfile;/* byte before the zipfile, (>0 for sfx)*/
 
-        uLong size_central_dir;     /* size of the central directory  */
-        uLong offset_central_dir;   /* offset of start of central directory */
-        uLong central_pos,uL;
+        ZPOS64_T size_central_dir;  /* size of the central directory  */
+        ZPOS64_T offset_central_dir;/* offset of start of central directory */
+        ZPOS64_T central_pos;
+        ZPOS64_T end_central_pos;   /* position of the Zip64 end of central
+                                       dir record, or central_pos */
+        uLong uL;
 
         uLong number_disk;          /* number of the current dist, used for
                                     spaning ZIP, unsupported, always 0*/
         uLong number_disk_with_CD;  /* number the the disk with central dir, used
                                     for spaning ZIP, unsupported, always 0*/
-        uLong number_entry;
-        uLong number_entry_CD;      /* total number of entries in
+        ZPOS64_T number_entry;
+        ZPOS64_T number_entry_CD;   /* total number of entries in
                                     the central dir
                                     (same than number_entry on nospan) */
         uLong size_comment;
@@ -579,12 +707,14 @@ extern zipFile ZEXPORT zipOpen2 (pathname, append, globalcomment, pzlib_filefunc
             err=ZIP_ERRNO;
 
         /* total number of entries in the central dir on this disk */
-        if (ziplocal_getShort(&ziinit.z_filefunc, ziinit.filestream,&number_entry)!=ZIP_OK)
+        if (ziplocal_getShort(&ziinit.z_filefunc, ziinit.filestream,&uL)!=ZIP_OK)
             err=ZIP_ERRNO;
+        number_entry = uL;
 
         /* total number of entries in the central dir */
-        if (ziplocal_getShort(&ziinit.z_filefunc, ziinit.filestream,&number_entry_CD)!=ZIP_OK)
+        if (ziplocal_getShort(&ziinit.z_filefunc, ziinit.filestream,&uL)!=ZIP_OK)
             err=ZIP_ERRNO;
+        number_entry_CD = uL;
 
         if ((number_entry_CD!=number_entry) ||
             (number_disk_with_CD!=0) ||
@@ -592,29 +722,21 @@ extern zipFile ZEXPORT zipOpen2 (pathname, append, globalcomment, pzlib_filefunc
             err=ZIP_BADZIPFILE;
 
         /* size of the central directory */
-        if (ziplocal_getLong(&ziinit.z_filefunc, ziinit.filestream,&size_central_dir)!=ZIP_OK)
+        if (ziplocal_getLong(&ziinit.z_filefunc, ziinit.filestream,&uL)!=ZIP_OK)
             err=ZIP_ERRNO;
+        size_central_dir = uL;
 
         /* offset of start of central directory with respect to the
             starting disk number */
-        if (ziplocal_getLong(&ziinit.z_filefunc, ziinit.filestream,&offset_central_dir)!=ZIP_OK)
+        if (ziplocal_getLong(&ziinit.z_filefunc, ziinit.filestream,&uL)!=ZIP_OK)
             err=ZIP_ERRNO;
+        offset_central_dir = uL;
 
         /* zipfile global comment length */
         if (ziplocal_getShort(&ziinit.z_filefunc, ziinit.filestream,&size_comment)!=ZIP_OK)
             err=ZIP_ERRNO;
 
-        if ((central_pos<offset_central_dir+size_central_dir) &&
-            (err==ZIP_OK))
-            err=ZIP_BADZIPFILE;
-
-        if (err!=ZIP_OK)
-        {
-            ZCLOSE(ziinit.z_filefunc, ziinit.filestream);
-            return NULL;
-        }
-
-        if (size_comment>0)
+        if ((err==ZIP_OK) && (size_comment>0))
         {
             ziinit.globalcomment = ALLOC(size_comment+1);
             if (ziinit.globalcomment)
@@ -624,34 +746,91 @@ extern zipFile ZEXPORT zipOpen2 (pathname, append, globalcomment, pzlib_filefunc
             }
         }
 
-        byte_before_the_zipfile = central_pos -
-                                (offset_central_dir+size_central_dir);
-        ziinit.add_position_when_writting_offset = byte_before_the_zipfile;
-
+        /* the values of a Zip64 end of central dir record replace the ones
+           of the end of central dir record */
+        end_central_pos = 0;
+        if (err==ZIP_OK)
+            end_central_pos = ziplocal_SearchCentralDir64(&ziinit.z_filefunc,
+                                                ziinit.filestream,central_pos);
+        if (end_central_pos==0)
+            end_central_pos = central_pos;
+        else
         {
-            uLong size_central_dir_to_read = size_central_dir;
-            size_t buf_size = SIZEDATA_INDATABLOCK;
-            void* buf_read = (void*)ALLOC(buf_size);
+            /* the signature has been read by ziplocal_SearchCentralDir64,
+               skip size of the record (8), version made by and needed (4) */
             if (ZSEEK(ziinit.z_filefunc, ziinit.filestream,
-                  offset_central_dir + byte_before_the_zipfile,
-                  ZLIB_FILEFUNC_SEEK_SET) != 0)
-                  err=ZIP_ERRNO;
+                      end_central_pos+16,ZLIB_FILEFUNC_SEEK_SET)!=0)
+                err=ZIP_ERRNO;
 
-            while ((size_central_dir_to_read>0) && (err==ZIP_OK))
-            {
-                uLong read_this = SIZEDATA_INDATABLOCK;
+            /* number of this disk */
+            if (ziplocal_getLong(&ziinit.z_filefunc, ziinit.filestream,&number_disk)!=ZIP_OK)
+                err=ZIP_ERRNO;
 
-                if (read_this > size_central_dir_to_read)
-                    read_this = size_central_dir_to_read;
-                if (ZREAD(ziinit.z_filefunc, ziinit.filestream,buf_read,read_this) != read_this)
-                    err=ZIP_ERRNO;
+            /* number of the disk with the start of the central directory */
+            if (ziplocal_getLong(&ziinit.z_filefunc, ziinit.filestream,&number_disk_with_CD)!=ZIP_OK)
+                err=ZIP_ERRNO;
 
-                if (err==ZIP_OK)
-                    err = add_data_in_datablock(&ziinit.central_dir,buf_read,
-                                                (uLong)read_this);
-                size_central_dir_to_read-=read_this;
-            }
-            TRYFREE(buf_read);
+            /* total number of entries in the central dir on this disk */
+            if (ziplocal_getLong64(&ziinit.z_filefunc, ziinit.filestream,&number_entry)!=ZIP_OK)
+                err=ZIP_ERRNO;
+
+            /* total number of entries in the central dir */
+            if (ziplocal_getLong64(&ziinit.z_filefunc, ziinit.filestream,&number_entry_CD)!=ZIP_OK)
+                err=ZIP_ERRNO;
+
+            if ((number_entry_CD!=number_entry) ||
+                (number_disk_with_CD!=0) ||
+                (number_disk!=0))
+                err=ZIP_BADZIPFILE;
+
+            /* size of the central directory */
+            if (ziplocal_getLong64(&ziinit.z_filefunc, ziinit.filestream,&size_central_dir)!=ZIP_OK)
+                err=ZIP_ERRNO;
+
+            /* offset of start of central directory */
+            if (ziplocal_getLong64(&ziinit.z_filefunc, ziinit.filestream,&offset_central_dir)!=ZIP_OK)
+                err=ZIP_ERRNO;
+        }
+
+        if ((end_central_pos<offset_central_dir+size_central_dir) &&
+            (err==ZIP_OK))
+            err=ZIP_BADZIPFILE;
+
+        if (err!=ZIP_OK)
+        {
+            TRYFREE(ziinit.globalcomment);
+            TRYFREE(zi);
+            ZCLOSE(ziinit.z_filefunc, ziinit.filestream);
+            return NULL;
+        }
+
+        byte_before_the_zipfile = end_central_pos -
+                                (offset_central_dir+size_central_dir);
+        ziinit.add_position_when_writting_offset = byte_before_the_zipfile;
+
+        /* the central dir is read directly in its buffer */
+        if (err==ZIP_OK)
+            err = reserve_in_buffer(&ziinit.central_dir,size_central_dir);
+        if ((err==ZIP_OK) &&
+            (ZSEEK(ziinit.z_filefunc, ziinit.filestream,
+                  offset_central_dir + byte_before_the_zipfile,
+                  ZLIB_FILEFUNC_SEEK_SET) != 0))
+            err=ZIP_ERRNO;
+
+        while ((ziinit.central_dir.filled_in_buffer<size_central_dir) &&
+               (err==ZIP_OK))
+        {
+            ZPOS64_T rest = size_central_dir -
+                            ziinit.central_dir.filled_in_buffer;
+            uLong read_this = (rest > 0x40000000) ? 0x40000000 : (uLong)rest;
+
+            if (ZREAD(ziinit.z_filefunc, ziinit.filestream,
+                      ziinit.central_dir.data +
+                      ziinit.central_dir.filled_in_buffer,
+                      read_this) != read_this)
+                err=ZIP_ERRNO;
+            else
+                ziinit.central_dir.filled_in_buffer += read_this;
         }
         ziinit.begin_pos = byte_before_the_zipfile;
         ziinit.number_entry = number_entry_CD;
@@ -672,6 +851,7 @@ extern zipFile ZEXPORT zipOpen2 (pathname, append, globalcomment, pzlib_filefunc
 #    ifndef NO_ADDFILEINEXISTINGZIP
         TRYFREE(ziinit.globalcomment);
 #    endif /* !NO_ADDFILEINEXISTINGZIP*/
+        free_buffer(&ziinit.central_dir);
         TRYFREE(zi);
         return NULL;
     }
@@ -689,12 +869,192 @@ extern zipFile ZEXPORT zipOpen (pathname, append)
     return zipOpen2(pathname,append,NULL,NULL);
 }
 
-extern int ZEXPORT zipOpenNewFileInZip3 (file, filename, zipfi,
+/* signatures of already compressed formats, at an offset of the file */
+local const struct
+{
+    uInt offset;
+    uInt size;
+    const char* signature;
+} compressed_formats[] =
+{
+    { 0, 4, "\x89PNG" },
+    { 0, 3, "\xff\xd8\xff" },              /* JPEG */
+    { 0, 4, "GIF8" },
+    { 0, 4, "PK\x03\x04" },                 /* zip, and OpenDocument, OOXML */
+    { 0, 2, "\x1f\x8b" },                   /* gzip */
+    { 0, 3, "BZh" },
+    { 0, 6, "\xfd" "7zXZ\0" },              /* xz */
+    { 0, 6, "7z\xbc\xaf\x27\x1c" },
+    { 0, 4, "\x28\xb5\x2f\xfd" },           /* zstd */
+    { 0, 4, "OggS" },
+    { 8, 4, "WEBP" },
+    { 4, 4, "ftyp" }                        /* MP4, QuickTime, HEIF */
+};
+
+/*
+  Return the method for a file beginning with the len bytes of buf, deflating
+    its first bytes with stream in out (of size_out bytes) when it is not in
+    an already compressed format. stream is reset after.
+*/
+local int ziplocal_probeMethod OF((z_stream* stream, const void* buf,
+                                   unsigned len, Bytef* out, uInt size_out));
+local int ziplocal_probeMethod (stream, buf, len, out, size_out)
+    z_stream* stream;
+    const void* buf;
+    unsigned len;
+    Bytef* out;
+    uInt size_out;
+{
+    uInt size_probe = (len > ZIP_PROBESIZE) ? ZIP_PROBESIZE : (uInt)len;
+    int method = Z_DEFLATED;
+    int err;
+    uInt i;
+
+    for (i=0;i<sizeof(compressed_formats)/sizeof(compressed_formats[0]);i++)
+        if ((len >= compressed_formats[i].offset+compressed_formats[i].size) &&
+            (memcmp((const char*)buf+compressed_formats[i].offset,
+                    compressed_formats[i].signature,
+                    compressed_formats[i].size)==0))
+            return 0;
+
+    /* out must be large enough to know that the probe does not gain */
+    if ((stream==NULL) || (size_out < size_probe))
+        return Z_DEFLATED;
+
+    stream->next_in = (Bytef*)buf;
+    stream->avail_in = size_probe;
+    stream->next_out = out;
+    stream->avail_out = size_out;
+    err = deflate(stream, Z_FINISH);
+    if ((err==Z_STREAM_END) &&
+        (stream->total_out >= size_probe - size_probe/ZIP_PROBEMINGAIN))
+        method = 0;
+    else if ((err!=Z_STREAM_END) && (stream->avail_out==0))
+        method = 0;
+    deflateReset(stream);
+    return method;
+}
+
+extern int ZEXPORT zipChooseMethod (buf, len, level)
+    const void* buf;
+    unsigned len;
+    int level;
+{
+    z_stream stream;
+    Bytef out[ZIP_PROBESIZE];
+    int method;
+
+    if ((level == 0) || (buf == NULL) || (len == 0))
+        return 0;
+
+    /* a small window is enough for ZIP_PROBESIZE bytes */
+    stream.zalloc = (alloc_func)0;
+    stream.zfree = (free_func)0;
+    stream.opaque = (voidpf)0;
+    if (deflateInit2(&stream, level, Z_DEFLATED, -12, 5,
+                     Z_DEFAULT_STRATEGY) != Z_OK)
+        return ziplocal_probeMethod(NULL,buf,len,NULL,0);
+    method = ziplocal_probeMethod(&stream,buf,len,out,ZIP_PROBESIZE);
+    deflateEnd(&stream);
+    return method;
+}
+
+/*
+  Choose the method of a file opened with ZIP_METHOD_AUTO, with its first
+    data, and set it in its local and central headers. The local header must
+    still be in buffered_data, else the file stays deflated.
+*/
+local void zipChooseCurrentMethod OF((zip_internal* zi, const void* buf,
+                                      unsigned len));
+local void zipChooseCurrentMethod (zi, buf, len)
+    zip_internal* zi;
+    const void* buf;
+    unsigned len;
+{
+    int method = 0;
+    zi->ci.method_auto = 0;
+    if (!zi->ci.localheader_in_buffer)
+        return;
+
+    /* the probe is deflated after the headers, where the data will go */
+    if (len > 0)
+        method = ziplocal_probeMethod(&zi->ci.stream,buf,len,
+                            zi->ci.buffered_data+zi->ci.pos_in_buffered_data,
+                            Z_BUFSIZE-zi->ci.pos_in_buffered_data);
+    zi->ci.stream.next_out = zi->ci.buffered_data+zi->ci.pos_in_buffered_data;
+    zi->ci.stream.avail_out = Z_BUFSIZE-zi->ci.pos_in_buffered_data;
+    zi->ci.stream.total_in = 0;
+    zi->ci.stream.total_out = 0;
+
+    if (method == 0)
+    {
+        zi->ci.method = 0;
+        zi->ci.flag &= ~6;  /* no compression level */
+        ziplocal_putValue_inmemory(zi->ci.buffered_data+6,(uLong)zi->ci.flag,2);
+        ziplocal_putValue_inmemory(zi->ci.buffered_data+8,(uLong)0,2);
+        ziplocal_putValue_inmemory(zi->ci.central_header+8,(uLong)zi->ci.flag,2);
+        ziplocal_putValue_inmemory(zi->ci.central_header+10,(uLong)0,2);
+    }
+}
+
+local int zipFlushWriteBuffer(zi)
+  zip_internal* zi;
+{
+    int err=ZIP_OK;
+
+    if (zi->ci.encrypt != 0)
+    {
+#ifndef NOCRYPT
+        uInt i;
+        int t;
+        for (i=zi->ci.size_header_in_buffered_data;
+             i<zi->ci.pos_in_buffered_data;i++)
+            zi->ci.buffered_data[i] = zencode(zi->ci.keys, zi->ci.pcrc_32_tab,
+                                       zi->ci.buffered_data[i],t);
+#endif
+    }
+    if (ZWRITE(zi->z_filefunc,zi->filestream,zi->ci.buffered_data,zi->ci.pos_in_buffered_data)
+                                                                    !=zi->ci.pos_in_buffered_data)
+      err = ZIP_ERRNO;
+    zi->ci.pos_in_buffered_data = 0;
+    zi->ci.size_header_in_buffered_data = 0;
+    zi->ci.localheader_in_buffer = 0;
+    return err;
+}
+
+/*
+  Add a part of the headers of the file in buffered_data, where it waits for
+    the first data of the file, so both are written together. A part which
+    does not fit is written directly.
+*/
+local int zipAddHeaderInBuffer OF((zip_internal* zi, const void* buf, uInt len));
+local int zipAddHeaderInBuffer (zi, buf, len)
+    zip_internal* zi;
+    const void* buf;
+    uInt len;
+{
+    if (zi->ci.pos_in_buffered_data + len > Z_BUFSIZE)
+        if (zipFlushWriteBuffer(zi) == ZIP_ERRNO)
+            return ZIP_ERRNO;
+
+    if (len > Z_BUFSIZE)
+    {
+        if (ZWRITE(zi->z_filefunc,zi->filestream,buf,len) != len)
+            return ZIP_ERRNO;
+        return ZIP_OK;
+    }
+    memcpy(zi->ci.buffered_data+zi->ci.pos_in_buffered_data,buf,len);
+    zi->ci.pos_in_buffered_data += len;
+    zi->ci.size_header_in_buffered_data += len;
+    return ZIP_OK;
+}
+
+extern int ZEXPORT zipOpenNewFileInZip3_64 (file, filename, zipfi,
                                          extrafield_local, size_extrafield_local,
                                          extrafield_global, size_extrafield_global,
                                          comment, method, level, raw,
                                          windowBits, memLevel, strategy,
-                                         password, crcForCrypting)
+                                         password, crcForCrypting, zip64)
     zipFile file;
     const char* filename;
     const zip_fileinfo* zipfi;
@@ -711,6 +1071,7 @@ extern int ZEXPORT zipOpenNewFileInZip3 (file, filename, zipfi,
     int strategy;
     const char* password;
     uLong crcForCrypting;
+    int zip64;
 {
     zip_internal* zi;
     uInt size_filename;
@@ -725,7 +1086,9 @@ extern int ZEXPORT zipOpenNewFileInZip3 (file, filename, zipfi,
 
     if (file == NULL)
         return ZIP_PARAMERROR;
-    if ((method!=0) && (method!=Z_DEFLATED))
+    if ((method!=0) && (method!=Z_DEFLATED) && (method!=ZIP_METHOD_AUTO))
+        return ZIP_PARAMERROR;
+    if ((method==ZIP_METHOD_AUTO) && (raw))
         return ZIP_PARAMERROR;
 
     zi = (zip_internal*)file;
@@ -767,16 +1130,33 @@ extern int ZEXPORT zipOpenNewFileInZip3 (file, filename, zipfi,
     if (password != NULL)
       zi->ci.flag |= 1;
 
+    /* with ZIP_METHOD_AUTO, the file is deflated until the first data are
+       probed, while its local header is still in buffered_data */
+    zi->ci.method_auto = 0;
+    if (method==ZIP_METHOD_AUTO)
+    {
+        method = (level != 0) ? Z_DEFLATED : 0;
+        zi->ci.method_auto = (level != 0);
+    }
+
     zi->ci.crc32 = 0;
     zi->ci.method = method;
     zi->ci.encrypt = 0;
-    zi->ci.stream_initialised = 0;
     zi->ci.pos_in_buffered_data = 0;
     zi->ci.raw = raw;
+    zi->ci.zip64 = zip64;
+    zi->ci.totalCompressedData = 0;
+    zi->ci.totalUncompressedData = 0;
     zi->ci.pos_local_header = ZTELL(zi->z_filefunc,zi->filestream) ;
+    zi->ci.size_filename = size_filename;
+    zi->ci.size_extrafield_global = size_extrafield_global;
     zi->ci.size_centralheader = SIZECENTRALHEADER + size_filename +
                                       size_extrafield_global + size_comment;
-    zi->ci.central_header = (char*)ALLOC((uInt)zi->ci.size_centralheader);
+    /* room is kept for a Zip64 extra field, added on close if needed */
+    zi->ci.central_header = (char*)ALLOC((uInt)zi->ci.size_centralheader +
+                                         SIZEZIP64EXTRAFIELD);
+    if (zi->ci.central_header == NULL)
+        return ZIP_INTERNALERROR;
 
     ziplocal_putValue_inmemory(zi->ci.central_header,(uLong)CENTRALHEADERMAGIC,4);
     /* version info */
@@ -815,65 +1195,94 @@ extern int ZEXPORT zipOpenNewFileInZip3 (file, filename, zipfi,
     for (i=0;i<size_comment;i++)
         *(zi->ci.central_header+SIZECENTRALHEADER+size_filename+
               size_extrafield_global+i) = *(comment+i);
-    if (zi->ci.central_header == NULL)
-        return ZIP_INTERNALERROR;
-
-    /* write the local header */
-    err = ziplocal_putValue(&zi->z_filefunc,zi->filestream,(uLong)LOCALHEADERMAGIC,4);
-
-    if (err==ZIP_OK)
-        err = ziplocal_putValue(&zi->z_filefunc,zi->filestream,(uLong)20,2);/* version needed to extract */
-    if (err==ZIP_OK)
-        err = ziplocal_putValue(&zi->z_filefunc,zi->filestream,(uLong)zi->ci.flag,2);
-
-    if (err==ZIP_OK)
-        err = ziplocal_putValue(&zi->z_filefunc,zi->filestream,(uLong)zi->ci.method,2);
-
-    if (err==ZIP_OK)
-        err = ziplocal_putValue(&zi->z_filefunc,zi->filestream,(uLong)zi->ci.dosDate,4);
-
-    if (err==ZIP_OK)
-        err = ziplocal_putValue(&zi->z_filefunc,zi->filestream,(uLong)0,4); /* crc 32, unknown */
-    if (err==ZIP_OK)
-        err = ziplocal_putValue(&zi->z_filefunc,zi->filestream,(uLong)0,4); /* compressed size, unknown */
-    if (err==ZIP_OK)
-        err = ziplocal_putValue(&zi->z_filefunc,zi->filestream,(uLong)0,4); /* uncompressed size, unknown */
 
-    if (err==ZIP_OK)
-        err = ziplocal_putValue(&zi->z_filefunc,zi->filestream,(uLong)size_filename,2);
-
-    if (err==ZIP_OK)
-        err = ziplocal_putValue(&zi->z_filefunc,zi->filestream,(uLong)size_extrafield_local,2);
+    /* the local header is assembled in buffered_data, and written with the
+       first data of the file */
+    zi->ci.size_header_in_buffered_data = 0;
+    zi->ci.localheader_in_buffer = 1;
+    {
+        unsigned char header[SIZELOCALHEADER];
+        ziplocal_putValue_inmemory(header,(uLong)LOCALHEADERMAGIC,4);
+        /* version needed to extract */
+        ziplocal_putValue_inmemory(header+4,(uLong)(zi->ci.zip64 ? 45 : 20),2);
+        ziplocal_putValue_inmemory(header+6,(uLong)zi->ci.flag,2);
+        ziplocal_putValue_inmemory(header+8,(uLong)zi->ci.method,2);
+        ziplocal_putValue_inmemory(header+10,(uLong)zi->ci.dosDate,4);
+        ziplocal_putValue_inmemory(header+14,(uLong)0,4); /* crc 32, unknown */
+        /* compressed and uncompressed sizes, unknown. With zip64, they are
+           in the Zip64 extra field */
+        ziplocal_putValue_inmemory(header+18,
+                                   (uLong)(zi->ci.zip64 ? 0xffffffff : 0),4);
+        ziplocal_putValue_inmemory(header+22,
+                                   (uLong)(zi->ci.zip64 ? 0xffffffff : 0),4);
+        ziplocal_putValue_inmemory(header+26,(uLong)size_filename,2);
+        ziplocal_putValue_inmemory(header+28,
+                    (uLong)size_extrafield_local +
+                    (zi->ci.zip64 ? SIZEZIP64LOCALEXTRAFIELD : 0),2);
+        err = zipAddHeaderInBuffer(zi,header,SIZELOCALHEADER);
+    }
 
     if ((err==ZIP_OK) && (size_filename>0))
-        if (ZWRITE(zi->z_filefunc,zi->filestream,filename,size_filename)!=size_filename)
-                err = ZIP_ERRNO;
+        err = zipAddHeaderInBuffer(zi,filename,size_filename);
+
+    if ((err==ZIP_OK) && (zi->ci.zip64))
+    {
+        /* Zip64 extra field, the sizes are written on close */
+        unsigned char zip64extra[SIZEZIP64LOCALEXTRAFIELD];
+        memset(zip64extra,0,SIZEZIP64LOCALEXTRAFIELD);
+        ziplocal_putValue_inmemory(zip64extra,(uLong)0x0001,2);
+        ziplocal_putValue_inmemory(zip64extra+2,(uLong)(SIZEZIP64LOCALEXTRAFIELD-4),2);
+        err = zipAddHeaderInBuffer(zi,zip64extra,SIZEZIP64LOCALEXTRAFIELD);
+    }
 
     if ((err==ZIP_OK) && (size_extrafield_local>0))
-        if (ZWRITE(zi->z_filefunc,zi->filestream,extrafield_local,size_extrafield_local)
-                                                                           !=size_extrafield_local)
-                err = ZIP_ERRNO;
+        err = zipAddHeaderInBuffer(zi,extrafield_local,size_extrafield_local);
 
     zi->ci.stream.avail_in = (uInt)0;
-    zi->ci.stream.avail_out = (uInt)Z_BUFSIZE;
-    zi->ci.stream.next_out = zi->ci.buffered_data;
     zi->ci.stream.total_in = 0;
     zi->ci.stream.total_out = 0;
 
     if ((err==ZIP_OK) && (zi->ci.method == Z_DEFLATED) && (!zi->ci.raw))
     {
-        zi->ci.stream.zalloc = (alloc_func)0;
-        zi->ci.stream.zfree = (free_func)0;
-        zi->ci.stream.opaque = (voidpf)0;
-
         if (windowBits>0)
             windowBits = -windowBits;
 
-        err = deflateInit2(&zi->ci.stream, level,
-               Z_DEFLATED, windowBits, memLevel, strategy);
+        /* the deflate state of the previous file is reset rather than
+           freed and allocated again, if its size does not change */
+        if ((zi->ci.stream_initialised) &&
+            ((zi->ci.stream_windowBits != windowBits) ||
+             (zi->ci.stream_memLevel != memLevel)))
+        {
+            deflateEnd(&zi->ci.stream);
+            zi->ci.stream_initialised = 0;
+        }
+
+        if (zi->ci.stream_initialised)
+        {
+            err = deflateReset(&zi->ci.stream);
+            if ((err==Z_OK) &&
+                ((zi->ci.stream_level != level) ||
+                 (zi->ci.stream_strategy != strategy)))
+                err = deflateParams(&zi->ci.stream, level, strategy);
+        }
+        else
+        {
+            zi->ci.stream.zalloc = zi->zalloc;
+            zi->ci.stream.zfree = zi->zfree;
+            zi->ci.stream.opaque = zi->opaque;
 
-        if (err==Z_OK)
-            zi->ci.stream_initialised = 1;
+            err = deflateInit2(&zi->ci.stream, level,
+                   Z_DEFLATED, windowBits, memLevel, strategy);
+
+            if (err==Z_OK)
+            {
+                zi->ci.stream_initialised = 1;
+                zi->ci.stream_windowBits = windowBits;
+                zi->ci.stream_memLevel = memLevel;
+            }
+        }
+        zi->ci.stream_level = level;
+        zi->ci.stream_strategy = strategy;
     }
 #    ifndef NOCRYPT
     zi->ci.crypt_header_size = 0;
@@ -888,16 +1297,75 @@ extern int ZEXPORT zipOpenNewFileInZip3 (file, filename, zipfi,
         sizeHead=crypthead(password,bufHead,RAND_HEAD_LEN,zi->ci.keys,zi->ci.pcrc_32_tab,crcForCrypting);
         zi->ci.crypt_header_size = sizeHead;
 
-        if (ZWRITE(zi->z_filefunc,zi->filestream,bufHead,sizeHead) != sizeHead)
-                err = ZIP_ERRNO;
+        err = zipAddHeaderInBuffer(zi,bufHead,sizeHead);
     }
 #    endif
 
+    /* the data follows the headers in buffered_data */
+    zi->ci.stream.avail_out = (uInt)(Z_BUFSIZE - zi->ci.pos_in_buffered_data);
+    zi->ci.stream.next_out = zi->ci.buffered_data + zi->ci.pos_in_buffered_data;
+
     if (err==Z_OK)
         zi->in_opened_file_inzip = 1;
     return err;
 }
 
+extern int ZEXPORT zipOpenNewFileInZip3 (file, filename, zipfi,
+                                         extrafield_local, size_extrafield_local,
+                                         extrafield_global, size_extrafield_global,
+                                         comment, method, level, raw,
+                                         windowBits, memLevel, strategy,
+                                         password, crcForCrypting)
+    zipFile file;
+    const char* filename;
+    const zip_fileinfo* zipfi;
+    const void* extrafield_local;
+    uInt size_extrafield_local;
+    const void* extrafield_global;
+    uInt size_extrafield_global;
+    const char* comment;
+    int method;
+    int level;
+    int raw;
+    int windowBits;
+    int memLevel;
+    int strategy;
+    const char* password;
+    uLong crcForCrypting;
+{
+    return zipOpenNewFileInZip3_64 (file, filename, zipfi,
+                                    extrafield_local, size_extrafield_local,
+                                    extrafield_global, size_extrafield_global,
+                                    comment, method, level, raw,
+                                    windowBits, memLevel, strategy,
+                                    password, crcForCrypting, 0);
+}
+
+extern int ZEXPORT zipOpenNewFileInZip2_64(file, filename, zipfi,
+                                        extrafield_local, size_extrafield_local,
+                                        extrafield_global, size_extrafield_global,
+                                        comment, method, level, raw, zip64)
+    zipFile file;
+    const char* filename;
+    const zip_fileinfo* zipfi;
+    const void* extrafield_local;
+    uInt size_extrafield_local;
+    const void* extrafield_global;
+    uInt size_extrafield_global;
+    const char* comment;
+    int method;
+    int level;
+    int raw;
+    int zip64;
+{
+    return zipOpenNewFileInZip3_64 (file, filename, zipfi,
+                                    extrafield_local, size_extrafield_local,
+                                    extrafield_global, size_extrafield_global,
+                                    comment, method, level, raw,
+                                    -MAX_WBITS, DEF_MEM_LEVEL, Z_DEFAULT_STRATEGY,
+                                    NULL, 0, zip64);
+}
+
 extern int ZEXPORT zipOpenNewFileInZip2(file, filename, zipfi,
                                         extrafield_local, size_extrafield_local,
                                         extrafield_global, size_extrafield_global,
@@ -943,28 +1411,6 @@ extern int ZEXPORT zipOpenNewFileInZip (file, filename, zipfi,
                                  comment, method, level, 0);
 }
 
-local int zipFlushWriteBuffer(zi)
-  zip_internal* zi;
-{
-    int err=ZIP_OK;
-
-    if (zi->ci.encrypt != 0)
-    {
-#ifndef NOCRYPT
-        uInt i;
-        int t;
-        for (i=0;i<zi->ci.pos_in_buffered_data;i++)
-            zi->ci.buffered_data[i] = zencode(zi->ci.keys, zi->ci.pcrc_32_tab,
-                                       zi->ci.buffered_data[i],t);
-#endif
-    }
-    if (ZWRITE(zi->z_filefunc,zi->filestream,zi->ci.buffered_data,zi->ci.pos_in_buffered_data)
-                                                                    !=zi->ci.pos_in_buffered_data)
-      err = ZIP_ERRNO;
-    zi->ci.pos_in_buffered_data = 0;
-    return err;
-}
-
 extern int ZEXPORT zipWriteInFileInZip (file, buf, len)
     zipFile file;
     const void* buf;
@@ -980,9 +1426,13 @@ extern int ZEXPORT zipWriteInFileInZip (file, buf, len)
     if (zi->in_opened_file_inzip == 0)
         return ZIP_PARAMERROR;
 
+    if ((zi->ci.method_auto) && (len > 0))
+        zipChooseCurrentMethod(zi,buf,len);
+
     zi->ci.stream.next_in = (void*)buf;
     zi->ci.stream.avail_in = len;
-    zi->ci.crc32 = crc32(zi->ci.crc32,buf,len);
+    zi->ci.crc32 = crc32hw(zi->ci.crc32,buf,len);
+    zi->ci.totalUncompressedData += len;
 
     while ((err==ZIP_OK) && (zi->ci.stream.avail_in>0))
     {
@@ -1003,18 +1453,33 @@ extern int ZEXPORT zipWriteInFileInZip (file, buf, len)
             uLong uTotalOutBefore = zi->ci.stream.total_out;
             err=deflate(&zi->ci.stream,  Z_NO_FLUSH);
             zi->ci.pos_in_buffered_data += (uInt)(zi->ci.stream.total_out - uTotalOutBefore) ;
+            zi->ci.totalCompressedData += zi->ci.stream.total_out - uTotalOutBefore;
 
         }
+        else if ((zi->ci.stream.avail_in >= Z_BUFSIZE) &&
+                 (zi->ci.pos_in_buffered_data == 0) && (zi->ci.encrypt == 0))
+        {
+            /* stored or raw, with an empty buffer : the whole Z_BUFSIZE
+               blocks are written directly from buf, without copy */
+            uInt write_this = zi->ci.stream.avail_in -
+                              (zi->ci.stream.avail_in % Z_BUFSIZE);
+            if (ZWRITE(zi->z_filefunc,zi->filestream,
+                       zi->ci.stream.next_in,write_this) != write_this)
+                err = ZIP_ERRNO;
+            zi->ci.stream.avail_in -= write_this;
+            zi->ci.stream.next_in += write_this;
+            zi->ci.stream.total_in += write_this;
+            zi->ci.stream.total_out += write_this;
+            zi->ci.totalCompressedData += write_this;
+        }
         else
         {
-            uInt copy_this,i;
+            uInt copy_this;
             if (zi->ci.stream.avail_in < zi->ci.stream.avail_out)
                 copy_this = zi->ci.stream.avail_in;
             else
                 copy_this = zi->ci.stream.avail_out;
-            for (i=0;i<copy_this;i++)
-                *(((char*)zi->ci.stream.next_out)+i) =
-                    *(((const char*)zi->ci.stream.next_in)+i);
+            memcpy(zi->ci.stream.next_out,zi->ci.stream.next_in,copy_this);
             {
                 zi->ci.stream.avail_in -= copy_this;
                 zi->ci.stream.avail_out-= copy_this;
@@ -1023,6 +1488,7 @@ extern int ZEXPORT zipWriteInFileInZip (file, buf, len)
                 zi->ci.stream.total_in+= copy_this;
                 zi->ci.stream.total_out+= copy_this;
                 zi->ci.pos_in_buffered_data += copy_this;
+                zi->ci.totalCompressedData += copy_this;
             }
         }
     }
@@ -1030,13 +1496,15 @@ extern int ZEXPORT zipWriteInFileInZip (file, buf, len)
     return err;
 }
 
-extern int ZEXPORT zipCloseFileInZipRaw (file, uncompressed_size, crc32)
+extern int ZEXPORT zipCloseFileInZipRaw64 (file, uncompressed_size, crc32)
     zipFile file;
-    uLong uncompressed_size;
+    ZPOS64_T uncompressed_size;
     uLong crc32;
 {
     zip_internal* zi;
-    uLong compressed_size;
+    ZPOS64_T compressed_size;
+    ZPOS64_T offset_local_header;
+    uLong size_zip64extra=0;
     int err=ZIP_OK;
 
     if (file == NULL)
@@ -1045,6 +1513,8 @@ extern int ZEXPORT zipCloseFileInZipRaw (file, uncompressed_size, crc32)
 
     if (zi->in_opened_file_inzip == 0)
         return ZIP_PARAMERROR;
+    if (zi->ci.method_auto) /* empty file */
+        zipChooseCurrentMethod(zi,NULL,0);
     zi->ci.stream.avail_in = 0;
 
     if ((zi->ci.method == Z_DEFLATED) && (!zi->ci.raw))
@@ -1061,63 +1531,144 @@ extern int ZEXPORT zipCloseFileInZipRaw (file, uncompressed_size, crc32)
         uTotalOutBefore = zi->ci.stream.total_out;
         err=deflate(&zi->ci.stream,  Z_FINISH);
         zi->ci.pos_in_buffered_data += (uInt)(zi->ci.stream.total_out - uTotalOutBefore) ;
+        zi->ci.totalCompressedData += zi->ci.stream.total_out - uTotalOutBefore;
     }
 
     if (err==Z_STREAM_END)
         err=ZIP_OK; /* this is normal */
 
-    if ((zi->ci.pos_in_buffered_data>0) && (err==ZIP_OK))
-        if (zipFlushWriteBuffer(zi)==ZIP_ERRNO)
-            err = ZIP_ERRNO;
-
-    if ((zi->ci.method == Z_DEFLATED) && (!zi->ci.raw))
-    {
-        err=deflateEnd(&zi->ci.stream);
-        zi->ci.stream_initialised = 0;
-    }
+    /* the deflate state is kept for the next file, until zipClose */
 
     if (!zi->ci.raw)
     {
         crc32 = (uLong)zi->ci.crc32;
-        uncompressed_size = (uLong)zi->ci.stream.total_in;
+        uncompressed_size = zi->ci.totalUncompressedData;
     }
-    compressed_size = (uLong)zi->ci.stream.total_out;
+    compressed_size = zi->ci.totalCompressedData;
 #    ifndef NOCRYPT
     compressed_size += zi->ci.crypt_header_size;
 #    endif
+    offset_local_header = zi->ci.pos_local_header -
+                                    zi->add_position_when_writting_offset;
 
     ziplocal_putValue_inmemory(zi->ci.central_header+16,crc32,4); /*crc*/
-    ziplocal_putValue_inmemory(zi->ci.central_header+20,
-                                compressed_size,4); /*compr size*/
     if (zi->ci.stream.data_type == Z_ASCII)
         ziplocal_putValue_inmemory(zi->ci.central_header+36,(uLong)Z_ASCII,2);
+
+    /* the values which do not fit in 32 bits are set to 0xffffffff and
+       stored in a Zip64 extra field, added after the extra field given by
+       the caller */
+    if (uncompressed_size >= 0xffffffff)
+        size_zip64extra += 8;
+    if (compressed_size >= 0xffffffff)
+        size_zip64extra += 8;
+    if (offset_local_header >= 0xffffffff)
+        size_zip64extra += 8;
+
+    if (size_zip64extra>0)
+    {
+        char* p = zi->ci.central_header + SIZECENTRALHEADER +
+                  zi->ci.size_filename + zi->ci.size_extrafield_global;
+        uLong size_after = zi->ci.size_centralheader -
+                  (SIZECENTRALHEADER + zi->ci.size_filename +
+                   zi->ci.size_extrafield_global);
+
+        /* move the comment after the Zip64 extra field */
+        memmove(p+4+size_zip64extra,p,size_after);
+
+        ziplocal_putValue_inmemory(p,(uLong)0x0001,2);
+        ziplocal_putValue_inmemory(p+2,size_zip64extra,2);
+        p += 4;
+        if (uncompressed_size >= 0xffffffff)
+        {
+            ziplocal_putValue_inmemory(p,uncompressed_size,8);
+            p += 8;
+        }
+        if (compressed_size >= 0xffffffff)
+        {
+            ziplocal_putValue_inmemory(p,compressed_size,8);
+            p += 8;
+        }
+        if (offset_local_header >= 0xffffffff)
+            ziplocal_putValue_inmemory(p,offset_local_header,8);
+
+        ziplocal_putValue_inmemory(zi->ci.central_header+6,(uLong)45,2);
+        ziplocal_putValue_inmemory(zi->ci.central_header+30,
+                    zi->ci.size_extrafield_global+4+size_zip64extra,2);
+        zi->ci.size_centralheader += 4+size_zip64extra;
+    }
+
+    ziplocal_putValue_inmemory(zi->ci.central_header+20,
+            (compressed_size>=0xffffffff) ? 0xffffffff : compressed_size,4);
     ziplocal_putValue_inmemory(zi->ci.central_header+24,
-                                uncompressed_size,4); /*uncompr size*/
+            (uncompressed_size>=0xffffffff) ? 0xffffffff : uncompressed_size,4);
+    ziplocal_putValue_inmemory(zi->ci.central_header+42,
+            (offset_local_header>=0xffffffff) ? 0xffffffff : offset_local_header,4);
 
     if (err==ZIP_OK)
-        err = add_data_in_datablock(&zi->central_dir,zi->ci.central_header,
-                                       (uLong)zi->ci.size_centralheader);
+        err = add_data_in_buffer(&zi->central_dir,zi->ci.central_header,
+                                 (uLong)zi->ci.size_centralheader);
     free(zi->ci.central_header);
 
+    /* the crc and the sizes of the local header : at its offset 14, or for
+       zip64 the crc at offset 14 and the sizes in the Zip64 extra field,
+       after the filename. Without reserved Zip64 extra field, sizes which
+       overflow are written as 0xffffffff, the central dir has the real
+       values */
     if (err==ZIP_OK)
     {
-        long cur_pos_inzip = ZTELL(zi->z_filefunc,zi->filestream);
-        if (ZSEEK(zi->z_filefunc,zi->filestream,
-                  zi->ci.pos_local_header + 14,ZLIB_FILEFUNC_SEEK_SET)!=0)
-            err = ZIP_ERRNO;
+        unsigned char values[4+8+8];
+        uLong size_values;
+        ZPOS64_T pos_sizes = 14 + 4;
 
-        if (err==ZIP_OK)
-            err = ziplocal_putValue(&zi->z_filefunc,zi->filestream,crc32,4); /* crc 32, unknown */
+        ziplocal_putValue_inmemory(values,crc32,4);
+        if (zi->ci.zip64)
+        {
+            ziplocal_putValue_inmemory(values+4,uncompressed_size,8);
+            ziplocal_putValue_inmemory(values+12,compressed_size,8);
+            pos_sizes = SIZELOCALHEADER + zi->ci.size_filename + 4;
+            size_values = 8+8;
+        }
+        else
+        {
+            ziplocal_putValue_inmemory(values+4,compressed_size,4);
+            ziplocal_putValue_inmemory(values+8,uncompressed_size,4);
+            size_values = 4+4;
+        }
+
+        if (zi->ci.localheader_in_buffer)
+        {
+            /* the local header is not written yet : it is set in memory, and
+               written with the data */
+            memcpy(zi->ci.buffered_data+14,values,4);
+            memcpy(zi->ci.buffered_data+pos_sizes,values+4,size_values);
+            if (zipFlushWriteBuffer(zi)==ZIP_ERRNO)
+                err = ZIP_ERRNO;
+        }
+        else
+        {
+            long cur_pos_inzip;
 
-        if (err==ZIP_OK) /* compressed size, unknown */
-            err = ziplocal_putValue(&zi->z_filefunc,zi->filestream,compressed_size,4);
+            if ((zi->ci.pos_in_buffered_data>0) &&
+                (zipFlushWriteBuffer(zi)==ZIP_ERRNO))
+                err = ZIP_ERRNO;
+            cur_pos_inzip = ZTELL(zi->z_filefunc,zi->filestream);
 
-        if (err==ZIP_OK) /* uncompressed size, unknown */
-            err = ziplocal_putValue(&zi->z_filefunc,zi->filestream,uncompressed_size,4);
+            if ((err==ZIP_OK) &&
+                (ZPWRITE(zi->z_filefunc,zi->filestream,values,4,
+                         zi->ci.pos_local_header + 14) != 4))
+                err = ZIP_ERRNO;
+            if ((err==ZIP_OK) &&
+                (ZPWRITE(zi->z_filefunc,zi->filestream,values+4,size_values,
+                         zi->ci.pos_local_header + pos_sizes) != size_values))
+                err = ZIP_ERRNO;
 
-        if (ZSEEK(zi->z_filefunc,zi->filestream,
-                  cur_pos_inzip,ZLIB_FILEFUNC_SEEK_SET)!=0)
-            err = ZIP_ERRNO;
+            /* without positional write, ZPWRITE moved the position */
+            if ((zi->z_filefunc.zpwrite_file == NULL) &&
+                (ZSEEK(zi->z_filefunc,zi->filestream,
+                       cur_pos_inzip,ZLIB_FILEFUNC_SEEK_SET)!=0))
+                err = ZIP_ERRNO;
+        }
     }
 
     zi->number_entry ++;
@@ -1126,10 +1677,18 @@ extern int ZEXPORT zipCloseFileInZipRaw (file, uncompressed_size, crc32)
     return err;
 }
 
+extern int ZEXPORT zipCloseFileInZipRaw (file, uncompressed_size, crc32)
+    zipFile file;
+    uLong uncompressed_size;
+    uLong crc32;
+{
+    return zipCloseFileInZipRaw64 (file,uncompressed_size,crc32);
+}
+
 extern int ZEXPORT zipCloseFileInZip (file)
     zipFile file;
 {
-    return zipCloseFileInZipRaw (file,0,0);
+    return zipCloseFileInZipRaw64 (file,0,0);
 }
 
 extern int ZEXPORT zipClose (file, global_comment)
@@ -1138,8 +1697,9 @@ extern int ZEXPORT zipClose (file, global_comment)
 {
     zip_internal* zi;
     int err = 0;
-    uLong size_centraldir = 0;
-    uLong centraldir_pos_inzip;
+    ZPOS64_T size_centraldir = 0;
+    ZPOS64_T centraldir_pos_inzip;
+    ZPOS64_T pos_zip64endcentraldir;
     uInt size_global_comment;
     if (file == NULL)
         return ZIP_PARAMERROR;
@@ -1160,58 +1720,100 @@ extern int ZEXPORT zipClose (file, global_comment)
         size_global_comment = (uInt)strlen(global_comment);
 
     centraldir_pos_inzip = ZTELL(zi->z_filefunc,zi->filestream);
+    size_centraldir = zi->central_dir.filled_in_buffer;
+    pos_zip64endcentraldir = centraldir_pos_inzip + size_centraldir;
+
+    /* the end of central dir records and the comment are added in the buffer
+       after the central dir, and all is written with a single write */
     if (err==ZIP_OK)
     {
-        linkedlist_datablock_internal* ldi = zi->central_dir.first_block ;
-        while (ldi!=NULL)
+        unsigned char end[SIZEZIP64ENDCENTRALDIR+SIZEZIP64LOCATOR+
+                          SIZEENDCENTRALDIR];
+        unsigned char* p = end;
+
+        /* a Zip64 end of central dir record and its locator are needed when
+           the end of central dir record cannot hold the values */
+        if ((zi->number_entry >= 0xffff) ||
+            (size_centraldir >= 0xffffffff) ||
+            (centraldir_pos_inzip - zi->add_position_when_writting_offset >= 0xffffffff))
         {
-            if ((err==ZIP_OK) && (ldi->filled_in_this_block>0))
-                if (ZWRITE(zi->z_filefunc,zi->filestream,
-                           ldi->data,ldi->filled_in_this_block)
-                              !=ldi->filled_in_this_block )
-                    err = ZIP_ERRNO;
-
-            size_centraldir += ldi->filled_in_this_block;
-            ldi = ldi->next_datablock;
+            ziplocal_putValue_inmemory(p,(uLong)ZIP64ENDHEADERMAGIC,4);
+            /* size of the remaining of the record */
+            ziplocal_putValue_inmemory(p+4,(uLong)(SIZEZIP64ENDCENTRALDIR-12),8);
+            /* version made by, version needed to extract */
+            ziplocal_putValue_inmemory(p+12,(uLong)VERSIONMADEBY,2);
+            ziplocal_putValue_inmemory(p+14,(uLong)45,2);
+            /* number of this disk, of the disk with the start of the
+               central directory */
+            ziplocal_putValue_inmemory(p+16,(uLong)0,4);
+            ziplocal_putValue_inmemory(p+20,(uLong)0,4);
+            /* number of entries in the central dir on this disk, in total */
+            ziplocal_putValue_inmemory(p+24,zi->number_entry,8);
+            ziplocal_putValue_inmemory(p+32,zi->number_entry,8);
+            /* size and offset of start of the central directory */
+            ziplocal_putValue_inmemory(p+40,size_centraldir,8);
+            ziplocal_putValue_inmemory(p+48,
+                centraldir_pos_inzip - zi->add_position_when_writting_offset,8);
+            p += SIZEZIP64ENDCENTRALDIR;
+
+            ziplocal_putValue_inmemory(p,(uLong)ZIP64ENDLOCHEADERMAGIC,4);
+            /* number of the disk with the start of the zip64 end of
+               central dir, its relative offset, total number of disks */
+            ziplocal_putValue_inmemory(p+4,(uLong)0,4);
+            ziplocal_putValue_inmemory(p+8,
+                pos_zip64endcentraldir - zi->add_position_when_writting_offset,8);
+            ziplocal_putValue_inmemory(p+16,(uLong)1,4);
+            p += SIZEZIP64LOCATOR;
         }
-    }
-    free_datablock(zi->central_dir.first_block);
-
-    if (err==ZIP_OK) /* Magic End */
-        err = ziplocal_putValue(&zi->z_filefunc,zi->filestream,(uLong)ENDHEADERMAGIC,4);
-
-    if (err==ZIP_OK) /* number of this disk */
-        err = ziplocal_putValue(&zi->z_filefunc,zi->filestream,(uLong)0,2);
-
-    if (err==ZIP_OK) /* number of the disk with the start of the central directory */
-        err = ziplocal_putValue(&zi->z_filefunc,zi->filestream,(uLong)0,2);
 
-    if (err==ZIP_OK) /* total number of entries in the central dir on this disk */
-        err = ziplocal_putValue(&zi->z_filefunc,zi->filestream,(uLong)zi->number_entry,2);
-
-    if (err==ZIP_OK) /* total number of entries in the central dir */
-        err = ziplocal_putValue(&zi->z_filefunc,zi->filestream,(uLong)zi->number_entry,2);
-
-    if (err==ZIP_OK) /* size of the central directory */
-        err = ziplocal_putValue(&zi->z_filefunc,zi->filestream,(uLong)size_centraldir,4);
-
-    if (err==ZIP_OK) /* offset of start of central directory with respect to the
-                            starting disk number */
-        err = ziplocal_putValue(&zi->z_filefunc,zi->filestream,
-                                (uLong)(centraldir_pos_inzip - zi->add_position_when_writting_offset),4);
-
-    if (err==ZIP_OK) /* zipfile comment length */
-        err = ziplocal_putValue(&zi->z_filefunc,zi->filestream,(uLong)size_global_comment,2);
+        ziplocal_putValue_inmemory(p,(uLong)ENDHEADERMAGIC,4);
+        /* number of this disk, of the disk with the start of the central
+           directory */
+        ziplocal_putValue_inmemory(p+4,(uLong)0,2);
+        ziplocal_putValue_inmemory(p+6,(uLong)0,2);
+        /* number of entries in the central dir on this disk, in total */
+        ziplocal_putValue_inmemory(p+8,zi->number_entry,2);
+        ziplocal_putValue_inmemory(p+10,zi->number_entry,2);
+        /* the values which overflow are written as 0xffff or 0xffffffff, the
+           Zip64 end of central dir record has the real ones */
+        /* size of the central directory, offset of its start with respect
+           to the starting disk number */
+        ziplocal_putValue_inmemory(p+12,size_centraldir,4);
+        ziplocal_putValue_inmemory(p+16,
+                centraldir_pos_inzip - zi->add_position_when_writting_offset,4);
+        /* zipfile comment length */
+        ziplocal_putValue_inmemory(p+20,(uLong)size_global_comment,2);
+        p += SIZEENDCENTRALDIR;
+
+        err = add_data_in_buffer(&zi->central_dir,end,(uLong)(p-end));
+        if ((err==ZIP_OK) && (size_global_comment>0))
+            err = add_data_in_buffer(&zi->central_dir,global_comment,
+                                     size_global_comment);
+    }
 
-    if ((err==ZIP_OK) && (size_global_comment>0))
-        if (ZWRITE(zi->z_filefunc,zi->filestream,
-                   global_comment,size_global_comment) != size_global_comment)
+    if (err==ZIP_OK)
+    {
+        unsigned char* data = zi->central_dir.data;
+        ZPOS64_T rest = zi->central_dir.filled_in_buffer;
+        while ((rest>0) && (err==ZIP_OK))
+        {
+            uLong write_this = (rest > 0x40000000) ? 0x40000000 : (uLong)rest;
+            if (ZWRITE(zi->z_filefunc,zi->filestream,data,write_this)
+                                                               !=write_this)
                 err = ZIP_ERRNO;
+            data += write_this;
+            rest -= write_this;
+        }
+    }
+    free_buffer(&zi->central_dir);
 
     if (ZCLOSE(zi->z_filefunc,zi->filestream) != 0)
         if (err == ZIP_OK)
             err = ZIP_ERRNO;
 
+    if (zi->ci.stream_initialised)
+        deflateEnd(&zi->ci.stream);
+
 #ifndef NO_ADDFILEINEXISTINGZIP
     TRYFREE(zi->globalcomment);
 #endif
@@ -1219,3 +1821,39 @@ extern int ZEXPORT zipClose (file, global_comment)
 
     return err;
 }
+
+extern int ZEXPORT zipGetCurrentFileMethod (file)
+    zipFile file;
+{
+    zip_internal* zi;
+    if (file == NULL)
+        return ZIP_PARAMERROR;
+    zi = (zip_internal*)file;
+    if (zi->in_opened_file_inzip == 0)
+        return ZIP_PARAMERROR;
+    return zi->ci.method;
+}
+
+extern int ZEXPORT zipSetAllocator (file, zalloc, zfree, opaque)
+    zipFile file;
+    alloc_func zalloc;
+    free_func zfree;
+    voidpf opaque;
+{
+    zip_internal* zi;
+    if ((file == NULL) || ((zalloc==(alloc_func)0) != (zfree==(free_func)0)))
+        return ZIP_PARAMERROR;
+    zi = (zip_internal*)file;
+    if (zi->in_opened_file_inzip == 1)
+        return ZIP_PARAMERROR;
+
+    if (zi->ci.stream_initialised)
+    {
+        deflateEnd(&zi->ci.stream);
+        zi->ci.stream_initialised = 0;
+    }
+    zi->zalloc = zalloc;
+    zi->zfree = zfree;
+    zi->opaque = opaque;
+    return ZIP_OK;
+}
@@ -6,6 +6,7 @@
    This unzip package allow creates .ZIP file, compatible with PKZip 2.04g
      WinZip, InfoZip tools and compatible.
    Multi volume ZipFile (span) are not supported.
+   Zip64 extra fields and end of central dir record are written when needed.
    Encryption compatible with pkzip 2.04g only supported
    Old compressions used by old PKZip 1.x are not supported
 
@@ -74,6 +75,10 @@ typedef voidp zipFile;
 #define ZIP_BADZIPFILE                  (-103)
 #define ZIP_INTERNALERROR               (-104)
 
+/* method of zipOpenNewFileInZip : deflate, or store when the first data
+   written do not compress (see zipChooseMethod) */
+#define ZIP_METHOD_AUTO                 (-1)
+
 #ifndef DEF_MEM_LEVEL
 #  if MAX_MEM_LEVEL >= 8
 #    define DEF_MEM_LEVEL 8
@@ -155,7 +160,8 @@ extern int ZEXPORT zipOpenNewFileInZip OF((zipFile file,
   if extrafield_global!=NULL and size_extrafield_global>0, extrafield_global
     contains the extrafield data the the local header
   if comment != NULL, comment contain the comment string
-  method contain the compression method (0 for store, Z_DEFLATED for deflate)
+  method contain the compression method (0 for store, Z_DEFLATED for deflate,
+    ZIP_METHOD_AUTO to choose one of them with the first data written)
   level contain the level of compression (can be Z_DEFAULT_COMPRESSION)
 */
 
@@ -200,6 +206,48 @@ extern int ZEXPORT zipOpenNewFileInZip3 OF((zipFile file,
     crcForCtypting : crc of file to compress (needed for crypting)
  */
 
+extern int ZEXPORT zipOpenNewFileInZip3_64 OF((zipFile file,
+                                               const char* filename,
+                                               const zip_fileinfo* zipfi,
+                                               const void* extrafield_local,
+                                               uInt size_extrafield_local,
+                                               const void* extrafield_global,
+                                               uInt size_extrafield_global,
+                                               const char* comment,
+                                               int method,
+                                               int level,
+                                               int raw,
+                                               int windowBits,
+                                               int memLevel,
+                                               int strategy,
+                                               const char* password,
+                                               uLong crcForCtypting,
+                                               int zip64));
+
+extern int ZEXPORT zipOpenNewFileInZip2_64 OF((zipFile file,
+                                               const char* filename,
+                                               const zip_fileinfo* zipfi,
+                                               const void* extrafield_local,
+                                               uInt size_extrafield_local,
+                                               const void* extrafield_global,
+                                               uInt size_extrafield_global,
+                                               const char* comment,
+                                               int method,
+                                               int level,
+                                               int raw,
+                                               int zip64));
+/*
+  Same than zipOpenNewFileInZip3 and zipOpenNewFileInZip2, except
+    zip64 : 1 if the file may be 4 GB or more. A Zip64 extra field is then
+      written in the local header, for the readers which do not use the
+      central dir.
+  Without it, the sizes and offsets which do not fit in 32 bits are still
+    written in a Zip64 extra field of the central dir (their value in the
+    local header is 0xffffffff), and the Zip64 end of central dir record is
+    written by zipClose when needed (more than 65534 files, or a central dir
+    after 4 GB).
+ */
+
 
 extern int ZEXPORT zipWriteInFileInZip OF((zipFile file,
                        const void* buf,
@@ -222,12 +270,52 @@ extern int ZEXPORT zipCloseFileInZipRaw OF((zipFile file,
   uncompressed_size and crc32 are value for the uncompressed size
 */
 
+extern int ZEXPORT zipCloseFileInZipRaw64 OF((zipFile file,
+                                              ZPOS64_T uncompressed_size,
+                                              uLong crc32));
+/*
+  Same than zipCloseFileInZipRaw, for files of 4 GB or more
+*/
+
 extern int ZEXPORT zipClose OF((zipFile file,
                 const char* global_comment));
 /*
   Close the zipfile
 */
 
+extern int ZEXPORT zipSetAllocator OF((zipFile file,
+                                       alloc_func zalloc,
+                                       free_func zfree,
+                                       voidpf opaque));
+/*
+  Set the functions allocating the deflate state, as zalloc and zfree of zlib
+    (called with opaque). zalloc and zfree NULL (the default) use malloc and
+    free. It can't be called while a file is opened in the zipfile.
+  The deflate state of a closed file is kept and reset (deflateReset and
+    deflateParams) for the next file, while windowBits and memLevel don't
+    change. It is freed by zipClose, so the memory given by zalloc must stay
+    valid until zipClose.
+*/
+
+extern int ZEXPORT zipChooseMethod OF((const void* buf,
+                                       unsigned len,
+                                       int level));
+/*
+  Return the method for a file beginning with the len bytes of buf : 0 (store)
+    when they are in an already compressed format (PNG, JPEG, zip...) or
+    when deflating the first ZIP_PROBESIZE bytes at level gains less than
+    1/ZIP_PROBEMINGAIN of them, else Z_DEFLATED. An empty file (len==0) is
+    stored, like with ZIP_METHOD_AUTO.
+  ZIP_METHOD_AUTO uses it on the first data given to zipWriteInFileInZip.
+*/
+
+extern int ZEXPORT zipGetCurrentFileMethod OF((zipFile file));
+/*
+  Return the method of the file opened in the zipfile (0 or Z_DEFLATED), or
+    ZIP_PARAMERROR. With ZIP_METHOD_AUTO, it is known after the first
+    zipWriteInFileInZip (a file closed without data is stored).
+*/
+
 #ifdef __cplusplus
 }
 #endif